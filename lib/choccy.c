@@ -0,0 +1,145 @@
+/*
+ * choccy.c
+ * The Choccy command line: an interactive REPL, or a script runner when
+ * given a file or standard input.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyparsing.h"
+#include "choccyenv.h"
+#include "choccymemo.h"
+#include "choccycons.h"
+#include "choccypar.h"
+#include "choccybatch.h"
+#include "choccyimage.h"
+#include <time.h>
+
+/*
+ * Line editing comes from editline by default; build with
+ * CHOCCY_GNU_READLINE defined to use GNU readline instead.
+ */
+#ifdef CHOCCY_GNU_READLINE
+#include <readline/readline.h>
+#include <readline/history.h>
+#else
+#include <editline/readline.h>
+#endif
+
+/* Purpose:    Execute the program and start the REPL, or run a script
+ *             file or standard input when one is named. The --hash-cons
+ *             option makes equal stored lists share their memory,
+ *             --parallel N evaluates large pure calls on N threads, and
+ *             --batch dir runs every script in a directory, on N threads
+ *             with -j N. --image file binds the values saved in a heap
+ *             image before anything runs, and --time-startup reports how
+ *             long startup took.
+ * Parameters: An int argc (argument count) and c-string argv
+ *             (additional string arguments).
+ * Return:     Returns an int.
+ */
+int main(int argc, char** argv) {
+        char* version = "v0.0.0.0.6";
+        char* read;
+        FILE* script;
+        char* batch = NULL;
+        char* image = NULL;
+        const char* problem = NULL;
+        int status = 0;
+        int arg = 1;
+        int jobs = 1;
+        int time_startup = 0;
+        struct timespec start;
+        struct timespec ready;
+        cygrammar* grammar;
+        cyenv* env;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        /* Define the language and bind the builtins globally */
+        grammar = cygrammar_new();
+        env = cyenv_new(NULL);
+        cyenv_add_builtins(env);
+
+        /* Options come first, and "-" alone names standard input. */
+        while (status == 0 && arg < argc && argv[arg][0] == '-' &&
+               argv[arg][1] != '\0') {
+                if (strcmp(argv[arg], "--hash-cons") == 0) {
+                        cycons_enable(1);
+                        arg++;
+                } else if (strcmp(argv[arg], "--parallel") == 0 &&
+                           arg + 1 < argc && atoi(argv[arg + 1]) > 0) {
+                        cypar_start(atoi(argv[arg + 1]));
+                        arg += 2;
+                } else if (strcmp(argv[arg], "--batch") == 0 &&
+                           arg + 1 < argc) {
+                        batch = argv[arg + 1];
+                        arg += 2;
+                } else if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc &&
+                           atoi(argv[arg + 1]) > 0) {
+                        jobs = atoi(argv[arg + 1]);
+                        arg += 2;
+                } else if (strcmp(argv[arg], "--image") == 0 &&
+                           arg + 1 < argc) {
+                        image = argv[arg + 1];
+                        arg += 2;
+                } else if (strcmp(argv[arg], "--time-startup") == 0) {
+                        time_startup = 1;
+                        arg++;
+                } else {
+                        status = 2;
+                }
+        }
+
+        if (status == 0 && image != NULL)
+                problem = cyimage_load(env, image);
+
+        /* Startup ends once the first line of code could be read. */
+        if (time_startup) {
+                clock_gettime(CLOCK_MONOTONIC, &ready);
+                fprintf(stderr, "startup: %.3f ms\n",
+                        (ready.tv_sec - start.tv_sec) * 1e3 +
+                        (ready.tv_nsec - start.tv_nsec) / 1e6);
+        }
+
+        if (problem != NULL) {
+                fprintf(stderr, "%s: cannot load image %s: %s\n",
+                        argv[0], image, problem);
+                status = 1;
+        } else if (status != 0 || argc - arg > (batch == NULL)) {
+                fprintf(stderr, "usage: %s [--hash-cons] [--parallel N] "
+                        "[--image file] [--time-startup]\n       "
+                        "[file | - | --batch dir [-j N]]\n", argv[0]);
+                status = 2;
+        } else if (batch != NULL) {
+                status = cybatch_run(batch, jobs, grammar -> line);
+        } else if (argc - arg == 1) {
+                /* Run a script, with "-" naming standard input. */
+                if (strcmp(argv[arg], "-") == 0) {
+                        status = run_stream(env, stdin, "<stdin>",
+                                            grammar -> line, stdout);
+                } else if ((script = fopen(argv[arg], "r")) != NULL) {
+                        status = run_stream(env, script, argv[arg],
+                                            grammar -> line, stdout);
+                        fclose(script);
+                } else {
+                        fprintf(stderr, "%s: cannot open %s: %s\n",
+                                argv[0], argv[arg], strerror(errno));
+                        status = 1;
+                }
+        } else {
+                /* Begin the REPL */
+                printf("choccy %s\nTo exit, press ctrl+c\n", version);
+                while ((read = readline("choccy> ")) != NULL) {
+                        add_history(read);
+                        eval_print_line(env, "<stdin>", read,
+                                        grammar -> line, stdout);
+                        free(read);
+                }
+        }
+        cymemo_clear();
+        cyenv_delete(env);
+        cygrammar_delete(grammar);
+
+        return status;
+}
@@ -0,0 +1,198 @@
+/*
+ * choccyalloc.c
+ * Memory for Choccy's cyval nodes. Nodes normally come from slabs of
+ * fixed-size cells threaded onto a free list, so creating and destroying
+ * a node never calls malloc or free. While an arena is open, nodes are
+ * instead bump-allocated from arena chunks and reclaimed in one pass when
+ * the arena is reset, which lets the REPL drop a whole line's worth of
+ * values at once. Immediate fixnums and symbols never reach the allocator.
+ *
+ * Arena nodes may own slab nodes, but a slab node must never own an arena
+ * node, as the arena is reclaimed without consulting the slab.
+ *
+ * Each thread has its own free list and arena, so threads evaluating in
+ * parallel (see choccypar.h) never contend for nodes. A node freed by
+ * another thread than the one that made it joins the freeing thread's
+ * free list, as slabs are never returned to the system.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyalloc.h"
+#include "choccycons.h"
+
+/* Number of nodes carved out of each slab and each arena chunk. */
+#define CYALLOC_CHUNK_NODES 1024
+
+/* A free slab cell, overlaying the memory of a cyval node. */
+typedef struct cyfree {
+        struct cyfree* next;
+} cyfree;
+
+/* A chunk of arena memory, chained to the chunk allocated before it. */
+typedef struct cychunk {
+        struct cychunk* next;
+        int used;
+        cyval nodes[CYALLOC_CHUNK_NODES];
+} cychunk;
+
+/* Head of this thread's slab free list. */
+static _Thread_local cyfree* cyalloc_free_list = NULL;
+
+/* This thread's most recent arena chunk, and whether its arena is open. */
+static _Thread_local cychunk* cyalloc_arena = NULL;
+static _Thread_local int cyalloc_arena_open = 0;
+
+/*
+ * Purpose:    Carve a new slab into cells and push them onto the free list.
+ * Parameters: Void
+ * Return:     Void
+ */
+static void cyalloc_grow_slab(void) {
+        int i;
+        cyval* slab = malloc(sizeof(cyval) * CYALLOC_CHUNK_NODES);
+        cyfree* cell;
+
+        for (i = CYALLOC_CHUNK_NODES - 1; i >= 0; i--) {
+                cell = (cyfree*) &slab[i];
+                cell -> next = cyalloc_free_list;
+                cyalloc_free_list = cell;
+        }
+}
+
+/*
+ * Purpose:    Allocate memory for one cyval node, from the arena while one
+ *             is open and from the slab free lists otherwise.
+ * Parameters: Void
+ * Return:     A pointer to an uninitialized cyval with its owner set.
+ */
+cyval* cyalloc_node(void) {
+        cyval* value;
+        cychunk* chunk;
+
+        if (!cyalloc_arena_open)
+                return cyalloc_slab_node();
+        if (cyalloc_arena == NULL ||
+            cyalloc_arena -> used == CYALLOC_CHUNK_NODES) {
+                chunk = malloc(sizeof(*chunk));
+                chunk -> next = cyalloc_arena;
+                chunk -> used = 0;
+                cyalloc_arena = chunk;
+        }
+        value = &cyalloc_arena -> nodes[cyalloc_arena -> used++];
+        value -> owner = CYALLOC_ARENA;
+
+        return value;
+}
+
+/*
+ * Purpose:    Allocate memory for one cyval node from the slab free lists,
+ *             even while the arena is open, for a value that must outlive
+ *             the arena.
+ * Parameters: Void
+ * Return:     A pointer to an uninitialized cyval with its owner set.
+ */
+cyval* cyalloc_slab_node(void) {
+        cyval* value;
+
+        if (cyalloc_free_list == NULL)
+                cyalloc_grow_slab();
+        value = (cyval*) cyalloc_free_list;
+        cyalloc_free_list = cyalloc_free_list -> next;
+        value -> owner = CYALLOC_SLAB;
+
+        return value;
+}
+
+/*
+ * Purpose:    Return a cyval node's memory to the allocator. The node's
+ *             contents must already have been released.
+ * Parameters: A pointer to the cyval node to free.
+ * Return:     Void
+ */
+void cyalloc_free(cyval* value) {
+        cyfree* cell;
+
+        if (value == NULL)
+                return;
+        /* Arena nodes are only marked; their memory returns on reset. */
+        if (value -> owner == CYALLOC_ARENA) {
+                value -> owner = CYALLOC_DEAD;
+                return;
+        }
+        cell = (cyfree*) value;
+        cell -> next = cyalloc_free_list;
+        cyalloc_free_list = cell;
+}
+
+/*
+ * Purpose:    Open the arena, so that every node allocated until the next
+ *             reset is bump-allocated and reclaimed all at once.
+ * Parameters: Void
+ * Return:     Void
+ */
+void cyalloc_arena_begin(void) {
+        cyalloc_arena_open = 1;
+}
+
+/*
+ * Purpose:    Release the contents of a live arena node without touching
+ *             its arena-owned children, which are swept on their own.
+ * Parameters: A pointer to a live arena cyval node.
+ * Return:     Void
+ */
+static void cyalloc_sweep(cyval* value) {
+        int i;
+        cyvec* vec;
+
+        if (value -> data_type == CYVAL_ERROR) {
+                free(value -> error);
+        } else if (value -> data_type == CYVAL_BIG) {
+                cybig_free(&value -> big);
+        } else if (value -> data_type == CYVAL_NUMS) {
+                cynums_release(value -> nums);
+        } else if (value -> data_type == CYVAL_S_EXP ||
+                   value -> data_type == CYVAL_Q_EXP) {
+                /* The last node sharing a vector releases its children. */
+                vec = value -> vec;
+                if (vec != NULL && --vec -> refs == 0) {
+                        if (vec -> consed)
+                                cycons_forget(vec);
+                        for (i = vec -> lo; i < vec -> hi; i++)
+                                if (CY_IS_HEAP(vec -> items[i]) &&
+                                    vec -> items[i] -> owner == CYALLOC_SLAB)
+                                        cyval_destructor(vec -> items[i]);
+                        cyval_destructor(vec -> folded);
+                        free(vec);
+                }
+        }
+        value -> owner = CYALLOC_DEAD;
+}
+
+/*
+ * Purpose:    Release every node allocated since the arena was opened,
+ *             whether or not it was destroyed, and close the arena.
+ * Parameters: Void
+ * Return:     Void
+ */
+void cyalloc_arena_reset(void) {
+        int i;
+        cychunk* chunk;
+
+        /* Close the arena first so the sweep cannot allocate from it. */
+        cyalloc_arena_open = 0;
+        for (chunk = cyalloc_arena; chunk != NULL; chunk = chunk -> next)
+                for (i = 0; i < chunk -> used; i++)
+                        if (chunk -> nodes[i].owner == CYALLOC_ARENA)
+                                cyalloc_sweep(&chunk -> nodes[i]);
+
+        /* Keep the newest chunk for the next line and free the rest. */
+        if (cyalloc_arena == NULL)
+                return;
+        while (cyalloc_arena -> next != NULL) {
+                chunk = cyalloc_arena -> next;
+                cyalloc_arena -> next = chunk -> next;
+                free(chunk);
+        }
+        cyalloc_arena -> used = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * choccyalloc.h
+ * Header file for choccyalloc.c, declaring the slab allocator and the
+ * per-evaluation arena that supply memory for cyval nodes.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYALLOC_H
+#define CHOCCYALLOC_H
+
+#include "choccyparsing.h"
+
+/*
+ * Enumeration of where a cyval node's memory came from. Nodes in a heap
+ * image (see choccyimage.h) are mapped from a file and never freed.
+ */
+enum { CYALLOC_SLAB, CYALLOC_ARENA, CYALLOC_DEAD, CYALLOC_IMAGE };
+
+/*
+ * Purpose:    Allocate memory for one cyval node, from the arena while one
+ *             is open and from the slab free lists otherwise.
+ * Parameters: Void
+ * Return:     A pointer to an uninitialized cyval with its owner set.
+ */
+cyval* cyalloc_node(void);
+
+/*
+ * Purpose:    Allocate memory for one cyval node from the slab free lists,
+ *             even while the arena is open, for a value that must outlive
+ *             the arena.
+ * Parameters: Void
+ * Return:     A pointer to an uninitialized cyval with its owner set.
+ */
+cyval* cyalloc_slab_node(void);
+
+/*
+ * Purpose:    Return a cyval node's memory to the allocator. The node's
+ *             contents must already have been released.
+ * Parameters: A pointer to the cyval node to free.
+ * Return:     Void
+ */
+void cyalloc_free(cyval* value);
+
+/*
+ * Purpose:    Open the arena, so that every node allocated until the next
+ *             reset is bump-allocated and reclaimed all at once.
+ * Parameters: Void
+ * Return:     Void
+ */
+void cyalloc_arena_begin(void);
+
+/*
+ * Purpose:    Release every node allocated since the arena was opened,
+ *             whether or not it was destroyed, and close the arena.
+ * Parameters: Void
+ * Return:     Void
+ */
+void cyalloc_arena_reset(void);
+
+#endif
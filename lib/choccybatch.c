@@ -0,0 +1,154 @@
+/*
+ * choccybatch.c
+ * The batch runner for Choccy, which evaluates many small scripts in one
+ * process, paying for startup and the grammar once. Each script runs in an
+ * environment of its own as a job on the thread pool (see choccypar.h),
+ * and prints into a buffer of its own, which is written out once every
+ * script before it has been. Every thread has its own node allocator,
+ * evaluation stacks, memo table and hash-consing table, and the grammar
+ * and symbol table are shared, so scripts never wait on one another except
+ * to intern a symbol.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "choccybatch.h"
+#include "choccyenv.h"
+#include "choccypar.h"
+
+/* A script in a batch, and what running it printed. */
+typedef struct cyscript {
+        char* path;
+        char* output;
+        size_t len_output;
+        int error;
+        int status;
+} cyscript;
+
+/* The scripts being run side by side, and the parser they are read with. */
+typedef struct cybatch {
+        cyscript* scripts;
+        mpc_parser_t* line;
+} cybatch;
+
+/*
+ * Purpose:    Tell whether a directory entry may be a script, skipping
+ *             hidden files and the "." and ".." entries.
+ * Parameters: A pointer to a dirent.
+ * Return:     1 if the entry is visible, or 0 otherwise.
+ */
+static int cybatch_visible(const struct dirent* entry) {
+        return entry -> d_name[0] != '.';
+}
+
+/*
+ * Purpose:    Run one script of a batch in a new environment, keeping what
+ *             it prints.
+ * Parameters: A pointer to the cybatch and an int index of the script.
+ * Return:     Void
+ */
+static void cybatch_script(void* data, int index) {
+        cybatch* batch = data;
+        cyscript* script = &batch -> scripts[index];
+        FILE* input;
+        FILE* out;
+        cyenv* env;
+
+        if ((input = fopen(script -> path, "r")) == NULL) {
+                script -> error = errno;
+                script -> status = 1;
+                return;
+        }
+        out = open_memstream(&script -> output, &script -> len_output);
+        env = cyenv_new(NULL);
+        cyenv_add_builtins(env);
+        script -> status = run_stream(env, input, script -> path,
+                                      batch -> line, out);
+        cyenv_delete(env);
+        fclose(out);
+        fclose(input);
+}
+
+/*
+ * Purpose:    List the regular files in a directory, in order of name.
+ * Parameters: A c-string path of the directory and a pointer to an int
+ *             set to the number of files.
+ * Return:     A pointer to a heap array of cyscripts with their paths set,
+ *             or NULL if the directory cannot be read.
+ */
+static cyscript* cybatch_list(const char* dir, int* len) {
+        int i;
+        int n;
+        char* path;
+        struct dirent** names;
+        struct stat info;
+        cyscript* scripts;
+
+        if ((n = scandir(dir, &names, cybatch_visible, alphasort)) < 0)
+                return NULL;
+        scripts = calloc(n > 0 ? n : 1, sizeof(cyscript));
+        *len = 0;
+        for (i = 0; i < n; i++) {
+                path = malloc(strlen(dir) + strlen(names[i] -> d_name) + 2);
+                sprintf(path, "%s/%s", dir, names[i] -> d_name);
+                if (stat(path, &info) == 0 && S_ISREG(info.st_mode))
+                        scripts[(*len)++].path = path;
+                else
+                        free(path);
+                free(names[i]);
+        }
+        free(names);
+
+        return scripts;
+}
+
+/*
+ * Purpose:    Run every script in a directory, in order of name, each in
+ *             an environment of its own, on the given number of threads.
+ *             The output of each script is written to standard output in
+ *             that order, as if the scripts had been run one by one.
+ * Parameters: A c-string path of the directory, an int number of threads
+ *             and a pointer to the MPC parser for a line, which is only
+ *             read.
+ * Return:     0 if every script ran and parsed, or 1 otherwise.
+ */
+int cybatch_run(const char* dir, int jobs, mpc_parser_t* line) {
+        int i;
+        int j;
+        int len;
+        int count;
+        int status = 0;
+        cyscript* scripts;
+        cybatch batch;
+
+        if ((scripts = cybatch_list(dir, &len)) == NULL) {
+                fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+                return 1;
+        }
+        cypar_start(jobs);
+        batch.line = line;
+
+        /* Run a window of scripts at once, then write out what they print. */
+        for (i = 0; i < len; i += count) {
+                count = len - i < CYBATCH_WINDOW ? len - i : CYBATCH_WINDOW;
+                batch.scripts = scripts + i;
+                cypar_each(count, cybatch_script, &batch);
+                for (j = i; j < i + count; j++) {
+                        if (scripts[j].error != 0)
+                                fprintf(stderr, "%s: %s\n", scripts[j].path,
+                                        strerror(scripts[j].error));
+                        if (scripts[j].output != NULL)
+                                fwrite(scripts[j].output, 1,
+                                       scripts[j].len_output, stdout);
+                        status |= scripts[j].status;
+                        free(scripts[j].output);
+                        free(scripts[j].path);
+                }
+        }
+        free(scripts);
+
+        return status;
+}
@@ -0,0 +1,32 @@
+/*
+ * choccybatch.h
+ * Header file for choccybatch.c, declaring the batch runner that evaluates
+ * every script in a directory on the thread pool.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYBATCH_H
+#define CHOCCYBATCH_H
+
+#include "choccyparsing.h"
+
+/*
+ * Most scripts run side by side before their output is written, bounding
+ * the output held in memory at once.
+ */
+#define CYBATCH_WINDOW 256
+
+/*
+ * Purpose:    Run every script in a directory, in order of name, each in
+ *             an environment of its own, on the given number of threads.
+ *             The output of each script is written to standard output in
+ *             that order, as if the scripts had been run one by one.
+ * Parameters: A c-string path of the directory, an int number of threads
+ *             and a pointer to the MPC parser for a line, which is only
+ *             read.
+ * Return:     0 if every script ran and parsed, or 1 otherwise.
+ */
+int cybatch_run(const char* dir, int jobs, mpc_parser_t* line);
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * choccybench.c
+ * A micro-benchmark harness for the Choccy interpreter. Each benchmark
+ * reads and evaluates a fixed, generated program many times and reports
+ * nanoseconds, allocations per run and peak resident memory, one
+ * tab-separated row per benchmark, so results can be diffed or loaded
+ * into a spreadsheet when tracking regressions.
+ *
+ * Allocations are counted by linking with --wrap for malloc, calloc and
+ * realloc (see the Makefile), which counts calls made by the interpreter
+ * and MPC but not by the C library itself.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "choccyparsing.h"
+#include "choccyenv.h"
+#include "choccyalloc.h"
+#include "choccyread.h"
+#include "choccymemo.h"
+#include "choccycons.h"
+#include "choccypar.h"
+
+/* Minimum time in seconds to spend on each benchmark. */
+#define CYBENCH_MIN_TIME 0.25
+
+/*
+ * Enumeration of how a benchmark's program is run. Benchmarks run on the
+ * thread pool start it, so they come last.
+ */
+enum {
+        CYBENCH_EVAL, CYBENCH_MPC_READ, CYBENCH_GRAMMAR, CYBENCH_MPC_RE,
+        CYBENCH_PAR_EVAL
+};
+
+/*
+ * A benchmark: a generated program, how to run it, and an optional program
+ * run once beforehand, outside the timing.
+ */
+typedef struct cybench {
+        const char* name;
+        int mode;
+        char* input;
+        char* setup;
+} cybench;
+
+/* Number of allocation calls made since the program started. */
+static unsigned long cybench_allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+/*
+ * Purpose:    Count and forward allocation calls, replacing malloc, calloc
+ *             and realloc when linked with --wrap.
+ * Parameters: The parameters of the wrapped allocation function.
+ * Return:     The result of the wrapped allocation function.
+ */
+void* __wrap_malloc(size_t size) {
+        __atomic_add_fetch(&cybench_allocs, 1, __ATOMIC_RELAXED);
+        return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+        __atomic_add_fetch(&cybench_allocs, 1, __ATOMIC_RELAXED);
+        return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+        __atomic_add_fetch(&cybench_allocs, 1, __ATOMIC_RELAXED);
+        return __real_realloc(p, size);
+}
+
+/*
+ * Purpose:    Append formatted text to a growing heap buffer.
+ * Parameters: A pointer to a heap c-string (or NULL), a pointer to its
+ *             length, and a printf-style format with its arguments.
+ * Return:     The possibly moved c-string.
+ */
+static char* cybench_append(char* buffer, size_t* len, const char* fmt, ...) {
+        va_list args;
+        int n;
+
+        va_start(args, fmt);
+        n = vsnprintf(NULL, 0, fmt, args);
+        va_end(args);
+
+        buffer = realloc(buffer, *len + n + 1);
+        va_start(args, fmt);
+        vsnprintf(buffer + *len, n + 1, fmt, args);
+        va_end(args);
+        *len += n;
+
+        return buffer;
+}
+
+/*
+ * Purpose:    Generate arithmetic nested to the given depth, such as
+ *             (+ 1 (* 2 (- 3 ...))).
+ * Parameters: An int depth.
+ * Return:     A heap c-string program.
+ */
+static char* cybench_nested(int depth) {
+        const char* ops = "+*-";
+        char* s = NULL;
+        size_t len = 0;
+        int i;
+
+        for (i = 0; i < depth; i++)
+                s = cybench_append(s, &len, "(%c %d ", ops[i % 3], i % 7 + 1);
+        s = cybench_append(s, &len, "1");
+        for (i = 0; i < depth; i++)
+                s = cybench_append(s, &len, ")");
+        return s;
+}
+
+/*
+ * Purpose:    Generate a chain of joins, each joining the previous result
+ *             with a small Q-expression.
+ * Parameters: An int number of joins.
+ * Return:     A heap c-string program.
+ */
+static char* cybench_joins(int n) {
+        char* s = NULL;
+        size_t len = 0;
+        int i;
+
+        for (i = 0; i < n; i++)
+                s = cybench_append(s, &len, "(join ");
+        s = cybench_append(s, &len, "{0}");
+        for (i = 0; i < n; i++)
+                s = cybench_append(s, &len, " {%d %d})", i, -i);
+        return s;
+}
+
+/*
+ * Purpose:    Generate repeated tails of a long Q-expression, finishing
+ *             with a head.
+ * Parameters: An int number of tails, which is also the list length.
+ * Return:     A heap c-string program.
+ */
+static char* cybench_tails(int n) {
+        char* s = NULL;
+        size_t len = 0;
+        int i;
+
+        s = cybench_append(s, &len, "(head ");
+        for (i = 0; i < n - 1; i++)
+                s = cybench_append(s, &len, "(tail ");
+        s = cybench_append(s, &len, "{");
+        for (i = 0; i < n; i++)
+                s = cybench_append(s, &len, " %d", i);
+        s = cybench_append(s, &len, "}");
+        for (i = 0; i < n; i++)
+                s = cybench_append(s, &len, ")");
+        return s;
+}
+
+/*
+ * Purpose:    Generate a sum of many arguments, or a Q-expression literal
+ *             of many numbers.
+ * Parameters: A c-string opening, an int number of elements and a c-string
+ *             closing.
+ * Return:     A heap c-string program.
+ */
+static char* cybench_list(const char* opening, int n, const char* closing) {
+        char* s = NULL;
+        size_t len = 0;
+        int i;
+
+        s = cybench_append(s, &len, "%s", opening);
+        for (i = 0; i < n; i++)
+                s = cybench_append(s, &len, " %d", i * 37 % 1000003);
+        s = cybench_append(s, &len, "%s", closing);
+        return s;
+}
+
+/*
+ * Purpose:    Generate a definition of many variables, or a sum of them.
+ * Parameters: An int number of variables and an int that is nonzero to
+ *             generate the definition and 0 to generate the sum.
+ * Return:     A heap c-string program.
+ */
+static char* cybench_vars(int n, int define) {
+        char* s = NULL;
+        size_t len = 0;
+        int i;
+
+        s = cybench_append(s, &len, define ? "(def {" : "(+");
+        for (i = 0; i < n; i++)
+                s = cybench_append(s, &len, " v%d", i);
+        if (define) {
+                s = cybench_append(s, &len, "}");
+                for (i = 0; i < n; i++)
+                        s = cybench_append(s, &len, " %d", i);
+        }
+        s = cybench_append(s, &len, ")");
+        return s;
+}
+
+/*
+ * Purpose:    Generate a sum of many independent sums of powers, such as
+ *             (+ (+ (^ k 300) (^ k 301) ...) (+ (^ k 340) ...) ...).
+ * Parameters: An int number of inner sums and an int number of powers in
+ *             each.
+ * Return:     A heap c-string program.
+ */
+static char* cybench_fanout(int sums, int terms) {
+        char* s = NULL;
+        size_t len = 0;
+        int i;
+        int j;
+
+        s = cybench_append(s, &len, "(+");
+        for (i = 0; i < sums; i++) {
+                s = cybench_append(s, &len, " (+");
+                for (j = 0; j < terms; j++)
+                        s = cybench_append(s, &len, " (^ k %d)",
+                                           300 + i * terms + j);
+                s = cybench_append(s, &len, ")");
+        }
+        s = cybench_append(s, &len, ")");
+        return s;
+}
+
+/*
+ * Purpose:    Generate a regular expression of many literal alternatives,
+ *             each starting with its own letter, such as (A123|B123|...),
+ *             whose DFA has about one state per character.
+ * Parameters: An int number of alternatives, at most 52, and an int length
+ *             of each.
+ * Return:     A heap c-string regular expression.
+ */
+static char* cybench_regex(int n, int len) {
+        static const char letters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                      "abcdefghijklmnopqrstuvwxyz";
+        char* s = NULL;
+        size_t total = 0;
+        int i;
+        int j;
+
+        s = cybench_append(s, &total, "(");
+        for (i = 0; i < n; i++) {
+                s = cybench_append(s, &total, i > 0 ? "|%c" : "%c",
+                                   letters[i]);
+                for (j = 1; j < len; j++)
+                        s = cybench_append(s, &total, "%d", j % 10);
+        }
+        s = cybench_append(s, &total, ")");
+        return s;
+}
+
+/*
+ * Purpose:    Read the monotonic clock.
+ * Parameters: Void
+ * Return:     The current time in nanoseconds.
+ */
+static double cybench_now(void) {
+        struct timespec t;
+
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/*
+ * Purpose:    Run a benchmark's program once, discarding the result.
+ * Parameters: A pointer to a cybench, a pointer to the cygrammar and a
+ *             pointer to the cyenv to evaluate in.
+ * Return:     Void
+ */
+static void cybench_run_once(cybench* bench, cygrammar* grammar,
+                             cyenv* env) {
+        mpc_result_t result;
+        cyval* value;
+
+        cyalloc_arena_begin();
+        if (bench -> setup != NULL) {
+                if (cyread_line(bench -> setup, &value))
+                        cyval_evaluate(env, value);
+                free(bench -> setup);
+                bench -> setup = NULL;
+        } else if (bench -> mode == CYBENCH_MPC_READ) {
+                if (mpc_parse("<bench>", bench -> input, grammar -> line,
+                              &result)) {
+                        cyval_read_tree(result.output);
+                        mpc_ast_delete(result.output);
+                } else {
+                        mpc_err_delete(result.error);
+                }
+        } else if (bench -> mode == CYBENCH_GRAMMAR) {
+                cygrammar_delete(cygrammar_new());
+        } else if (bench -> mode == CYBENCH_MPC_RE) {
+                mpc_delete(mpc_re(bench -> input));
+        } else if (cyread_line(bench -> input, &value)) {
+                cyval_evaluate(env, value);
+        }
+        cyalloc_arena_reset();
+}
+
+/*
+ * Purpose:    Run the benchmark suite, optionally only the benchmarks whose
+ *             names contain the given argument, and print the results.
+ * Parameters: An int argc (argument count) and c-string argv
+ *             (additional string arguments).
+ * Return:     Returns an int.
+ */
+int main(int argc, char** argv) {
+        cybench benches[] = {
+                { "nested_arith", CYBENCH_EVAL, NULL, NULL },
+                { "join_chain", CYBENCH_EVAL, NULL, NULL },
+                { "head_tail", CYBENCH_EVAL, NULL, NULL },
+                { "sum_args", CYBENCH_EVAL, NULL, NULL },
+                { "sum_vars", CYBENCH_EVAL, NULL, NULL },
+                { "big_pow", CYBENCH_EVAL, NULL, NULL },
+                { "nums_arith", CYBENCH_EVAL, NULL, NULL },
+                { "eval_template", CYBENCH_EVAL, NULL, NULL },
+                { "memo_pow", CYBENCH_EVAL, NULL, NULL },
+                { "equal_lists", CYBENCH_EVAL, NULL, NULL },
+                { "read_literal", CYBENCH_EVAL, NULL, NULL },
+                { "mpc_literal", CYBENCH_MPC_READ, NULL, NULL },
+                { "grammar_new", CYBENCH_GRAMMAR, NULL, NULL },
+                { "regex_dfa", CYBENCH_MPC_RE, NULL, NULL },
+                { "par_pow", CYBENCH_PAR_EVAL, NULL, NULL },
+                { "par_map", CYBENCH_PAR_EVAL, NULL, NULL }
+        };
+        int n = sizeof(benches) / sizeof(benches[0]);
+        int i;
+        size_t len = 0;
+        long iters;
+        double start;
+        double elapsed;
+        unsigned long allocs;
+        struct rusage usage;
+        char* list;
+        cygrammar* grammar = cygrammar_new();
+        cyenv* env = cyenv_new(NULL);
+
+        cyenv_add_builtins(env);
+        /* Run as a data-heavy script would, sharing equal stored lists. */
+        cycons_enable(1);
+
+        benches[0].input = cybench_nested(500);
+        benches[1].input = cybench_joins(500);
+        benches[2].input = cybench_tails(500);
+        benches[3].input = cybench_list("(+", 10000, ")");
+        benches[4].input = cybench_vars(10000, 0);
+        benches[4].setup = cybench_vars(10000, 1);
+        benches[5].input = strdup("(/ (* (^ 3 20000) (^ 7 10000)) "
+                                  "(^ 3 19999))");
+        benches[6].input = strdup("(max (- (+ nums nums) (sum nums)))");
+        benches[6].setup = cybench_list("(def {nums} (vec {", 1000000,
+                                        "}))");
+        benches[7].input = strdup("(eval tpl)");
+        benches[7].setup = cybench_list("(def {x tpl} 1 {(+ x (* 60 60 24) "
+                                        "(sum (vec {", 1000, "})))})");
+        benches[8].input = strdup("(memo slow)");
+        benches[8].setup = strdup("(def {k slow} 3 "
+                                  "{(* (^ k 20000) (^ 7 3000))})");
+        benches[9].input = strdup("(== p q)");
+        list = cybench_list("{", 10000, "}");
+        benches[9].setup = cybench_append(NULL, &len, "(def {p q} %s %s)",
+                                          list, list);
+        free(list);
+        benches[10].input = cybench_list("{", 10000, "}");
+        benches[11].input = cybench_list("{", 10000, "}");
+        benches[13].input = cybench_regex(25, 20);
+        benches[14].input = cybench_fanout(16, 30);
+        benches[14].setup = strdup("(def {k} 7)");
+        benches[15].input = strdup("(sum (vec (map {* 3} xs)))");
+        benches[15].setup = cybench_list("(def {xs} {", 100000, "})");
+
+        fprintf(stderr, "vector kernels: %s\n", cynums_isa());
+        printf("name\titers\tns_per_op\tallocs_per_op\tpeak_rss_kb\n");
+        for (i = 0; i < n; i++) {
+                if (argc > 1 && strstr(benches[i].name, argv[1]) == NULL)
+                        continue;
+                if (benches[i].mode == CYBENCH_PAR_EVAL)
+                        cypar_start(sysconf(_SC_NPROCESSORS_ONLN));
+                /*
+                 * Run any setup, warm up once, then run until the minimum
+                 * time passes.
+                 */
+                if (benches[i].setup != NULL)
+                        cybench_run_once(&benches[i], grammar, env);
+                cybench_run_once(&benches[i], grammar, env);
+                iters = 0;
+                allocs = cybench_allocs;
+                start = cybench_now();
+                do {
+                        cybench_run_once(&benches[i], grammar, env);
+                        iters++;
+                        elapsed = cybench_now() - start;
+                } while (elapsed < CYBENCH_MIN_TIME * 1e9);
+                allocs = cybench_allocs - allocs;
+
+                getrusage(RUSAGE_SELF, &usage);
+                printf("%s\t%ld\t%.0f\t%.1f\t%ld\n", benches[i].name, iters,
+                       elapsed / iters, (double) allocs / iters,
+                       usage.ru_maxrss);
+                fflush(stdout);
+        }
+
+        for (i = 0; i < n; i++) {
+                free(benches[i].input);
+                free(benches[i].setup);
+        }
+        cymemo_clear();
+        cyenv_delete(env);
+        cygrammar_delete(grammar);
+
+        return 0;
+}
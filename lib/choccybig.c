@@ -0,0 +1,659 @@
+/*
+ * choccybig.c
+ * Arbitrary-precision integers for Choccy. Magnitudes are arrays of base
+ * 2^32 limbs, so every limb product fits in a uint64_t. Multiplication
+ * switches from the schoolbook method to Karatsuba's algorithm once both
+ * operands are long enough, division is Knuth's Algorithm D, and powers
+ * are taken by repeated squaring.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "choccybig.h"
+
+/* Number of limbs below which multiplication uses the schoolbook method. */
+#define CYBIG_KARATSUBA 32
+
+/* The largest power of ten that fits in a limb, and its number of zeros. */
+#define CYBIG_DEC_BASE 1000000000u
+#define CYBIG_DEC_DIGITS 9
+
+/*
+ * Purpose:    Find the length of a magnitude without its leading zeros.
+ * Parameters: A pointer to limbs and an int number of limbs.
+ * Return:     The int number of limbs up to the highest nonzero one.
+ */
+static int cybig_trim(const uint32_t* limbs, int len) {
+        while (len > 0 && limbs[len - 1] == 0)
+                len--;
+        return len;
+}
+
+/*
+ * Purpose:    Set a cybig to a sign and a magnitude, taking ownership of
+ *             the magnitude's limbs.
+ * Parameters: A pointer to the cybig to set, an int sign, and a pointer to
+ *             heap-allocated limbs with an int number of limbs, which may
+ *             include leading zeros.
+ * Return:     Void
+ */
+static void cybig_set(cybig* out, int sign, uint32_t* limbs, int len) {
+        len = cybig_trim(limbs, len);
+        if (len == 0) {
+                free(limbs);
+                out -> sign = 0;
+                out -> len_limbs = 0;
+                out -> limbs = NULL;
+                return;
+        }
+        out -> sign = sign;
+        out -> len_limbs = len;
+        out -> limbs = limbs;
+}
+
+/*
+ * Purpose:    Compare two magnitudes without leading zeros.
+ * Parameters: Pointers to the limbs of two magnitudes, each followed by
+ *             its int number of limbs.
+ * Return:     A negative int, zero or a positive int as the first
+ *             magnitude is less than, equal to or greater than the second.
+ */
+static int cybig_cmp_mag(const uint32_t* a, int na, const uint32_t* b,
+                         int nb) {
+        int i;
+
+        if (na != nb)
+                return na < nb ? -1 : 1;
+        for (i = na - 1; i >= 0; i--)
+                if (a[i] != b[i])
+                        return a[i] < b[i] ? -1 : 1;
+        return 0;
+}
+
+/*
+ * Purpose:    Add a magnitude into another in place.
+ * Parameters: A pointer to the limbs to add into with their int number,
+ *             and a pointer to the limbs to add with their int number,
+ *             which must be no more than the first.
+ * Return:     The carry out of the highest limb.
+ */
+static uint32_t cybig_add_into(uint32_t* x, int nx, const uint32_t* y,
+                               int ny) {
+        int i;
+        uint64_t t;
+        uint32_t carry = 0;
+
+        for (i = 0; i < ny; i++) {
+                t = (uint64_t) x[i] + y[i] + carry;
+                x[i] = (uint32_t) t;
+                carry = (uint32_t) (t >> 32);
+        }
+        for (; carry && i < nx; i++) {
+                t = (uint64_t) x[i] + carry;
+                x[i] = (uint32_t) t;
+                carry = (uint32_t) (t >> 32);
+        }
+        return carry;
+}
+
+/*
+ * Purpose:    Subtract a magnitude from another in place.
+ * Parameters: A pointer to the limbs to subtract from with their int
+ *             number, and a pointer to the limbs to subtract, which must
+ *             not be greater, with their int number.
+ * Return:     Void
+ */
+static void cybig_sub_from(uint32_t* x, int nx, const uint32_t* y, int ny) {
+        int i;
+        uint64_t t;
+        uint32_t borrow = 0;
+
+        ny = cybig_trim(y, ny);
+        for (i = 0; i < ny; i++) {
+                t = (uint64_t) x[i] - y[i] - borrow;
+                x[i] = (uint32_t) t;
+                borrow = (uint32_t) (t >> 32) & 1;
+        }
+        for (; borrow && i < nx; i++) {
+                t = (uint64_t) x[i] - borrow;
+                x[i] = (uint32_t) t;
+                borrow = (uint32_t) (t >> 32) & 1;
+        }
+}
+
+/*
+ * Purpose:    Multiply a magnitude by a limb and add a limb, in place.
+ * Parameters: A pointer to limbs with room for one more, their int number,
+ *             and the uint32_t multiplier and addend.
+ * Return:     The new int number of limbs.
+ */
+static int cybig_mul_small_add(uint32_t* x, int n, uint32_t mul,
+                               uint32_t add) {
+        int i;
+        uint64_t t;
+        uint64_t carry = add;
+
+        for (i = 0; i < n; i++) {
+                t = (uint64_t) x[i] * mul + carry;
+                x[i] = (uint32_t) t;
+                carry = t >> 32;
+        }
+        if (carry)
+                x[n++] = (uint32_t) carry;
+        return n;
+}
+
+/*
+ * Purpose:    Divide a magnitude by a limb in place.
+ * Parameters: A pointer to limbs, their int number and a nonzero uint32_t
+ *             divisor.
+ * Return:     The remainder.
+ */
+static uint32_t cybig_div_small(uint32_t* x, int n, uint32_t div) {
+        int i;
+        uint64_t cur;
+        uint64_t rem = 0;
+
+        for (i = n - 1; i >= 0; i--) {
+                cur = (rem << 32) | x[i];
+                x[i] = (uint32_t) (cur / div);
+                rem = cur % div;
+        }
+        return (uint32_t) rem;
+}
+
+/*
+ * Purpose:    Multiply two magnitudes with the schoolbook method.
+ * Parameters: A pointer to na + nb limbs for the product, and pointers to
+ *             the limbs of the two magnitudes, each followed by its int
+ *             number of limbs.
+ * Return:     Void
+ */
+static void cybig_mul_school(uint32_t* r, const uint32_t* a, int na,
+                             const uint32_t* b, int nb) {
+        int i;
+        int j;
+        uint64_t t;
+        uint64_t carry;
+
+        memset(r, 0, sizeof(uint32_t) * (na + nb));
+        for (i = 0; i < na; i++) {
+                carry = 0;
+                for (j = 0; j < nb; j++) {
+                        t = (uint64_t) a[i] * b[j] + r[i + j] + carry;
+                        r[i + j] = (uint32_t) t;
+                        carry = t >> 32;
+                }
+                r[i + nb] = (uint32_t) carry;
+        }
+}
+
+/*
+ * Purpose:    Multiply two magnitudes, using Karatsuba's algorithm when
+ *             both are long: with a = a1 B^m + a0 and b = b1 B^m + b0, the
+ *             product takes three half-size products, a0 b0, a1 b1 and
+ *             (a0 + a1)(b0 + b1), rather than four.
+ * Parameters: A pointer to na + nb limbs for the product, and pointers to
+ *             the limbs of the two magnitudes, each followed by its int
+ *             number of limbs.
+ * Return:     Void
+ */
+static void cybig_mul_mag(uint32_t* r, const uint32_t* a, int na,
+                          const uint32_t* b, int nb) {
+        int m;
+        int nsa;
+        int nsb;
+        int nz1;
+        const uint32_t* swap;
+        uint32_t* sa;
+        uint32_t* sb;
+        uint32_t* z1;
+
+        if (na < nb) {
+                swap = a;
+                a = b;
+                b = swap;
+                nz1 = na;
+                na = nb;
+                nb = nz1;
+        }
+        if (nb < CYBIG_KARATSUBA) {
+                cybig_mul_school(r, a, na, b, nb);
+                return;
+        }
+        m = na / 2;
+
+        /* When b is no longer than a's low half, multiply by each half. */
+        if (nb <= m) {
+                z1 = malloc(sizeof(uint32_t) * (na - m + nb));
+                cybig_mul_mag(r, a, m, b, nb);
+                memset(r + m + nb, 0, sizeof(uint32_t) * (na - m));
+                cybig_mul_mag(z1, a + m, na - m, b, nb);
+                cybig_add_into(r + m, na + nb - m, z1, na - m + nb);
+                free(z1);
+                return;
+        }
+
+        /* Form the sums of the halves; a1 is never shorter than a0. */
+        nsa = na - m + 1;
+        sa = malloc(sizeof(uint32_t) * nsa);
+        memcpy(sa, a + m, sizeof(uint32_t) * (na - m));
+        sa[na - m] = 0;
+        cybig_add_into(sa, nsa, a, m);
+        if (nb - m >= m) {
+                nsb = nb - m + 1;
+                sb = malloc(sizeof(uint32_t) * nsb);
+                memcpy(sb, b + m, sizeof(uint32_t) * (nb - m));
+                sb[nb - m] = 0;
+                cybig_add_into(sb, nsb, b, m);
+        } else {
+                nsb = m + 1;
+                sb = malloc(sizeof(uint32_t) * nsb);
+                memcpy(sb, b, sizeof(uint32_t) * m);
+                sb[m] = 0;
+                cybig_add_into(sb, nsb, b + m, nb - m);
+        }
+
+        /*
+         * z0 = a0 b0 and z2 = a1 b1 fill the product side by side, and
+         * z1 = (a0 + a1)(b0 + b1) - z0 - z2 is added in m limbs up.
+         */
+        nz1 = nsa + nsb;
+        z1 = malloc(sizeof(uint32_t) * nz1);
+        cybig_mul_mag(z1, sa, nsa, sb, nsb);
+        cybig_mul_mag(r, a, m, b, m);
+        cybig_mul_mag(r + 2 * m, a + m, na - m, b + m, nb - m);
+        cybig_sub_from(z1, nz1, r, 2 * m);
+        cybig_sub_from(z1, nz1, r + 2 * m, na + nb - 2 * m);
+        cybig_add_into(r + m, na + nb - m, z1, cybig_trim(z1, nz1));
+
+        free(sa);
+        free(sb);
+        free(z1);
+}
+
+/*
+ * Purpose:    Divide two magnitudes with Knuth's Algorithm D, normalizing
+ *             the divisor so its top limb has its high bit set, which
+ *             keeps each estimated quotient limb within two of the truth.
+ * Parameters: Pointers to m - n + 1 limbs for the quotient and n limbs for
+ *             the remainder, a pointer to the m limbs of the dividend and
+ *             a pointer to the n limbs of the divisor, where m >= n >= 1
+ *             and the divisor's top limb is nonzero.
+ * Return:     Void
+ */
+static void cybig_divmod_mag(uint32_t* q, uint32_t* r, const uint32_t* u,
+                             int m, const uint32_t* v, int n) {
+        int i;
+        int j;
+        int s;
+        uint32_t* un;
+        uint32_t* vn;
+        uint64_t num;
+        uint64_t qhat;
+        uint64_t rhat;
+        uint64_t p;
+        int64_t t;
+        int64_t k;
+
+        if (n == 1) {
+                memcpy(q, u, sizeof(uint32_t) * m);
+                r[0] = cybig_div_small(q, m, v[0]);
+                return;
+        }
+
+        /* Shift both operands left until the divisor's top bit is set. */
+        s = __builtin_clz(v[n - 1]);
+        vn = malloc(sizeof(uint32_t) * n);
+        un = malloc(sizeof(uint32_t) * (m + 1));
+        for (i = n - 1; i > 0; i--)
+                vn[i] = (v[i] << s) | (uint32_t) ((uint64_t) v[i - 1] >>
+                                                  (32 - s));
+        vn[0] = v[0] << s;
+        un[m] = (uint32_t) ((uint64_t) u[m - 1] >> (32 - s));
+        for (i = m - 1; i > 0; i--)
+                un[i] = (u[i] << s) | (uint32_t) ((uint64_t) u[i - 1] >>
+                                                  (32 - s));
+        un[0] = u[0] << s;
+
+        for (j = m - n; j >= 0; j--) {
+                /* Estimate the quotient limb from the top two limbs. */
+                num = ((uint64_t) un[j + n] << 32) | un[j + n - 1];
+                qhat = num / vn[n - 1];
+                rhat = num % vn[n - 1];
+                while (qhat >> 32 ||
+                       qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+                        qhat--;
+                        rhat += vn[n - 1];
+                        if (rhat >> 32)
+                                break;
+                }
+
+                /* Multiply and subtract. */
+                k = 0;
+                for (i = 0; i < n; i++) {
+                        p = qhat * vn[i];
+                        t = (int64_t) un[i + j] - k -
+                            (int64_t) (p & 0xFFFFFFFFu);
+                        un[i + j] = (uint32_t) t;
+                        k = (int64_t) (p >> 32) - (t >> 32);
+                }
+                t = (int64_t) un[j + n] - k;
+                un[j + n] = (uint32_t) t;
+
+                /* Add back if the estimate was one too large. */
+                q[j] = (uint32_t) qhat;
+                if (t < 0) {
+                        q[j]--;
+                        k = 0;
+                        for (i = 0; i < n; i++) {
+                                t = (int64_t) ((uint64_t) un[i + j] +
+                                               vn[i] + k);
+                                un[i + j] = (uint32_t) t;
+                                k = t >> 32;
+                        }
+                        un[j + n] += (uint32_t) k;
+                }
+        }
+
+        /* Shift the remainder back. */
+        for (i = 0; i < n - 1; i++)
+                r[i] = (un[i] >> s) | (uint32_t) ((uint64_t) un[i + 1] <<
+                                                  (32 - s));
+        r[n - 1] = un[n - 1] >> s;
+
+        free(un);
+        free(vn);
+}
+
+/*
+ * Purpose:    Set a cybig to the value of a long.
+ * Parameters: A pointer to the cybig to set and a long value.
+ * Return:     Void
+ */
+void cybig_from_long(cybig* out, long num) {
+        unsigned long long mag = num < 0 ? -(unsigned long long) num :
+                                           (unsigned long long) num;
+        uint32_t* limbs = malloc(sizeof(uint32_t) * 2);
+        int len = 0;
+
+        while (mag) {
+                limbs[len++] = (uint32_t) mag;
+                mag >>= 32;
+        }
+        cybig_set(out, num < 0 ? -1 : 1, limbs, len);
+}
+
+/*
+ * Purpose:    Set a cybig to the value of a string of decimal digits.
+ * Parameters: A pointer to the cybig to set, a pointer to the digit chars,
+ *             an int number of digits and an int that is nonzero if the
+ *             number is negative.
+ * Return:     Void
+ */
+void cybig_from_digits(cybig* out, const char* digits, int len,
+                       int negative) {
+        uint32_t* limbs = malloc(sizeof(uint32_t) *
+                                 (len / CYBIG_DEC_DIGITS + 2));
+        uint32_t chunk;
+        uint32_t mul;
+        int n = 0;
+        int i = 0;
+        int end;
+
+        /*
+         * Take the digits nine at a time, the first chunk taking whatever
+         * is left over.
+         */
+        end = len % CYBIG_DEC_DIGITS ? len % CYBIG_DEC_DIGITS :
+                                       CYBIG_DEC_DIGITS;
+        while (i < len) {
+                chunk = 0;
+                mul = 1;
+                for (; i < end; i++) {
+                        chunk = chunk * 10 + (digits[i] - '0');
+                        mul *= 10;
+                }
+                n = cybig_mul_small_add(limbs, n, mul, chunk);
+                end += CYBIG_DEC_DIGITS;
+        }
+        cybig_set(out, negative ? -1 : 1, limbs, n);
+}
+
+/*
+ * Purpose:    Convert a cybig to a long if it fits in one.
+ * Parameters: A pointer to a cybig and a pointer to a long to store it in.
+ * Return:     1 if the value fits and was stored, or 0 otherwise.
+ */
+int cybig_to_long(const cybig* num, long* out) {
+        unsigned long long mag = 0;
+        int i;
+
+        if (num -> len_limbs * 32 > (int) sizeof(mag) * CHAR_BIT)
+                return 0;
+        for (i = num -> len_limbs - 1; i >= 0; i--)
+                mag = (mag << 16 << 16) | num -> limbs[i];
+        if (num -> sign >= 0 && mag <= LONG_MAX) {
+                *out = (long) mag;
+                return 1;
+        }
+        if (num -> sign < 0 && mag <= (unsigned long long) LONG_MAX + 1) {
+                *out = mag == (unsigned long long) LONG_MAX + 1 ?
+                       LONG_MIN : -(long) mag;
+                return 1;
+        }
+        return 0;
+}
+
+/*
+ * Purpose:    Format a cybig in decimal.
+ * Parameters: A pointer to a cybig.
+ * Return:     A heap-allocated c-string, owned by the caller.
+ */
+char* cybig_to_str(const cybig* num) {
+        int n = num -> len_limbs;
+        int len_chunks = 0;
+        uint32_t* mag = malloc(sizeof(uint32_t) * (n + 1));
+        uint32_t* chunks = malloc(sizeof(uint32_t) * (2 * n + 1));
+        char* str;
+        char* p;
+
+        /* Peel off nine decimal digits at a time, lowest first. */
+        if (n > 0)
+                memcpy(mag, num -> limbs, sizeof(uint32_t) * n);
+        do {
+                chunks[len_chunks++] = cybig_div_small(mag, n,
+                                                       CYBIG_DEC_BASE);
+                n = cybig_trim(mag, n);
+        } while (n > 0);
+
+        str = malloc(len_chunks * CYBIG_DEC_DIGITS + 2);
+        p = str;
+        if (num -> sign < 0)
+                *p++ = '-';
+        p += sprintf(p, "%u", (unsigned) chunks[--len_chunks]);
+        while (len_chunks > 0)
+                p += sprintf(p, "%09u", (unsigned) chunks[--len_chunks]);
+
+        free(mag);
+        free(chunks);
+        return str;
+}
+
+/*
+ * Purpose:    Set a cybig to a copy of another.
+ * Parameters: A pointer to the cybig to set and a pointer to a cybig to
+ *             copy.
+ * Return:     Void
+ */
+void cybig_copy(cybig* out, const cybig* num) {
+        out -> sign = num -> sign;
+        out -> len_limbs = num -> len_limbs;
+        out -> limbs = NULL;
+        if (num -> len_limbs > 0) {
+                out -> limbs = malloc(sizeof(uint32_t) * num -> len_limbs);
+                memcpy(out -> limbs, num -> limbs,
+                       sizeof(uint32_t) * num -> len_limbs);
+        }
+}
+
+/*
+ * Purpose:    Deallocate the limbs of a cybig, leaving it zero.
+ * Parameters: A pointer to a cybig.
+ * Return:     Void
+ */
+void cybig_free(cybig* num) {
+        free(num -> limbs);
+        num -> sign = 0;
+        num -> len_limbs = 0;
+        num -> limbs = NULL;
+}
+
+/*
+ * Purpose:    Add a cybig to another whose sign is given separately, so
+ *             subtraction can flip it without a copy.
+ * Parameters: A pointer to the cybig to set to the sum, pointers to the two
+ *             cybig operands and the int sign to use for the second.
+ * Return:     Void
+ */
+static void cybig_add_signed(cybig* out, const cybig* a, const cybig* b,
+                             int sign_b) {
+        const cybig* big;
+        const cybig* small;
+        int cmp;
+        int len;
+        uint32_t* limbs;
+
+        if (b -> sign == 0) {
+                cybig_copy(out, a);
+                return;
+        }
+        if (a -> sign == 0) {
+                cybig_copy(out, b);
+                out -> sign = sign_b;
+                return;
+        }
+
+        cmp = cybig_cmp_mag(a -> limbs, a -> len_limbs, b -> limbs,
+                            b -> len_limbs);
+        big = cmp >= 0 ? a : b;
+        small = cmp >= 0 ? b : a;
+        len = big -> len_limbs + 1;
+        limbs = malloc(sizeof(uint32_t) * len);
+        memcpy(limbs, big -> limbs, sizeof(uint32_t) * big -> len_limbs);
+        limbs[len - 1] = 0;
+
+        /* Like signs add magnitudes; unlike signs subtract the smaller. */
+        if (a -> sign == sign_b) {
+                cybig_add_into(limbs, len, small -> limbs,
+                               small -> len_limbs);
+                cybig_set(out, sign_b, limbs, len);
+        } else {
+                cybig_sub_from(limbs, len, small -> limbs,
+                               small -> len_limbs);
+                cybig_set(out, cmp >= 0 ? a -> sign : sign_b, limbs, len);
+        }
+}
+
+/*
+ * Purpose:    Add, subtract or multiply two cybigs. Multiplication of
+ *             large numbers uses Karatsuba's algorithm.
+ * Parameters: A pointer to the cybig to set to the result, which must not
+ *             be either operand, and pointers to the two cybig operands.
+ * Return:     Void
+ */
+void cybig_add(cybig* out, const cybig* a, const cybig* b) {
+        cybig_add_signed(out, a, b, b -> sign);
+}
+
+void cybig_sub(cybig* out, const cybig* a, const cybig* b) {
+        cybig_add_signed(out, a, b, -b -> sign);
+}
+
+void cybig_mul(cybig* out, const cybig* a, const cybig* b) {
+        int len = a -> len_limbs + b -> len_limbs;
+        uint32_t* limbs;
+
+        if (a -> sign == 0 || b -> sign == 0) {
+                cybig_from_long(out, 0);
+                return;
+        }
+        limbs = malloc(sizeof(uint32_t) * len);
+        cybig_mul_mag(limbs, a -> limbs, a -> len_limbs, b -> limbs,
+                      b -> len_limbs);
+        cybig_set(out, a -> sign * b -> sign, limbs, len);
+}
+
+/*
+ * Purpose:    Divide two cybigs, truncating the quotient toward zero as C
+ *             does, so the remainder takes the sign of the dividend.
+ * Parameters: Pointers to the cybigs to set to the quotient and the
+ *             remainder, either of which may be NULL and neither of which
+ *             may be an operand, and pointers to the dividend and divisor.
+ * Return:     1 on success, or 0 if the divisor is zero.
+ */
+int cybig_divmod(cybig* quot, cybig* rem, const cybig* a, const cybig* b) {
+        int m = a -> len_limbs;
+        int n = b -> len_limbs;
+        uint32_t* q;
+        uint32_t* r;
+
+        if (b -> sign == 0)
+                return 0;
+        /* A smaller dividend is all remainder. */
+        if (cybig_cmp_mag(a -> limbs, m, b -> limbs, n) < 0) {
+                if (quot != NULL)
+                        cybig_from_long(quot, 0);
+                if (rem != NULL)
+                        cybig_copy(rem, a);
+                return 1;
+        }
+
+        q = malloc(sizeof(uint32_t) * (m - n + 1));
+        r = malloc(sizeof(uint32_t) * n);
+        cybig_divmod_mag(q, r, a -> limbs, m, b -> limbs, n);
+        if (quot != NULL)
+                cybig_set(quot, a -> sign * b -> sign, q, m - n + 1);
+        else
+                free(q);
+        if (rem != NULL)
+                cybig_set(rem, a -> sign, r, n);
+        else
+                free(r);
+        return 1;
+}
+
+/*
+ * Purpose:    Raise a cybig to a power by repeated squaring.
+ * Parameters: A pointer to the cybig to set to the result, which must not
+ *             be the base, a pointer to the cybig base and an unsigned
+ *             long exponent.
+ * Return:     Void
+ */
+void cybig_pow(cybig* out, const cybig* base, unsigned long exp) {
+        cybig result;
+        cybig square;
+        cybig next;
+
+        cybig_from_long(&result, 1);
+        cybig_copy(&square, base);
+        while (exp) {
+                if (exp & 1) {
+                        cybig_mul(&next, &result, &square);
+                        cybig_free(&result);
+                        result = next;
+                }
+                exp >>= 1;
+                if (exp) {
+                        cybig_mul(&next, &square, &square);
+                        cybig_free(&square);
+                        square = next;
+                }
+        }
+        cybig_free(&square);
+        *out = result;
+}
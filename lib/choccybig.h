@@ -0,0 +1,102 @@
+/*
+ * choccybig.h
+ * Header file for choccybig.c, declaring the arbitrary-precision integers
+ * that Choccy numbers are promoted to when they outgrow a long.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYBIG_H
+#define CHOCCYBIG_H
+
+#include <stdint.h>
+
+/*
+ * Choccy big integer (cybig) struct, a sign and a magnitude held as
+ * len_limbs base 2^32 limbs, least significant first. The magnitude never
+ * has leading zero limbs, so zero is the only value with no limbs and a
+ * sign of 0. The limbs are heap-allocated and owned by the cybig.
+ */
+typedef struct cybig {
+        int sign;
+        int len_limbs;
+        uint32_t* limbs;
+} cybig;
+
+/*
+ * Purpose:    Set a cybig to the value of a long.
+ * Parameters: A pointer to the cybig to set and a long value.
+ * Return:     Void
+ */
+void cybig_from_long(cybig* out, long num);
+
+/*
+ * Purpose:    Set a cybig to the value of a string of decimal digits.
+ * Parameters: A pointer to the cybig to set, a pointer to the digit chars,
+ *             an int number of digits and an int that is nonzero if the
+ *             number is negative.
+ * Return:     Void
+ */
+void cybig_from_digits(cybig* out, const char* digits, int len,
+                       int negative);
+
+/*
+ * Purpose:    Convert a cybig to a long if it fits in one.
+ * Parameters: A pointer to a cybig and a pointer to a long to store it in.
+ * Return:     1 if the value fits and was stored, or 0 otherwise.
+ */
+int cybig_to_long(const cybig* num, long* out);
+
+/*
+ * Purpose:    Format a cybig in decimal.
+ * Parameters: A pointer to a cybig.
+ * Return:     A heap-allocated c-string, owned by the caller.
+ */
+char* cybig_to_str(const cybig* num);
+
+/*
+ * Purpose:    Set a cybig to a copy of another.
+ * Parameters: A pointer to the cybig to set and a pointer to a cybig to
+ *             copy.
+ * Return:     Void
+ */
+void cybig_copy(cybig* out, const cybig* num);
+
+/*
+ * Purpose:    Deallocate the limbs of a cybig, leaving it zero.
+ * Parameters: A pointer to a cybig.
+ * Return:     Void
+ */
+void cybig_free(cybig* num);
+
+/*
+ * Purpose:    Add, subtract or multiply two cybigs. Multiplication of
+ *             large numbers uses Karatsuba's algorithm.
+ * Parameters: A pointer to the cybig to set to the result, which must not
+ *             be either operand, and pointers to the two cybig operands.
+ * Return:     Void
+ */
+void cybig_add(cybig* out, const cybig* a, const cybig* b);
+void cybig_sub(cybig* out, const cybig* a, const cybig* b);
+void cybig_mul(cybig* out, const cybig* a, const cybig* b);
+
+/*
+ * Purpose:    Divide two cybigs, truncating the quotient toward zero as C
+ *             does, so the remainder takes the sign of the dividend.
+ * Parameters: Pointers to the cybigs to set to the quotient and the
+ *             remainder, either of which may be NULL and neither of which
+ *             may be an operand, and pointers to the dividend and divisor.
+ * Return:     1 on success, or 0 if the divisor is zero.
+ */
+int cybig_divmod(cybig* quot, cybig* rem, const cybig* a, const cybig* b);
+
+/*
+ * Purpose:    Raise a cybig to a power by repeated squaring.
+ * Parameters: A pointer to the cybig to set to the result, which must not
+ *             be the base, a pointer to the cybig base and an unsigned
+ *             long exponent.
+ * Return:     Void
+ */
+void cybig_pow(cybig* out, const cybig* base, unsigned long exp);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * choccycons.c
+ * Hash-consing for Choccy. While it is on, every expression copied out of
+ * the arena to be stored, such as a value bound to a symbol, shares its
+ * vector with any equal expression already stored, so duplicated lists are
+ * kept once. Children are copied before their parent, so the children of a
+ * stored vector are already unique, and two vectors are compared child by
+ * child without walking any deeper.
+ *
+ * The table does not hold a reference to its vectors: a vector leaves it
+ * when it is freed, or when its last holder is about to modify it.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccycons.h"
+#include "choccyhash.h"
+
+/* Initial number of slots in the table; always kept a power of two. */
+#define CYCONS_MIN_SLOTS 16
+
+/* Whether hash-consing is on. */
+static int cycons_on = 0;
+
+/*
+ * This thread's hash table of hash-consed vectors, chained by hash. Each
+ * thread stores only what it evaluates, so none needs another's vectors.
+ */
+static _Thread_local cyvec** cycons_slots = NULL;
+static _Thread_local int cycons_cap_slots = 0;
+static _Thread_local int cycons_len_vecs = 0;
+
+/*
+ * Purpose:    Turn hash-consing of stored expressions on or off. It is off
+ *             until turned on.
+ * Parameters: An int, nonzero to turn hash-consing on.
+ * Return:     Void
+ */
+void cycons_enable(int on) {
+        cycons_on = on;
+}
+
+/*
+ * Purpose:    Compare two children of hash-consed vectors: immediates and
+ *             expressions by identity, and other nodes by value.
+ * Parameters: Pointers to two cyvals.
+ * Return:     1 if the children are equal, or 0 otherwise.
+ */
+static int cycons_same_child(cyval* a, cyval* b) {
+        if (a == b)
+                return 1;
+        if (!CY_IS_HEAP(a) || !CY_IS_HEAP(b) ||
+            a -> data_type != b -> data_type)
+                return 0;
+        if (a -> data_type == CYVAL_S_EXP || a -> data_type == CYVAL_Q_EXP)
+                return a -> vec == b -> vec &&
+                       a -> off_cyvals == b -> off_cyvals &&
+                       a -> len_cyvals == b -> len_cyvals;
+        return cyval_equal(a, b);
+}
+
+/*
+ * Purpose:    Compare the children of two vectors whose own children are
+ *             hash-consed.
+ * Parameters: Pointers to two cyvecs.
+ * Return:     1 if the vectors hold equal children, or 0 otherwise.
+ */
+static int cycons_same(cyvec* a, cyvec* b) {
+        int i;
+        int len = a -> hi - a -> lo;
+
+        if (a -> hash != b -> hash || b -> hi - b -> lo != len)
+                return 0;
+        for (i = 0; i < len; i++)
+                if (!cycons_same_child(a -> items[a -> lo + i],
+                                       b -> items[b -> lo + i]))
+                        return 0;
+        return 1;
+}
+
+/*
+ * Purpose:    Rebuild the table with double the slots.
+ * Parameters: Void
+ * Return:     Void
+ */
+static void cycons_grow(void) {
+        int i;
+        int cap = cycons_cap_slots;
+        int mask;
+        cyvec** old = cycons_slots;
+        cyvec* vec;
+        cyvec* next;
+
+        cycons_cap_slots = cap ? cap * 2 : CYCONS_MIN_SLOTS;
+        cycons_slots = calloc(cycons_cap_slots, sizeof(cyvec*));
+        mask = cycons_cap_slots - 1;
+        for (i = 0; i < cap; i++)
+                for (vec = old[i]; vec != NULL; vec = next) {
+                        next = vec -> cons_chain;
+                        vec -> cons_chain = cycons_slots[vec -> hash & mask];
+                        cycons_slots[vec -> hash & mask] = vec;
+                }
+        free(old);
+}
+
+/*
+ * Purpose:    Share the vector of an expression just copied out of the
+ *             arena with an equal one already stored, or add it to the
+ *             table if there is none, while hash-consing is on.
+ * Parameters: A pointer to a cyval S-expression or Q-expression that views
+ *             the whole of its unshared vector, whose children have been
+ *             hash-consed.
+ * Return:     Void
+ */
+void cycons_intern(cyval* value) {
+        cyvec* vec = value -> vec;
+        cyvec* found = NULL;
+        cyvec** slot;
+
+        if (!cycons_on || vec == NULL)
+                return;
+        /* Hashing the expression caches the hash of its children. */
+        cyval_hash(value);
+        if (cycons_cap_slots > 0)
+                found = cycons_slots[vec -> hash & (cycons_cap_slots - 1)];
+        for (; found != NULL; found = found -> cons_chain)
+                if (cycons_same(found, vec))
+                        break;
+        if (found != NULL) {
+                found -> refs++;
+                cyvec_release(vec);
+                value -> vec = found;
+                value -> off_cyvals = found -> lo;
+                value -> cyvals = found -> items + found -> lo;
+                return;
+        }
+
+        if (cycons_len_vecs >= cycons_cap_slots)
+                cycons_grow();
+        slot = &cycons_slots[vec -> hash & (cycons_cap_slots - 1)];
+        vec -> cons_chain = *slot;
+        *slot = vec;
+        vec -> consed = 1;
+        cycons_len_vecs++;
+}
+
+/*
+ * Purpose:    Take a vector out of the hash-consing table, before it is
+ *             modified or freed.
+ * Parameters: A pointer to a hash-consed cyvec.
+ * Return:     Void
+ */
+void cycons_forget(cyvec* vec) {
+        cyvec** link = &cycons_slots[vec -> hash & (cycons_cap_slots - 1)];
+
+        while (*link != vec)
+                link = &(*link) -> cons_chain;
+        *link = vec -> cons_chain;
+        vec -> cons_chain = NULL;
+        vec -> consed = 0;
+
+        /* Free the table once it empties, as nothing is left to share. */
+        if (--cycons_len_vecs == 0) {
+                free(cycons_slots);
+                cycons_slots = NULL;
+                cycons_cap_slots = 0;
+        }
+}
@@ -0,0 +1,41 @@
+/*
+ * choccycons.h
+ * Header file for choccycons.c, declaring the optional hash-consing table
+ * that lets structurally equal stored expressions share one vector.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYCONS_H
+#define CHOCCYCONS_H
+
+#include "choccyparsing.h"
+
+/*
+ * Purpose:    Turn hash-consing of stored expressions on or off. It is off
+ *             until turned on.
+ * Parameters: An int, nonzero to turn hash-consing on.
+ * Return:     Void
+ */
+void cycons_enable(int on);
+
+/*
+ * Purpose:    Share the vector of an expression just copied out of the
+ *             arena with an equal one already stored, or add it to the
+ *             table if there is none, while hash-consing is on.
+ * Parameters: A pointer to a cyval S-expression or Q-expression that views
+ *             the whole of its unshared vector, whose children have been
+ *             hash-consed.
+ * Return:     Void
+ */
+void cycons_intern(cyval* value);
+
+/*
+ * Purpose:    Take a vector out of the hash-consing table, before it is
+ *             modified or freed.
+ * Parameters: A pointer to a hash-consed cyvec.
+ * Return:     Void
+ */
+void cycons_forget(cyvec* vec);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * choccyenv.c
+ * Environments for Choccy. Each scope maps interned symbol ids to values
+ * in an open-addressing hash table of bindings, and falls back on its
+ * enclosing scope for symbols it does not bind. Symbol ids are handed out
+ * densely from zero, so a scope hashes an id by masking it, and bindings
+ * made in order land in consecutive slots.
+ *
+ * Bound values must outlive the line that bound them, so each is copied
+ * out of the arena with cyval_persist.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyenv.h"
+
+/* Initial number of slots in a scope; always kept a power of two. */
+#define CYENV_MIN_SLOTS 16
+
+/*
+ * Number of times a symbol bound to a builtin function has been rebound on
+ * this thread, which evaluates only in environments of its own.
+ */
+static _Thread_local int cyenv_rebinds = 0;
+
+/*
+ * Purpose:    Construct an empty scope.
+ * Parameters: A pointer to the enclosing cyenv, or NULL for a global scope.
+ * Return:     A pointer to a heap-allocated cyenv.
+ */
+cyenv* cyenv_new(cyenv* parent) {
+        cyenv* env = malloc(sizeof(*env));
+
+        env -> parent = parent;
+        env -> len_slots = 0;
+        env -> cap_slots = CYENV_MIN_SLOTS;
+        env -> slots = calloc(CYENV_MIN_SLOTS, sizeof(cybinding));
+
+        return env;
+}
+
+/*
+ * Purpose:    Deallocate a scope and the values bound in it, leaving its
+ *             enclosing scopes alone.
+ * Parameters: A pointer to a cyenv to deallocate.
+ * Return:     Void
+ */
+void cyenv_delete(cyenv* env) {
+        int i;
+
+        if (env == NULL)
+                return;
+        for (i = 0; i < env -> cap_slots; i++)
+                if (env -> slots[i].sym)
+                        cyval_destructor(env -> slots[i].value);
+        free(env -> slots);
+        free(env);
+}
+
+/*
+ * Purpose:    Find the slot for a symbol in a single scope.
+ * Parameters: A pointer to a cyenv and an int interned symbol id.
+ * Return:     A pointer to the cybinding holding the symbol, or to the
+ *             empty slot where it would be inserted.
+ */
+static cybinding* cyenv_slot(cyenv* env, int sym) {
+        int mask = env -> cap_slots - 1;
+        int j = sym & mask;
+
+        while (env -> slots[j].sym && env -> slots[j].sym != sym + 1)
+                j = (j + 1) & mask;
+        return &env -> slots[j];
+}
+
+/*
+ * Purpose:    Rebuild a scope's slots with double the capacity.
+ * Parameters: A pointer to a cyenv.
+ * Return:     Void
+ */
+static void cyenv_grow(cyenv* env) {
+        int i;
+        int cap = env -> cap_slots;
+        cybinding* old = env -> slots;
+
+        env -> cap_slots = cap * 2;
+        env -> slots = calloc(env -> cap_slots, sizeof(cybinding));
+        for (i = 0; i < cap; i++)
+                if (old[i].sym)
+                        *cyenv_slot(env, old[i].sym - 1) = old[i];
+        free(old);
+}
+
+/*
+ * Purpose:    Find the value bound to a symbol in a scope or the nearest
+ *             enclosing scope that binds it.
+ * Parameters: A pointer to a cyenv and an int interned symbol id.
+ * Return:     A pointer to the bound cyval, still owned by its scope, or
+ *             NULL if the symbol is unbound.
+ */
+cyval* cyenv_lookup(cyenv* env, int sym) {
+        cybinding* slot;
+
+        for (; env != NULL; env = env -> parent) {
+                slot = cyenv_slot(env, sym);
+                if (slot -> sym)
+                        return slot -> value;
+        }
+        return NULL;
+}
+
+/*
+ * Purpose:    Get a copy of the value bound to a symbol.
+ * Parameters: A pointer to a cyenv and an int interned symbol id.
+ * Return:     A pointer to a copy of the bound cyval, or to an error if the
+ *             symbol is unbound.
+ */
+cyval* cyenv_get(cyenv* env, int sym) {
+        cyval* value = cyenv_lookup(env, sym);
+        char* name;
+        char* msg;
+
+        if (value != NULL)
+                return cyval_copy(value);
+
+        /* Name the symbol in the error. */
+        name = cysym_name(sym);
+        msg = malloc(strlen(name) + sizeof("Unbound symbol ''"));
+        sprintf(msg, "Unbound symbol '%s'", name);
+        value = cyval_error(msg);
+        free(msg);
+
+        return value;
+}
+
+/*
+ * Purpose:    Bind a symbol to a copy of a value in the given scope,
+ *             replacing any value it was bound to there.
+ * Parameters: A pointer to a cyenv, an int interned symbol id and a
+ *             pointer to a cyval, which is not consumed.
+ * Return:     Void
+ */
+void cyenv_put(cyenv* env, int sym, cyval* value) {
+        /* Copy the new value before the old one can be destroyed. */
+        cyenv_adopt(env, sym, cyval_persist(value));
+}
+
+/*
+ * Purpose:    Bind a symbol to a value in the given scope without copying
+ *             it, replacing any value it was bound to there.
+ * Parameters: A pointer to a cyenv, an int interned symbol id and a
+ *             pointer to a cyval outside the arena, which the scope takes
+ *             over.
+ * Return:     Void
+ */
+void cyenv_adopt(cyenv* env, int sym, cyval* value) {
+        cybinding* slot = cyenv_slot(env, sym);
+        cyval* old = cyenv_lookup(env, sym);
+
+        if (old != NULL && CY_IS_FUN(old))
+                cyenv_rebinds++;
+
+        if (slot -> sym) {
+                old = slot -> value;
+                slot -> value = value;
+                cyval_destructor(old);
+                return;
+        }
+        slot -> sym = sym + 1;
+        slot -> value = value;
+
+        /* Keep the load factor at or below one half. */
+        if (++env -> len_slots * 2 > env -> cap_slots)
+                cyenv_grow(env);
+}
+
+/*
+ * Purpose:    Tell whether any symbol bound to a builtin function has been
+ *             rebound, by counting such rebindings.
+ * Parameters: Void
+ * Return:     An int that changes whenever such a symbol is rebound.
+ */
+int cyenv_epoch(void) {
+        return cyenv_rebinds;
+}
+
+/*
+ * Purpose:    Bind a symbol to a copy of a value in the global scope that
+ *             encloses the given scope.
+ * Parameters: A pointer to a cyenv, an int interned symbol id and a
+ *             pointer to a cyval, which is not consumed.
+ * Return:     Void
+ */
+void cyenv_def(cyenv* env, int sym, cyval* value) {
+        while (env -> parent != NULL)
+                env = env -> parent;
+        cyenv_put(env, sym, value);
+}
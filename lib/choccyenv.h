@@ -0,0 +1,103 @@
+/*
+ * choccyenv.h
+ * Header file for choccyenv.c, declaring the environments that bind
+ * interned symbols to values, and defining the scope structure.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYENV_H
+#define CHOCCYENV_H
+
+#include "choccyparsing.h"
+
+/* A binding of an interned symbol to a value, stored in a scope's slots. */
+typedef struct cybinding {
+        /* The symbol id + 1, or 0 when the slot is empty */
+        int sym;
+        cyval* value;
+} cybinding;
+
+/*
+ * Choccy environment (cyenv) struct, a single scope of bindings with a
+ * pointer to its enclosing scope, which is NULL for the global scope.
+ * Bindings live in an open-addressing hash table keyed by symbol id, so a
+ * lookup is an array probe with no string comparisons. Bound values are
+ * owned by the scope and are kept outside the arena.
+ */
+struct cyenv {
+        struct cyenv* parent;
+        int len_slots;
+        int cap_slots;
+        cybinding* slots;
+};
+
+/*
+ * Purpose:    Construct an empty scope.
+ * Parameters: A pointer to the enclosing cyenv, or NULL for a global scope.
+ * Return:     A pointer to a heap-allocated cyenv.
+ */
+cyenv* cyenv_new(cyenv* parent);
+
+/*
+ * Purpose:    Deallocate a scope and the values bound in it, leaving its
+ *             enclosing scopes alone.
+ * Parameters: A pointer to a cyenv to deallocate.
+ * Return:     Void
+ */
+void cyenv_delete(cyenv* env);
+
+/*
+ * Purpose:    Find the value bound to a symbol in a scope or the nearest
+ *             enclosing scope that binds it.
+ * Parameters: A pointer to a cyenv and an int interned symbol id.
+ * Return:     A pointer to the bound cyval, still owned by its scope, or
+ *             NULL if the symbol is unbound.
+ */
+cyval* cyenv_lookup(cyenv* env, int sym);
+
+/*
+ * Purpose:    Get a copy of the value bound to a symbol.
+ * Parameters: A pointer to a cyenv and an int interned symbol id.
+ * Return:     A pointer to a copy of the bound cyval, or to an error if the
+ *             symbol is unbound.
+ */
+cyval* cyenv_get(cyenv* env, int sym);
+
+/*
+ * Purpose:    Bind a symbol to a copy of a value in the given scope,
+ *             replacing any value it was bound to there.
+ * Parameters: A pointer to a cyenv, an int interned symbol id and a
+ *             pointer to a cyval, which is not consumed.
+ * Return:     Void
+ */
+void cyenv_put(cyenv* env, int sym, cyval* value);
+
+/*
+ * Purpose:    Bind a symbol to a value in the given scope without copying
+ *             it, replacing any value it was bound to there.
+ * Parameters: A pointer to a cyenv, an int interned symbol id and a
+ *             pointer to a cyval outside the arena, which the scope takes
+ *             over.
+ * Return:     Void
+ */
+void cyenv_adopt(cyenv* env, int sym, cyval* value);
+
+/*
+ * Purpose:    Tell whether any symbol bound to a builtin function has been
+ *             rebound, by counting such rebindings.
+ * Parameters: Void
+ * Return:     An int that changes whenever such a symbol is rebound.
+ */
+int cyenv_epoch(void);
+
+/*
+ * Purpose:    Bind a symbol to a copy of a value in the global scope that
+ *             encloses the given scope.
+ * Parameters: A pointer to a cyenv, an int interned symbol id and a
+ *             pointer to a cyval, which is not consumed.
+ * Return:     Void
+ */
+void cyenv_def(cyenv* env, int sym, cyval* value);
+
+#endif
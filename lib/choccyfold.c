@@ -0,0 +1,214 @@
+/*
+ * choccyfold.c
+ * Constant folding for Choccy. Before an expression is compiled, each call
+ * to a pure builtin whose arguments are all constants is run once and
+ * replaced by its result, errors included, so the compiled program is left
+ * with only the work that depends on the environment.
+ *
+ * Calls are folded in the order they would be evaluated, and folding stops
+ * at the first call that is not to a pure builtin: "def", "=" or anything
+ * run by "eval" may rebind the symbols later calls go through. The
+ * children of Q-expressions are data and are never folded.
+ *
+ * Stored Q-expressions evaluated again and again, such as a template bound
+ * to a symbol, keep their folded body on their vector, so the constant
+ * work is done once. The cached body is dropped if the vector is modified
+ * and ignored once any symbol bound to a builtin has been rebound.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyfold.h"
+#include "choccyenv.h"
+
+/* Initial number of slots allocated for the work stack. */
+#define CYFOLD_MIN_SLOTS 16
+
+/* An S-expression being folded, and the index of its next child. */
+typedef struct cyfoldwork {
+        cyval* value;
+        int next;
+} cyfoldwork;
+
+/* The folding pass's work stack, kept between passes on this thread. */
+static _Thread_local cyfoldwork* cyfold_work = NULL;
+static _Thread_local int cyfold_len_work = 0;
+static _Thread_local int cyfold_cap_work = 0;
+
+/*
+ * Purpose:    Push an S-expression onto the work stack, first making its
+ *             children its own so folded results can replace them.
+ * Parameters: A pointer to a non-empty cyval S-expression.
+ * Return:     Void
+ */
+static void cyfold_schedule(cyval* value) {
+        if (cyfold_len_work == cyfold_cap_work) {
+                cyfold_cap_work = cyfold_cap_work ?
+                                  cyfold_cap_work * 2 : CYFOLD_MIN_SLOTS;
+                cyfold_work = realloc(cyfold_work, sizeof(cyfoldwork) *
+                                                   cyfold_cap_work);
+        }
+        cyval_own(value);
+        cyfold_work[cyfold_len_work].value = value;
+        cyfold_work[cyfold_len_work].next = 0;
+        cyfold_len_work++;
+}
+
+/*
+ * Purpose:    Tell whether a cyval evaluates to itself.
+ * Parameters: A pointer to a cyval.
+ * Return:     1 if the cyval is a constant, or 0 otherwise.
+ */
+static int cyfold_is_const(cyval* value) {
+        int type = CY_TYPE(value);
+
+        if (type == CYVAL_S_EXP)
+                return value -> len_cyvals == 0;
+        return type != CYVAL_SYM && type != CYVAL_FUN;
+}
+
+/*
+ * Purpose:    Tell whether a builtin's result depends only on its
+ *             arguments, and it has no effect but returning it.
+ * Parameters: An int interned symbol id naming the builtin.
+ * Return:     1 if the builtin can be folded, or 0 otherwise.
+ */
+int cyfold_is_pure(int func) {
+        switch (func) {
+        case CYSYM_LIST: case CYSYM_HEAD: case CYSYM_TAIL: case CYSYM_JOIN:
+        case CYSYM_ADD: case CYSYM_SUB: case CYSYM_MUL: case CYSYM_DIV:
+        case CYSYM_MOD: case CYSYM_POW: case CYSYM_VEC: case CYSYM_SUM:
+        case CYSYM_MIN: case CYSYM_MAX: case CYSYM_DOT: case CYSYM_EQ:
+        case CYSYM_NE:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+/*
+ * Purpose:    Fold an S-expression whose children have been folded, if it
+ *             is a call to a pure builtin on constants, or a single
+ *             constant in parentheses.
+ * Parameters: A pointer to the cyenv to look up functions in, a pointer to
+ *             a non-empty cyval S-expression and a pointer to an int set to
+ *             1 if the S-expression calls something that is not a pure
+ *             builtin.
+ * Return:     A pointer to the result, consuming the S-expression, or NULL
+ *             if it cannot be folded, leaving it untouched.
+ */
+static cyval* cyfold_call(cyenv* env, cyval* value, int* impure) {
+        int i;
+        cyval* fun = NULL;
+
+        if (value -> len_cyvals == 1)
+                return cyfold_is_const(value -> cyvals[0]) ?
+                       cyval_take(value, 0) : NULL;
+        /* A builtin itself, as in calls built by "map", is its own head. */
+        if (CY_IS_FUN(value -> cyvals[0]))
+                fun = value -> cyvals[0];
+        else if (CY_IS_SYM(value -> cyvals[0]))
+                fun = cyenv_lookup(env, CY_SYM_OF(value -> cyvals[0]));
+        if (fun == NULL || !CY_IS_FUN(fun) ||
+            !cyfold_is_pure(CY_FUN_OF(fun))) {
+                *impure = 1;
+                return NULL;
+        }
+        for (i = 1; i < value -> len_cyvals; i++)
+                if (!cyfold_is_const(value -> cyvals[i]))
+                        return NULL;
+
+        /* As in the VM, a call passed an error returns the first one. */
+        cyval_pop(value, 0);
+        for (i = 0; i < value -> len_cyvals; i++)
+                if (CY_TYPE(value -> cyvals[i]) == CYVAL_ERROR)
+                        return cyval_take(value, i);
+        return builtins(env, value, CY_FUN_OF(fun));
+}
+
+/*
+ * Purpose:    Fold the calls to pure builtins on constant arguments in an
+ *             expression, replacing each with its result. S-expressions
+ *             waiting to be folded are kept on a work stack instead of the
+ *             C stack, so nesting depth is limited only by memory.
+ * Parameters: A pointer to the cyenv the expression will be evaluated in, a
+ *             pointer to the cyval expression, which is consumed, and a
+ *             pointer to an int set to 1 if anything was folded, or NULL.
+ * Return:     A pointer to the folded expression.
+ */
+cyval* cyfold_expr(cyenv* env, cyval* value, int* folded) {
+        int base = cyfold_len_work;
+        int impure = 0;
+        cyval* child;
+        cyval* result;
+        cyfoldwork* work;
+
+        if (CY_TYPE(value) != CYVAL_S_EXP || value -> len_cyvals == 0)
+                return value;
+        cyfold_schedule(value);
+        while (cyfold_len_work > base) {
+                work = &cyfold_work[cyfold_len_work - 1];
+                value = work -> value;
+
+                /* Fold the children first, in the order they evaluate. */
+                if (!impure && work -> next < value -> len_cyvals) {
+                        child = value -> cyvals[work -> next++];
+                        if (CY_TYPE(child) == CYVAL_S_EXP &&
+                            child -> len_cyvals > 0)
+                                cyfold_schedule(child);
+                        continue;
+                }
+                cyfold_len_work--;
+                if (impure || (result = cyfold_call(env, value,
+                                                    &impure)) == NULL)
+                        continue;
+                if (folded != NULL)
+                        *folded = 1;
+                /* Put the result in place of the call. */
+                if (cyfold_len_work == base)
+                        return result;
+                work = &cyfold_work[cyfold_len_work - 1];
+                work -> value -> cyvals[work -> next - 1] = result;
+        }
+        return value;
+}
+
+/*
+ * Purpose:    Turn the Q-expression passed to "eval" into the folded
+ *             S-expression to run, reusing the body folded by an earlier
+ *             evaluation of the same stored Q-expression when it is still
+ *             valid.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression, which is consumed.
+ * Return:     A pointer to a cyval S-expression.
+ */
+cyval* cyfold_body(cyenv* env, cyval* value) {
+        int folded = 0;
+        int stored;
+        cyvec* vec = value -> vec;
+        cyval* body;
+
+        /*
+         * Only a Q-expression that shares its whole vector with another
+         * cyval, such as one bound to a symbol, is likely to be evaluated
+         * again.
+         */
+        stored = vec != NULL && vec -> refs > 1 &&
+                 value -> off_cyvals == vec -> lo &&
+                 value -> off_cyvals + value -> len_cyvals == vec -> hi;
+        if (stored && vec -> folded != NULL &&
+            vec -> folded_epoch == cyenv_epoch()) {
+                body = cyval_copy(vec -> folded);
+                cyval_destructor(value);
+                return body;
+        }
+
+        value -> data_type = CYVAL_S_EXP;
+        body = cyfold_expr(env, value, &folded);
+        if (stored && folded) {
+                cyval_destructor(vec -> folded);
+                vec -> folded = cyval_persist(body);
+                vec -> folded_epoch = cyenv_epoch();
+        }
+        return body;
+}
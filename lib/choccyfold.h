@@ -0,0 +1,43 @@
+/*
+ * choccyfold.h
+ * Header file for choccyfold.c, declaring the constant folding pass run
+ * over expressions before they are compiled.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYFOLD_H
+#define CHOCCYFOLD_H
+
+#include "choccyparsing.h"
+
+/*
+ * Purpose:    Tell whether a builtin's result depends only on its
+ *             arguments, and it has no effect but returning it.
+ * Parameters: An int interned symbol id naming the builtin.
+ * Return:     1 if the builtin can be folded, or 0 otherwise.
+ */
+int cyfold_is_pure(int func);
+
+/*
+ * Purpose:    Fold the calls to pure builtins on constant arguments in an
+ *             expression, replacing each with its result.
+ * Parameters: A pointer to the cyenv the expression will be evaluated in, a
+ *             pointer to the cyval expression, which is consumed, and a
+ *             pointer to an int set to 1 if anything was folded, or NULL.
+ * Return:     A pointer to the folded expression.
+ */
+cyval* cyfold_expr(cyenv* env, cyval* value, int* folded);
+
+/*
+ * Purpose:    Turn the Q-expression passed to "eval" into the folded
+ *             S-expression to run, reusing the body folded by an earlier
+ *             evaluation of the same stored Q-expression when it is still
+ *             valid.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression, which is consumed.
+ * Return:     A pointer to a cyval S-expression.
+ */
+cyval* cyfold_body(cyenv* env, cyval* value);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * choccyhash.c
+ * Structural hashing, equality and size measurement of Choccy values.
+ * Each walks the value with an explicit stack instead of recursing, so
+ * nesting depth is limited only by memory.
+ *
+ * The hash of an expression is built from the hashes of its children, and
+ * the hash of a vector's children is cached on the vector, which is never
+ * modified while shared. Hashing or comparing a shared expression again
+ * takes constant time.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyhash.h"
+
+/* Initial number of slots allocated for the walk stacks. */
+#define CYHASH_MIN_SLOTS 16
+
+/* Multiplier and offset basis of the 64-bit FNV hash. */
+#define CYHASH_PRIME  0x100000001b3ULL
+#define CYHASH_OFFSET 0xcbf29ce484222325ULL
+
+/* An expression being hashed and the hash of its children so far. */
+typedef struct cyhashframe {
+        cyval* value;
+        int next;
+        uint64_t hash;
+} cyhashframe;
+
+/* The stack of cyvals waiting to be walked, kept between walks. */
+static _Thread_local cyval** cyhash_stack = NULL;
+static _Thread_local int cyhash_len_stack = 0;
+static _Thread_local int cyhash_cap_stack = 0;
+
+/* The stack of expressions being hashed, kept between hashes. */
+static _Thread_local cyhashframe* cyhash_frames = NULL;
+static _Thread_local int cyhash_len_frames = 0;
+static _Thread_local int cyhash_cap_frames = 0;
+
+/*
+ * Purpose:    Push a cyval onto the walk stack.
+ * Parameters: A pointer to a cyval.
+ * Return:     Void
+ */
+static void cyhash_push(cyval* value) {
+        if (cyhash_len_stack == cyhash_cap_stack) {
+                cyhash_cap_stack = cyhash_cap_stack ?
+                                   cyhash_cap_stack * 2 : CYHASH_MIN_SLOTS;
+                cyhash_stack = realloc(cyhash_stack, sizeof(cyval*) *
+                                                     cyhash_cap_stack);
+        }
+        cyhash_stack[cyhash_len_stack++] = value;
+}
+
+/*
+ * Purpose:    Mix a word into a hash.
+ * Parameters: A 64-bit hash and a 64-bit word.
+ * Return:     The new hash.
+ */
+static uint64_t cyhash_mix(uint64_t hash, uint64_t word) {
+        return (hash ^ word) * CYHASH_PRIME;
+}
+
+/*
+ * Purpose:    Finish a hash, spreading its low bits, which pick a table
+ *             slot, over all 64. A finished hash is never 0, which marks a
+ *             vector whose hash is not cached.
+ * Parameters: A 64-bit hash.
+ * Return:     The finished hash.
+ */
+static uint64_t cyhash_finish(uint64_t hash) {
+        hash ^= hash >> 31;
+        hash *= 0x7fb5d329728ea185ULL;
+        hash ^= hash >> 27;
+
+        return hash ? hash : 1;
+}
+
+/*
+ * Purpose:    Tell whether an expression's children are the whole of its
+ *             vector, so the vector's cached hash is theirs.
+ * Parameters: A pointer to a cyval S-expression or Q-expression.
+ * Return:     1 if the cyval views its whole vector, or 0 otherwise.
+ */
+static int cyhash_whole(cyval* value) {
+        return value -> vec != NULL &&
+               value -> off_cyvals == value -> vec -> lo &&
+               value -> off_cyvals + value -> len_cyvals == value -> vec -> hi;
+}
+
+/*
+ * Purpose:    Hash a cyval that has no children: a number, symbol,
+ *             builtin, error or numeric vector.
+ * Parameters: A pointer to a cyval.
+ * Return:     A finished 64-bit hash.
+ */
+static uint64_t cyhash_leaf(cyval* value) {
+        int i;
+        int type = CY_TYPE(value);
+        uint64_t hash = cyhash_mix(CYHASH_OFFSET, type);
+        char* c;
+
+        if (type == CYVAL_NUM) {
+                hash = cyhash_mix(hash, CY_NUM_OF(value));
+        } else if (type == CYVAL_SYM) {
+                hash = cyhash_mix(hash, CY_SYM_OF(value));
+        } else if (type == CYVAL_FUN) {
+                hash = cyhash_mix(hash, CY_FUN_OF(value));
+        } else if (type == CYVAL_BIG) {
+                hash = cyhash_mix(hash, value -> big.sign);
+                for (i = 0; i < value -> big.len_limbs; i++)
+                        hash = cyhash_mix(hash, value -> big.limbs[i]);
+        } else if (type == CYVAL_NUMS) {
+                hash = cyhash_mix(hash, value -> nums -> len);
+                for (i = 0; i < value -> nums -> len; i++)
+                        hash = cyhash_mix(hash, value -> nums -> items[i]);
+        } else if (type == CYVAL_ERROR) {
+                for (c = value -> error; *c != '\0'; c++)
+                        hash = cyhash_mix(hash, (unsigned char) *c);
+        }
+        return cyhash_finish(hash);
+}
+
+/*
+ * Purpose:    Hash a cyval without walking its children, if it has none
+ *             or their hash is cached on its vector.
+ * Parameters: A pointer to a cyval.
+ * Return:     A finished 64-bit hash, or 0 if the children must be walked.
+ */
+static uint64_t cyhash_known(cyval* value) {
+        int type = CY_TYPE(value);
+
+        if (type != CYVAL_S_EXP && type != CYVAL_Q_EXP)
+                return cyhash_leaf(value);
+        if (value -> len_cyvals == 0)
+                return cyhash_finish(cyhash_mix(CYHASH_OFFSET, type));
+        if (cyhash_whole(value) && value -> vec -> hash != 0)
+                return cyhash_finish(cyhash_mix(value -> vec -> hash, type));
+        return 0;
+}
+
+/*
+ * Purpose:    Push an expression onto the stack of expressions being
+ *             hashed.
+ * Parameters: A pointer to a non-empty cyval S-expression or Q-expression.
+ * Return:     Void
+ */
+static void cyhash_enter(cyval* value) {
+        if (cyhash_len_frames == cyhash_cap_frames) {
+                cyhash_cap_frames = cyhash_cap_frames ?
+                                    cyhash_cap_frames * 2 : CYHASH_MIN_SLOTS;
+                cyhash_frames = realloc(cyhash_frames, sizeof(cyhashframe) *
+                                                       cyhash_cap_frames);
+        }
+        cyhash_frames[cyhash_len_frames].value = value;
+        cyhash_frames[cyhash_len_frames].next = 0;
+        cyhash_frames[cyhash_len_frames].hash =
+                cyhash_mix(CYHASH_OFFSET, value -> len_cyvals);
+        cyhash_len_frames++;
+}
+
+/*
+ * Purpose:    Hash a cyval by its structure, so that cyvals equal under
+ *             cyval_equal hash alike, caching the hash of the children of
+ *             each expression that views its whole vector.
+ * Parameters: A pointer to a cyval.
+ * Return:     A 64-bit hash, never 0.
+ */
+uint64_t cyval_hash(cyval* value) {
+        int base = cyhash_len_frames;
+        uint64_t hash;
+        cyval* child;
+        cyhashframe* frame;
+
+        if ((hash = cyhash_known(value)) != 0)
+                return hash;
+        cyhash_enter(value);
+        for (;;) {
+                frame = &cyhash_frames[cyhash_len_frames - 1];
+                value = frame -> value;
+                if (frame -> next < value -> len_cyvals) {
+                        child = value -> cyvals[frame -> next++];
+                        if ((hash = cyhash_known(child)) == 0)
+                                cyhash_enter(child);
+                        else
+                                frame -> hash = cyhash_mix(frame -> hash,
+                                                           hash);
+                        continue;
+                }
+
+                /* Every child is hashed, so the expression can be. */
+                hash = cyhash_finish(frame -> hash);
+                if (cyhash_whole(value))
+                        value -> vec -> hash = hash;
+                hash = cyhash_finish(cyhash_mix(hash, value -> data_type));
+                if (--cyhash_len_frames == base)
+                        return hash;
+                frame = &cyhash_frames[cyhash_len_frames - 1];
+                frame -> hash = cyhash_mix(frame -> hash, hash);
+        }
+}
+
+/*
+ * Purpose:    Compare two expressions of the same type and length without
+ *             walking their children, where their vectors settle it.
+ * Parameters: Pointers to two cyval S-expressions or Q-expressions.
+ * Return:     1 if they are equal, 0 if they are not, or -1 if their
+ *             children must be compared.
+ */
+static int cyhash_same_vec(cyval* a, cyval* b) {
+        if (a -> cyvals == b -> cyvals)
+                return 1;
+        if (!cyhash_whole(a) || !cyhash_whole(b))
+                return -1;
+        /* Equal hash-consed vectors are always the same vector. */
+        if (a -> vec -> consed && b -> vec -> consed)
+                return 0;
+        if (a -> vec -> hash != 0 && b -> vec -> hash != 0 &&
+            a -> vec -> hash != b -> vec -> hash)
+                return 0;
+        return -1;
+}
+
+/*
+ * Purpose:    Compare two cyvals by structure: numbers by value, symbols
+ *             and builtins by id, and expressions child by child. Shared
+ *             and hash-consed expressions, and ones whose hashes are cached
+ *             and differ, are compared in constant time.
+ * Parameters: Pointers to two cyvals.
+ * Return:     1 if the cyvals are equal, or 0 otherwise.
+ */
+int cyval_equal(cyval* a, cyval* b) {
+        int i;
+        int type;
+        int equal = 1;
+        int base = cyhash_len_stack;
+
+        cyhash_push(a);
+        cyhash_push(b);
+        while (equal && cyhash_len_stack > base) {
+                b = cyhash_stack[--cyhash_len_stack];
+                a = cyhash_stack[--cyhash_len_stack];
+                /* Immediates and shared nodes are equal to themselves. */
+                if (a == b)
+                        continue;
+                type = CY_TYPE(a);
+                if (type != CY_TYPE(b) || !CY_IS_HEAP(a) || !CY_IS_HEAP(b)) {
+                        equal = 0;
+                } else if (type == CYVAL_NUM) {
+                        equal = a -> num == b -> num;
+                } else if (type == CYVAL_BIG) {
+                        equal = a -> big.sign == b -> big.sign &&
+                                a -> big.len_limbs == b -> big.len_limbs &&
+                                memcmp(a -> big.limbs, b -> big.limbs,
+                                       sizeof(uint32_t) *
+                                       a -> big.len_limbs) == 0;
+                } else if (type == CYVAL_NUMS) {
+                        equal = a -> nums == b -> nums ||
+                                (a -> nums -> len == b -> nums -> len &&
+                                 memcmp(a -> nums -> items,
+                                        b -> nums -> items, sizeof(long) *
+                                        a -> nums -> len) == 0);
+                } else if (type == CYVAL_ERROR) {
+                        equal = strcmp(a -> error, b -> error) == 0;
+                } else if (a -> len_cyvals != b -> len_cyvals) {
+                        equal = 0;
+                } else if (a -> len_cyvals > 0 &&
+                           (equal = cyhash_same_vec(a, b)) == -1) {
+                        equal = 1;
+                        for (i = 0; i < a -> len_cyvals; i++) {
+                                cyhash_push(a -> cyvals[i]);
+                                cyhash_push(b -> cyvals[i]);
+                        }
+                }
+        }
+        cyhash_len_stack = base;
+
+        return equal;
+}
+
+/*
+ * Purpose:    Estimate the memory held by a cyval and everything it owns,
+ *             counting a vector shared by several children once for each.
+ * Parameters: A pointer to a cyval.
+ * Return:     The size in bytes.
+ */
+size_t cyval_bytes(cyval* value) {
+        int i;
+        int type;
+        int base = cyhash_len_stack;
+        size_t bytes = 0;
+
+        cyhash_push(value);
+        while (cyhash_len_stack > base) {
+                value = cyhash_stack[--cyhash_len_stack];
+                if (!CY_IS_HEAP(value))
+                        continue;
+                bytes += sizeof(cyval);
+                type = value -> data_type;
+                if (type == CYVAL_BIG) {
+                        bytes += sizeof(uint32_t) * value -> big.len_limbs;
+                } else if (type == CYVAL_NUMS) {
+                        bytes += sizeof(cynums) +
+                                 sizeof(long) * value -> nums -> len;
+                } else if (type == CYVAL_ERROR) {
+                        bytes += strlen(value -> error) + 1;
+                } else if (type == CYVAL_S_EXP || type == CYVAL_Q_EXP) {
+                        if (value -> vec != NULL)
+                                bytes += sizeof(cyvec) + sizeof(cyval*) *
+                                         value -> vec -> cap;
+                        for (i = 0; i < value -> len_cyvals; i++)
+                                cyhash_push(value -> cyvals[i]);
+                }
+        }
+
+        return bytes;
+}
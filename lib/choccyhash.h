@@ -0,0 +1,41 @@
+/*
+ * choccyhash.h
+ * Header file for choccyhash.c, declaring structural hashing, equality and
+ * size measurement of cyvals.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYHASH_H
+#define CHOCCYHASH_H
+
+#include "choccyparsing.h"
+
+/*
+ * Purpose:    Hash a cyval by its structure, so that cyvals equal under
+ *             cyval_equal hash alike, caching the hash of the children of
+ *             each expression that views its whole vector.
+ * Parameters: A pointer to a cyval.
+ * Return:     A 64-bit hash, never 0.
+ */
+uint64_t cyval_hash(cyval* value);
+
+/*
+ * Purpose:    Compare two cyvals by structure: numbers by value, symbols
+ *             and builtins by id, and expressions child by child. Shared
+ *             and hash-consed expressions, and ones whose hashes are cached
+ *             and differ, are compared in constant time.
+ * Parameters: Pointers to two cyvals.
+ * Return:     1 if the cyvals are equal, or 0 otherwise.
+ */
+int cyval_equal(cyval* a, cyval* b);
+
+/*
+ * Purpose:    Estimate the memory held by a cyval and everything it owns,
+ *             counting a vector shared by several children once for each.
+ * Parameters: A pointer to a cyval.
+ * Return:     The size in bytes.
+ */
+size_t cyval_bytes(cyval* value);
+
+#endif
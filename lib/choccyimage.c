@@ -0,0 +1,548 @@
+/*
+ * choccyimage.c
+ * Heap images for Choccy. An image holds the bindings of a global scope,
+ * the values they are bound to and the symbol table, laid out as the
+ * nodes, vectors and numbers the interpreter uses, with pointers set as
+ * if the file were mapped at CYIMAGE_BASE. Loading an image maps the file
+ * copy-on-write and binds its values where they lie, so warm data is
+ * usable as soon as it is mapped and only the pages read are ever loaded.
+ *
+ * An image mapped anywhere else has each pointer in its relocation table
+ * moved, and one loaded after other symbols were interned has each symbol
+ * in its table of symbols renumbered. Nodes in an image are marked as
+ * such and are never freed, and its vectors are pinned, so copies of its
+ * values share them safely.
+ *
+ * Images are only checked for their layout and version, and must be
+ * trusted like the code that made them.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "choccyimage.h"
+#include "choccyenv.h"
+#include "choccyalloc.h"
+
+/* Chars an image starts with. */
+#define CYIMAGE_MAGIC "CYIMAGE"
+
+/* Initial number of bytes, offsets or shared objects a buffer holds. */
+#define CYIMAGE_MIN_BYTES 4096
+#define CYIMAGE_MIN_SLOTS 16
+
+/* The header at the start of an image, locating its tables. */
+typedef struct cyimagehead {
+        char magic[8];
+        uint64_t version;
+        uint64_t size_cyval;
+        uint64_t size_cyvec;
+        uint64_t base;
+        uint64_t size;
+        uint64_t len_syms;
+        uint64_t off_syms;
+        uint64_t len_bindings;
+        uint64_t off_bindings;
+        uint64_t len_relocs;
+        uint64_t off_relocs;
+        uint64_t len_symrefs;
+        uint64_t off_symrefs;
+} cyimagehead;
+
+/* A cyval pointer waiting to be written, and the offset it goes at. */
+typedef struct cyimagework {
+        uint64_t at;
+        cyval* value;
+} cyimagework;
+
+/*
+ * An image being written: its bytes so far, the offsets of its pointers
+ * and of its symbols, the offsets of the shared vectors and numeric
+ * vectors already written, in an open-addressing table keyed by address,
+ * and the stack of pointers still to write.
+ */
+typedef struct cyimagebuf {
+        char* data;
+        size_t len;
+        size_t cap;
+        uint64_t* relocs;
+        size_t len_relocs;
+        size_t cap_relocs;
+        uint64_t* symrefs;
+        size_t len_symrefs;
+        size_t cap_symrefs;
+        const void** seen;
+        uint64_t* seen_at;
+        size_t len_seen;
+        size_t cap_seen;
+        cyimagework* work;
+        size_t len_work;
+        size_t cap_work;
+} cyimagebuf;
+
+/*
+ * Purpose:    Reserve zeroed room at the end of an image, keeping what
+ *             follows 8-byte aligned.
+ * Parameters: A pointer to a cyimagebuf and a size_t number of bytes.
+ * Return:     The uint64_t offset of the room.
+ */
+static uint64_t cyimage_alloc(cyimagebuf* buf, size_t size) {
+        uint64_t at = buf -> len;
+
+        size = (size + 7) & ~(size_t) 7;
+        while (buf -> len + size > buf -> cap) {
+                buf -> cap = buf -> cap ? buf -> cap * 2 : CYIMAGE_MIN_BYTES;
+                buf -> data = realloc(buf -> data, buf -> cap);
+        }
+        memset(buf -> data + at, 0, size);
+        buf -> len += size;
+
+        return at;
+}
+
+/*
+ * Purpose:    Add an offset to a growable list of offsets.
+ * Parameters: A pointer to the list, a pointer to its length, a pointer
+ *             to its capacity and the uint64_t offset.
+ * Return:     Void
+ */
+static void cyimage_note(uint64_t** list, size_t* len, size_t* cap,
+                         uint64_t at) {
+        if (*len == *cap) {
+                *cap = *cap ? *cap * 2 : CYIMAGE_MIN_SLOTS;
+                *list = realloc(*list, sizeof(uint64_t) * *cap);
+        }
+        (*list)[(*len)++] = at;
+}
+
+/*
+ * Purpose:    Hash an address into the table of shared objects written.
+ * Parameters: A pointer to a cyimagebuf and an address.
+ * Return:     The size_t index of the slot holding the address, or of the
+ *             empty slot where it belongs.
+ */
+static size_t cyimage_slot(cyimagebuf* buf, const void* key) {
+        size_t i = (size_t) (((uintptr_t) key >> 4) * 2654435761u) &
+                   (buf -> cap_seen - 1);
+
+        while (buf -> seen[i] != NULL && buf -> seen[i] != key)
+                i = (i + 1) & (buf -> cap_seen - 1);
+        return i;
+}
+
+/*
+ * Purpose:    Find where a shared object was written.
+ * Parameters: A pointer to a cyimagebuf and the address of the object.
+ * Return:     The uint64_t offset of the object, or 0 if it is not written.
+ */
+static uint64_t cyimage_find(cyimagebuf* buf, const void* key) {
+        size_t i;
+
+        if (buf -> cap_seen == 0)
+                return 0;
+        i = cyimage_slot(buf, key);
+        return buf -> seen[i] == key ? buf -> seen_at[i] : 0;
+}
+
+/*
+ * Purpose:    Remember where a shared object was written, so values sharing
+ *             it share it in the image too.
+ * Parameters: A pointer to a cyimagebuf, the address of the object and the
+ *             uint64_t offset it was written at.
+ * Return:     Void
+ */
+static void cyimage_remember(cyimagebuf* buf, const void* key, uint64_t at) {
+        size_t i;
+        size_t slot;
+        size_t cap = buf -> cap_seen;
+        const void** seen = buf -> seen;
+        uint64_t* seen_at = buf -> seen_at;
+
+        /* Keep the load factor at or below one half. */
+        if ((buf -> len_seen + 1) * 2 > cap) {
+                buf -> cap_seen = cap ? cap * 2 : CYIMAGE_MIN_SLOTS;
+                buf -> seen = calloc(buf -> cap_seen, sizeof(void*));
+                buf -> seen_at = malloc(sizeof(uint64_t) * buf -> cap_seen);
+                for (i = 0; i < cap; i++) {
+                        if (seen[i] != NULL) {
+                                slot = cyimage_slot(buf, seen[i]);
+                                buf -> seen[slot] = seen[i];
+                                buf -> seen_at[slot] = seen_at[i];
+                        }
+                }
+                free(seen);
+                free(seen_at);
+        }
+        i = cyimage_slot(buf, key);
+        buf -> seen[i] = key;
+        buf -> seen_at[i] = at;
+        buf -> len_seen++;
+}
+
+/*
+ * Purpose:    Write a pointer into an image, as it will read once the
+ *             image is mapped at CYIMAGE_BASE, and note it for relocation.
+ * Parameters: A pointer to a cyimagebuf, the uint64_t offset of the
+ *             pointer and the uint64_t offset it points at.
+ * Return:     Void
+ */
+static void cyimage_point(cyimagebuf* buf, uint64_t at, uint64_t target) {
+        uintptr_t word = CYIMAGE_BASE + (uintptr_t) target;
+
+        memcpy(buf -> data + at, &word, sizeof(word));
+        cyimage_note(&buf -> relocs, &buf -> len_relocs, &buf -> cap_relocs,
+                     at);
+}
+
+/*
+ * Purpose:    Push a cyval pointer onto the stack of pointers to write, so
+ *             nested values are written without recursing.
+ * Parameters: A pointer to a cyimagebuf, the uint64_t offset of the
+ *             pointer and a pointer to the cyval.
+ * Return:     Void
+ */
+static void cyimage_push(cyimagebuf* buf, uint64_t at, cyval* value) {
+        if (buf -> len_work == buf -> cap_work) {
+                buf -> cap_work = buf -> cap_work ? buf -> cap_work * 2 :
+                                                    CYIMAGE_MIN_SLOTS;
+                buf -> work = realloc(buf -> work, sizeof(cyimagework) *
+                                                   buf -> cap_work);
+        }
+        buf -> work[buf -> len_work].at = at;
+        buf -> work[buf -> len_work].value = value;
+        buf -> len_work++;
+}
+
+/*
+ * Purpose:    Write the children of an S-expression or Q-expression into an
+ *             image as a vector of their own, or find the vector already
+ *             written for them when they are all of a shared vector. The
+ *             children are pushed to be written after it.
+ * Parameters: A pointer to a cyimagebuf and a pointer to a non-empty cyval
+ *             S-expression or Q-expression.
+ * Return:     The uint64_t offset of the vector.
+ */
+static uint64_t cyimage_vec(cyimagebuf* buf, cyval* value) {
+        int i;
+        int whole = value -> off_cyvals == value -> vec -> lo &&
+                    value -> off_cyvals + value -> len_cyvals ==
+                    value -> vec -> hi;
+        uint64_t at;
+        cyvec head;
+
+        if (whole && (at = cyimage_find(buf, value -> vec)) != 0)
+                return at;
+        at = cyimage_alloc(buf, sizeof(cyvec) +
+                                sizeof(cyval*) * value -> len_cyvals);
+        memset(&head, 0, sizeof(head));
+        head.refs = CYIMAGE_PINNED;
+        head.cap = value -> len_cyvals;
+        head.hi = value -> len_cyvals;
+        memcpy(buf -> data + at, &head, sizeof(head));
+        if (whole)
+                cyimage_remember(buf, value -> vec, at);
+
+        for (i = value -> len_cyvals - 1; i >= 0; i--)
+                cyimage_push(buf, at + offsetof(cyvec, items) +
+                                  sizeof(cyval*) * i, value -> cyvals[i]);
+
+        return at;
+}
+
+/*
+ * Purpose:    Write a node and what it points at into an image, pushing
+ *             the children of an expression to be written after it.
+ * Parameters: A pointer to a cyimagebuf and a pointer to a heap cyval.
+ * Return:     The uint64_t offset of the node.
+ */
+static uint64_t cyimage_node(cyimagebuf* buf, cyval* value) {
+        uint64_t at = cyimage_alloc(buf, sizeof(cyval));
+        uint64_t data = 0;
+        size_t size;
+        cyval node;
+
+        memset(&node, 0, sizeof(node));
+        node.data_type = value -> data_type;
+        node.owner = CYALLOC_IMAGE;
+
+        /* Write what the node points at first, then the node itself. */
+        if (value -> data_type == CYVAL_NUM) {
+                node.num = value -> num;
+        } else if (value -> data_type == CYVAL_ERROR) {
+                size = strlen(value -> error) + 1;
+                data = cyimage_alloc(buf, size);
+                memcpy(buf -> data + data, value -> error, size);
+        } else if (value -> data_type == CYVAL_BIG) {
+                node.big.sign = value -> big.sign;
+                node.big.len_limbs = value -> big.len_limbs;
+                size = sizeof(uint32_t) * value -> big.len_limbs;
+                data = cyimage_alloc(buf, size);
+                memcpy(buf -> data + data, value -> big.limbs, size);
+        } else if (value -> data_type == CYVAL_NUMS) {
+                if ((data = cyimage_find(buf, value -> nums)) == 0) {
+                        size = sizeof(long) * value -> nums -> len;
+                        data = cyimage_alloc(buf, sizeof(cynums) + size);
+                        memcpy(buf -> data + data, value -> nums,
+                               sizeof(cynums) + size);
+                        ((cynums*) (buf -> data + data)) -> refs =
+                                CYIMAGE_PINNED;
+                        cyimage_remember(buf, value -> nums, data);
+                }
+        } else {
+                node.len_cyvals = value -> len_cyvals;
+                if (value -> len_cyvals > 0)
+                        data = cyimage_vec(buf, value);
+        }
+        memcpy(buf -> data + at, &node, sizeof(node));
+
+        if (value -> data_type == CYVAL_ERROR) {
+                cyimage_point(buf, at + offsetof(cyval, error), data);
+        } else if (value -> data_type == CYVAL_BIG) {
+                cyimage_point(buf, at + offsetof(cyval, big.limbs), data);
+        } else if (value -> data_type == CYVAL_NUMS) {
+                cyimage_point(buf, at + offsetof(cyval, nums), data);
+        } else if (value -> data_type != CYVAL_NUM && data != 0) {
+                cyimage_point(buf, at + offsetof(cyval, vec), data);
+                cyimage_point(buf, at + offsetof(cyval, cyvals),
+                              data + offsetof(cyvec, items));
+        }
+
+        return at;
+}
+
+/*
+ * Purpose:    Write a cyval pointer into an image, writing the value it
+ *             points at, and everything that holds, if it is not an
+ *             immediate. Pointers still to write are kept on a stack
+ *             instead of the C stack, so nesting depth is limited only by
+ *             memory.
+ * Parameters: A pointer to a cyimagebuf, the uint64_t offset of the
+ *             pointer and a pointer to the cyval.
+ * Return:     Void
+ */
+static void cyimage_store(cyimagebuf* buf, uint64_t at, cyval* value) {
+        cyimagework work;
+
+        cyimage_push(buf, at, value);
+        while (buf -> len_work > 0) {
+                work = buf -> work[--buf -> len_work];
+                if (CY_IS_HEAP(work.value)) {
+                        cyimage_point(buf, work.at,
+                                      cyimage_node(buf, work.value));
+                        continue;
+                }
+                memcpy(buf -> data + work.at, &work.value, sizeof(cyval*));
+                if (CY_IS_SYM(work.value))
+                        cyimage_note(&buf -> symrefs, &buf -> len_symrefs,
+                                     &buf -> cap_symrefs, work.at);
+        }
+}
+
+/*
+ * Purpose:    Tell whether a binding is a builtin still bound to its own
+ *             name, which every global scope starts with.
+ * Parameters: A pointer to a cybinding in use.
+ * Return:     1 if the binding is a builtin's own, or 0 otherwise.
+ */
+static int cyimage_is_builtin(cybinding* binding) {
+        return CY_IS_FUN(binding -> value) &&
+               CY_FUN_OF(binding -> value) == binding -> sym - 1;
+}
+
+/*
+ * Purpose:    Save the bindings of the global scope, and every value they
+ *             hold, to an image file. Builtins still bound to their own
+ *             names are left out.
+ * Parameters: A pointer to a cyenv whose global scope is saved and a
+ *             c-string path of the file to write.
+ * Return:     NULL if the image was written, or a c-string describing why
+ *             it was not.
+ */
+const char* cyimage_save(cyenv* env, const char* path) {
+        int i;
+        int j;
+        size_t size = 0;
+        uint64_t at;
+        const char* error = NULL;
+        char* name;
+        FILE* file;
+        cybinding* slot;
+        cyimagehead head;
+        cyimagebuf buf;
+
+        while (env -> parent != NULL)
+                env = env -> parent;
+        memset(&buf, 0, sizeof(buf));
+        memset(&head, 0, sizeof(head));
+        cyimage_alloc(&buf, sizeof(head));
+
+        /* Every symbol is kept, in order, so ids match when loaded. */
+        head.len_syms = cysym_count();
+        for (i = 0; i < (int) head.len_syms; i++)
+                size += strlen(cysym_name(i)) + 1;
+        head.off_syms = cyimage_alloc(&buf, size);
+        for (i = 0, at = head.off_syms; i < (int) head.len_syms; i++) {
+                name = cysym_name(i);
+                memcpy(buf.data + at, name, strlen(name) + 1);
+                at += strlen(name) + 1;
+        }
+
+        for (i = 0; i < env -> cap_slots; i++)
+                if (env -> slots[i].sym &&
+                    !cyimage_is_builtin(&env -> slots[i]))
+                        head.len_bindings++;
+        head.off_bindings = cyimage_alloc(&buf, sizeof(cybinding) *
+                                                head.len_bindings);
+        for (i = 0, j = 0; i < env -> cap_slots; i++) {
+                slot = &env -> slots[i];
+                if (!slot -> sym || cyimage_is_builtin(slot))
+                        continue;
+                at = head.off_bindings + sizeof(cybinding) * j++;
+                memcpy(buf.data + at + offsetof(cybinding, sym),
+                       &slot -> sym, sizeof(int));
+                cyimage_store(&buf, at + offsetof(cybinding, value),
+                              slot -> value);
+        }
+
+        head.len_relocs = buf.len_relocs;
+        head.off_relocs = cyimage_alloc(&buf, sizeof(uint64_t) *
+                                              buf.len_relocs);
+        if (buf.len_relocs > 0)
+                memcpy(buf.data + head.off_relocs, buf.relocs,
+                       sizeof(uint64_t) * buf.len_relocs);
+        head.len_symrefs = buf.len_symrefs;
+        head.off_symrefs = cyimage_alloc(&buf, sizeof(uint64_t) *
+                                               buf.len_symrefs);
+        if (buf.len_symrefs > 0)
+                memcpy(buf.data + head.off_symrefs, buf.symrefs,
+                       sizeof(uint64_t) * buf.len_symrefs);
+
+        memcpy(head.magic, CYIMAGE_MAGIC, sizeof(head.magic));
+        head.version = CYIMAGE_VERSION;
+        head.size_cyval = sizeof(cyval);
+        head.size_cyvec = sizeof(cyvec);
+        head.base = CYIMAGE_BASE;
+        head.size = buf.len;
+        memcpy(buf.data, &head, sizeof(head));
+
+        if ((file = fopen(path, "wb")) == NULL ||
+            fwrite(buf.data, 1, buf.len, file) != buf.len)
+                error = strerror(errno);
+        if (file != NULL && fclose(file) != 0 && error == NULL)
+                error = strerror(errno);
+
+        free(buf.data);
+        free(buf.relocs);
+        free(buf.symrefs);
+        free(buf.seen);
+        free(buf.seen_at);
+        free(buf.work);
+
+        return error;
+}
+
+/*
+ * Purpose:    Tell whether a table of an image lies within it.
+ * Parameters: A uint64_t offset of the table, a uint64_t number of
+ *             entries, a size_t size of each and the uint64_t size of the
+ *             image.
+ * Return:     1 if the table fits, or 0 otherwise.
+ */
+static int cyimage_fits(uint64_t at, uint64_t len, size_t size,
+                        uint64_t total) {
+        return at <= total && len <= (total - at) / size;
+}
+
+/*
+ * Purpose:    Map an image file into memory and bind the values it holds
+ *             in a scope. The values are used where they were mapped, and
+ *             live until the program exits.
+ * Parameters: A pointer to the cyenv to bind in and a c-string path of
+ *             the image file.
+ * Return:     NULL if the image was loaded, or a c-string describing why
+ *             it was not.
+ */
+const char* cyimage_load(cyenv* env, const char* path) {
+        int fd;
+        int id;
+        int* remap = NULL;
+        uint64_t i;
+        uint64_t* offs;
+        uintptr_t delta;
+        char* map;
+        char* name;
+        cyval** word;
+        cybinding* bindings;
+        struct stat info;
+        cyimagehead head;
+
+        if ((fd = open(path, O_RDONLY)) < 0)
+                return strerror(errno);
+        if (fstat(fd, &info) != 0 ||
+            read(fd, &head, sizeof(head)) != (ssize_t) sizeof(head) ||
+            memcmp(head.magic, CYIMAGE_MAGIC, sizeof(head.magic)) != 0 ||
+            head.version != CYIMAGE_VERSION ||
+            head.size_cyval != sizeof(cyval) ||
+            head.size_cyvec != sizeof(cyvec) ||
+            head.size != (uint64_t) info.st_size ||
+            !cyimage_fits(head.off_syms, 0, 1, head.size) ||
+            !cyimage_fits(head.off_bindings, head.len_bindings,
+                          sizeof(cybinding), head.size) ||
+            !cyimage_fits(head.off_relocs, head.len_relocs,
+                          sizeof(uint64_t), head.size) ||
+            !cyimage_fits(head.off_symrefs, head.len_symrefs,
+                          sizeof(uint64_t), head.size)) {
+                close(fd);
+                return "not an image made by this build of Choccy";
+        }
+        map = mmap((void*) (uintptr_t) head.base, head.size,
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+                return strerror(errno);
+
+        /* Move the pointers if the image was mapped somewhere else. */
+        if ((uintptr_t) map != head.base) {
+                delta = (uintptr_t) map - (uintptr_t) head.base;
+                offs = (uint64_t*) (map + head.off_relocs);
+                for (i = 0; i < head.len_relocs; i++)
+                        *(uintptr_t*) (map + offs[i]) += delta;
+        }
+
+        /* Renumber the symbols if any were interned with other ids. */
+        name = map + head.off_syms;
+        for (i = 0; i < head.len_syms; i++) {
+                id = cysym_intern(name);
+                if (id != (int) i && remap == NULL) {
+                        remap = malloc(sizeof(int) * head.len_syms);
+                        for (id = 0; id < (int) i; id++)
+                                remap[id] = id;
+                        id = cysym_intern(name);
+                }
+                if (remap != NULL)
+                        remap[i] = id;
+                name += strlen(name) + 1;
+        }
+        if (remap != NULL) {
+                offs = (uint64_t*) (map + head.off_symrefs);
+                for (i = 0; i < head.len_symrefs; i++) {
+                        word = (cyval**) (map + offs[i]);
+                        *word = CY_MAKE_SYM(remap[CY_SYM_OF(*word)]);
+                }
+        }
+
+        bindings = (cybinding*) (map + head.off_bindings);
+        for (i = 0; i < head.len_bindings; i++) {
+                id = bindings[i].sym - 1;
+                cyenv_adopt(env, remap != NULL ? remap[id] : id,
+                            bindings[i].value);
+        }
+        free(remap);
+
+        return NULL;
+}
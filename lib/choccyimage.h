@@ -0,0 +1,56 @@
+/*
+ * choccyimage.h
+ * Header file for choccyimage.c, declaring the heap images that save the
+ * global environment to a file which a later run maps back in and uses
+ * in place, without reading or evaluating any code.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYIMAGE_H
+#define CHOCCYIMAGE_H
+
+#include "choccyparsing.h"
+
+/* Version of the image layout, changed whenever the layout changes. */
+#define CYIMAGE_VERSION 1
+
+/*
+ * Address images are laid out for. An image mapped there is used without
+ * being touched; one mapped anywhere else has its pointers moved first.
+ */
+#if UINTPTR_MAX > 0xffffffffu
+#define CYIMAGE_BASE ((uintptr_t) 0x200000000000)
+#else
+#define CYIMAGE_BASE ((uintptr_t) 0x40000000)
+#endif
+
+/*
+ * Reference count given to the vectors in an image, so that sharing them
+ * never lets the count fall to zero and free them.
+ */
+#define CYIMAGE_PINNED (INT_MAX / 2)
+
+/*
+ * Purpose:    Save the bindings of the global scope, and every value they
+ *             hold, to an image file. Builtins still bound to their own
+ *             names are left out.
+ * Parameters: A pointer to a cyenv whose global scope is saved and a
+ *             c-string path of the file to write.
+ * Return:     NULL if the image was written, or a c-string describing why
+ *             it was not.
+ */
+const char* cyimage_save(cyenv* env, const char* path);
+
+/*
+ * Purpose:    Map an image file into memory and bind the values it holds
+ *             in a scope. The values are used where they were mapped, and
+ *             live until the program exits.
+ * Parameters: A pointer to the cyenv to bind in and a c-string path of
+ *             the image file.
+ * Return:     NULL if the image was loaded, or a c-string describing why
+ *             it was not.
+ */
+const char* cyimage_load(cyenv* env, const char* path);
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * choccymemo.c
+ * The memo table for Choccy, remembering the result of evaluating an
+ * expression so that evaluating it again with the same inputs is a table
+ * lookup.
+ *
+ * An expression's inputs are the values bound to the symbols it can reach:
+ * those in the expression, and those in the values bound to them, since a
+ * bound Q-expression may be evaluated in turn. Symbols are only made by
+ * reading source, so no other binding can affect the result. The key of a
+ * result is the expression followed by each reachable symbol and its
+ * value, compared by structure. Expressions reaching "def" or "=", which
+ * change the environment, or a builtin that writes or reads files are
+ * always evaluated.
+ *
+ * Keys and results are kept outside the arena, and the least recently used
+ * are forgotten once they take more than CYMEMO_MAX_BYTES. Each thread
+ * has its own table, as each evaluates in its own environments.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccymemo.h"
+#include "choccyenv.h"
+#include "choccyhash.h"
+
+/* Initial number of slots allocated for the hash table and work stack. */
+#define CYMEMO_MIN_SLOTS 16
+
+/* A remembered result, in a hash chain and in the list of entries. */
+typedef struct cymemo_entry {
+        uint64_t hash;
+        cyval* key;
+        cyval* result;
+        size_t bytes;
+        struct cymemo_entry* chain;
+        struct cymemo_entry* newer;
+        struct cymemo_entry* older;
+} cymemo_entry;
+
+/* The hash table of entries, chained by hash. */
+static _Thread_local cymemo_entry** cymemo_slots = NULL;
+static _Thread_local int cymemo_cap_slots = 0;
+static _Thread_local int cymemo_len_entries = 0;
+
+/* The entries from most to least recently used, and the bytes they hold. */
+static _Thread_local cymemo_entry* cymemo_newest = NULL;
+static _Thread_local cymemo_entry* cymemo_oldest = NULL;
+static _Thread_local size_t cymemo_total = 0;
+
+/* The stack of values to look for symbols in, kept between calls. */
+static _Thread_local cyval** cymemo_stack = NULL;
+static _Thread_local int cymemo_len_stack = 0;
+static _Thread_local int cymemo_cap_stack = 0;
+
+/* Which symbol ids have been found by the current call. */
+static _Thread_local unsigned char* cymemo_seen = NULL;
+static _Thread_local int cymemo_cap_seen = 0;
+
+/*
+ * Purpose:    Push a cyval onto the stack of values to look for symbols in.
+ * Parameters: A pointer to a cyval.
+ * Return:     Void
+ */
+static void cymemo_push(cyval* value) {
+        if (cymemo_len_stack == cymemo_cap_stack) {
+                cymemo_cap_stack = cymemo_cap_stack ?
+                                   cymemo_cap_stack * 2 : CYMEMO_MIN_SLOTS;
+                cymemo_stack = realloc(cymemo_stack, sizeof(cyval*) *
+                                                     cymemo_cap_stack);
+        }
+        cymemo_stack[cymemo_len_stack++] = value;
+}
+
+/*
+ * Purpose:    Mark a symbol as found.
+ * Parameters: An int interned symbol id.
+ * Return:     1 if the symbol had not been found yet, or 0 otherwise.
+ */
+static int cymemo_mark(int sym) {
+        int cap = cymemo_cap_seen;
+
+        if (sym >= cap) {
+                while (sym >= cap)
+                        cap = cap ? cap * 2 : CYMEMO_MIN_SLOTS;
+                cymemo_seen = realloc(cymemo_seen, cap);
+                memset(cymemo_seen + cymemo_cap_seen, 0,
+                       cap - cymemo_cap_seen);
+                cymemo_cap_seen = cap;
+        }
+        if (cymemo_seen[sym])
+                return 0;
+        cymemo_seen[sym] = 1;
+        return 1;
+}
+
+/*
+ * Purpose:    Tell whether a bound value is a builtin with effects beyond
+ *             its result, or whose result depends on more than its
+ *             arguments: "def" and "=", which change the environment, and
+ *             the builtins that write or read files.
+ * Parameters: A pointer to a cyval bound to a symbol.
+ * Return:     1 if the value is such a builtin, or 0 otherwise.
+ */
+static int cymemo_impure(cyval* bound) {
+        if (!CY_IS_FUN(bound))
+                return 0;
+        switch (CY_FUN_OF(bound)) {
+        case CYSYM_DEF: case CYSYM_PUT: case CYSYM_SAVE_IMAGE:
+        case CYSYM_SERIALIZE: case CYSYM_DESERIALIZE:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+/*
+ * Purpose:    Build the key an expression's result is remembered under:
+ *             the expression followed by a Q-expression for each symbol it
+ *             can reach, holding the symbol and its value, or only the
+ *             symbol if it is unbound.
+ * Parameters: A pointer to the cyenv to look symbols up in and a pointer
+ *             to a cyval expression, which is not consumed.
+ * Return:     A pointer to a cyval Q-expression key, or NULL if the
+ *             expression can reach an impure builtin.
+ */
+static cyval* cymemo_key(cyenv* env, cyval* body) {
+        int i;
+        int sym;
+        int pure = 1;
+        cyval* value;
+        cyval* bound;
+        cyval* pair;
+        cyval* key = cyval_add(cyval_q_exp(), cyval_copy(body));
+
+        cymemo_push(body);
+        while (cymemo_len_stack > 0) {
+                value = cymemo_stack[--cymemo_len_stack];
+                if (CY_TYPE(value) == CYVAL_S_EXP ||
+                    CY_TYPE(value) == CYVAL_Q_EXP) {
+                        for (i = value -> len_cyvals - 1; i >= 0; i--)
+                                cymemo_push(value -> cyvals[i]);
+                        continue;
+                }
+                if (!CY_IS_SYM(value) || !cymemo_mark(CY_SYM_OF(value)))
+                        continue;
+                sym = CY_SYM_OF(value);
+                bound = cyenv_lookup(env, sym);
+                if (bound != NULL && cymemo_impure(bound))
+                        pure = 0;
+                pair = cyval_add(cyval_q_exp(), value);
+                if (bound != NULL) {
+                        cyval_add(pair, cyval_copy(bound));
+                        cymemo_push(bound);
+                }
+                cyval_add(key, pair);
+        }
+
+        /* Clear the marks for the next call. */
+        for (i = 1; i < key -> len_cyvals; i++)
+                cymemo_seen[CY_SYM_OF(key -> cyvals[i] -> cyvals[0])] = 0;
+        if (!pure) {
+                cyval_destructor(key);
+                return NULL;
+        }
+        return key;
+}
+
+/*
+ * Purpose:    Unlink an entry from the list of entries.
+ * Parameters: A pointer to a cymemo_entry.
+ * Return:     Void
+ */
+static void cymemo_unlink(cymemo_entry* entry) {
+        if (entry -> newer != NULL)
+                entry -> newer -> older = entry -> older;
+        else
+                cymemo_newest = entry -> older;
+        if (entry -> older != NULL)
+                entry -> older -> newer = entry -> newer;
+        else
+                cymemo_oldest = entry -> newer;
+}
+
+/*
+ * Purpose:    Link an entry into the list of entries as the newest.
+ * Parameters: A pointer to a cymemo_entry.
+ * Return:     Void
+ */
+static void cymemo_link(cymemo_entry* entry) {
+        entry -> newer = NULL;
+        entry -> older = cymemo_newest;
+        if (cymemo_newest != NULL)
+                cymemo_newest -> newer = entry;
+        else
+                cymemo_oldest = entry;
+        cymemo_newest = entry;
+}
+
+/*
+ * Purpose:    Forget the least recently used entry.
+ * Parameters: Void
+ * Return:     Void
+ */
+static void cymemo_evict(void) {
+        cymemo_entry* entry = cymemo_oldest;
+        cymemo_entry** link;
+
+        link = &cymemo_slots[entry -> hash & (cymemo_cap_slots - 1)];
+        while (*link != entry)
+                link = &(*link) -> chain;
+        *link = entry -> chain;
+        cymemo_unlink(entry);
+
+        cymemo_total -= entry -> bytes;
+        cymemo_len_entries--;
+        cyval_destructor(entry -> key);
+        cyval_destructor(entry -> result);
+        free(entry);
+}
+
+/*
+ * Purpose:    Rebuild the hash table with double the slots.
+ * Parameters: Void
+ * Return:     Void
+ */
+static void cymemo_grow(void) {
+        int i;
+        int cap = cymemo_cap_slots;
+        cymemo_entry** old = cymemo_slots;
+        cymemo_entry* entry;
+        cymemo_entry* next;
+
+        cymemo_cap_slots = cap ? cap * 2 : CYMEMO_MIN_SLOTS;
+        cymemo_slots = calloc(cymemo_cap_slots, sizeof(cymemo_entry*));
+        for (i = 0; i < cap; i++)
+                for (entry = old[i]; entry != NULL; entry = next) {
+                        next = entry -> chain;
+                        entry -> chain = cymemo_slots[entry -> hash &
+                                                      (cymemo_cap_slots - 1)];
+                        cymemo_slots[entry -> hash &
+                                     (cymemo_cap_slots - 1)] = entry;
+                }
+        free(old);
+}
+
+/*
+ * Purpose:    Remember a result under a key, forgetting the least recently
+ *             used results to make room.
+ * Parameters: A pointer to a cyval key, which is consumed, its 64-bit hash
+ *             and a pointer to a cyval result, which is not consumed.
+ * Return:     Void
+ */
+static void cymemo_store(cyval* key, uint64_t hash, cyval* result) {
+        cymemo_entry* entry = malloc(sizeof(*entry));
+        cymemo_entry** slot;
+
+        entry -> hash = hash;
+        entry -> key = cyval_persist(key);
+        entry -> result = cyval_persist(result);
+        entry -> bytes = sizeof(*entry) + cyval_bytes(entry -> key) +
+                         cyval_bytes(entry -> result);
+        cyval_destructor(key);
+
+        if (entry -> bytes > CYMEMO_MAX_BYTES) {
+                cyval_destructor(entry -> key);
+                cyval_destructor(entry -> result);
+                free(entry);
+                return;
+        }
+        while (cymemo_total + entry -> bytes > CYMEMO_MAX_BYTES)
+                cymemo_evict();
+        if (cymemo_len_entries >= cymemo_cap_slots)
+                cymemo_grow();
+
+        slot = &cymemo_slots[hash & (cymemo_cap_slots - 1)];
+        entry -> chain = *slot;
+        *slot = entry;
+        cymemo_link(entry);
+        cymemo_total += entry -> bytes;
+        cymemo_len_entries++;
+}
+
+/*
+ * Purpose:    Evaluate the expression in a Q-expression, or return the
+ *             result remembered from evaluating it before with the same
+ *             bindings for every symbol it can reach.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression, which is consumed.
+ * Return:     A pointer to a cyval with the result.
+ */
+cyval* cymemo_eval(cyenv* env, cyval* value) {
+        uint64_t hash;
+        cyval* key;
+        cyval* result;
+        cymemo_entry* entry = NULL;
+
+        value -> data_type = CYVAL_S_EXP;
+        key = cymemo_key(env, value);
+        if (key == NULL)
+                return cyval_evaluate(env, value);
+
+        hash = cyval_hash(key);
+        if (cymemo_cap_slots > 0)
+                entry = cymemo_slots[hash & (cymemo_cap_slots - 1)];
+        for (; entry != NULL; entry = entry -> chain)
+                if (entry -> hash == hash && cyval_equal(entry -> key, key))
+                        break;
+        if (entry != NULL) {
+                /* Move the entry to the front of the list and share it. */
+                cymemo_unlink(entry);
+                cymemo_link(entry);
+                cyval_destructor(key);
+                cyval_destructor(value);
+                return cyval_copy(entry -> result);
+        }
+
+        result = cyval_evaluate(env, value);
+        cymemo_store(key, hash, result);
+
+        return result;
+}
+
+/*
+ * Purpose:    Forget every remembered result, freeing the memo table.
+ * Parameters: Void
+ * Return:     Void
+ */
+void cymemo_clear(void) {
+        while (cymemo_oldest != NULL)
+                cymemo_evict();
+        free(cymemo_slots);
+        cymemo_slots = NULL;
+        cymemo_cap_slots = 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * choccymemo.h
+ * Header file for choccymemo.c, declaring the memo table that remembers
+ * the results of evaluating expressions.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYMEMO_H
+#define CHOCCYMEMO_H
+
+#include "choccyparsing.h"
+
+/* Most bytes of keys and results the memo table holds at once. */
+#define CYMEMO_MAX_BYTES ((size_t) 64 << 20)
+
+/*
+ * Purpose:    Evaluate the expression in a Q-expression, or return the
+ *             result remembered from evaluating it before with the same
+ *             bindings for every symbol it can reach.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression, which is consumed.
+ * Return:     A pointer to a cyval with the result.
+ */
+cyval* cymemo_eval(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    Forget every remembered result, freeing the memo table.
+ * Parameters: Void
+ * Return:     Void
+ */
+void cymemo_clear(void);
+
+#endif
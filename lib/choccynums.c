@@ -0,0 +1,540 @@
+/*
+ * choccynums.c
+ * Packed numeric vectors for Choccy, and the kernels that do arithmetic
+ * over them. Each kernel comes in a scalar version and, on x86-64, SSE4.2
+ * and AVX2 versions compiled with per-function target attributes, so the
+ * build needs no special flags; the fastest version the CPU supports is
+ * picked the first time a kernel runs.
+ *
+ * Numbers stay 64-bit longs, so the vector kernels check for overflow as
+ * they go: a signed sum overflowed exactly when its sign differs from the
+ * signs of both operands. Multiplication and division have no packed
+ * 64-bit instructions below AVX-512, so those kernels are scalar loops on
+ * every CPU.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include "choccynums.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CYNUMS_X86 1
+#include <immintrin.h>
+#endif
+
+/* A set of kernels for one instruction set. */
+typedef struct cykernels {
+        const char* isa;
+        int (*add)(long* out, const long* a, const long* b, int step, int n);
+        int (*sub)(long* out, const long* a, const long* b, int step, int n);
+        int (*sum)(const long* a, int n, long* out);
+        long (*min)(const long* a, int n);
+        long (*max)(const long* a, int n);
+} cykernels;
+
+/*
+ * Purpose:    Allocate a numeric vector of the given length.
+ * Parameters: An int length.
+ * Return:     A pointer to a cynums with uninitialized items and one
+ *             reference.
+ */
+cynums* cynums_new(int len) {
+        cynums* nums = malloc(sizeof(cynums) + sizeof(long) * len);
+
+        nums -> refs = 1;
+        nums -> len = len;
+
+        return nums;
+}
+
+/*
+ * Purpose:    Allocate a numeric vector with every item set to one number.
+ * Parameters: An int length and a long number.
+ * Return:     A pointer to a cynums with one reference.
+ */
+cynums* cynums_fill(int len, long num) {
+        int i;
+        cynums* nums = cynums_new(len);
+
+        for (i = 0; i < len; i++)
+                nums -> items[i] = num;
+        return nums;
+}
+
+/*
+ * Purpose:    Add a reference to a numeric vector.
+ * Parameters: A pointer to a cynums.
+ * Return:     The same pointer.
+ */
+cynums* cynums_retain(cynums* nums) {
+        __atomic_add_fetch(&nums -> refs, 1, __ATOMIC_RELAXED);
+        return nums;
+}
+
+/*
+ * Purpose:    Tell whether a numeric vector has a single reference, so its
+ *             holder may modify it.
+ * Parameters: A pointer to a cynums.
+ * Return:     1 if the vector is unshared, or 0 otherwise.
+ */
+int cynums_unshared(cynums* nums) {
+        return __atomic_load_n(&nums -> refs, __ATOMIC_ACQUIRE) == 1;
+}
+
+/*
+ * Purpose:    Release a reference to a numeric vector, freeing it once no
+ *             cyval refers to it.
+ * Parameters: A pointer to a cynums, which may be NULL.
+ * Return:     Void
+ */
+void cynums_release(cynums* nums) {
+        if (nums != NULL &&
+            __atomic_sub_fetch(&nums -> refs, 1, __ATOMIC_ACQ_REL) == 0)
+                free(nums);
+}
+
+/*
+ * Purpose:    Scalar kernels, used on any CPU and to finish the elements
+ *             left over after the vector kernels' last full register.
+ * Parameters: As for the matching public kernels in choccynums.h.
+ * Return:     As for the matching public kernels in choccynums.h.
+ */
+static int cynums_add_scalar(long* out, const long* a, const long* b,
+                             int step, int n) {
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (__builtin_add_overflow(a[i], b[i * step], &out[i]))
+                        return CYNUMS_OVERFLOW;
+        return CYNUMS_OK;
+}
+
+static int cynums_sub_scalar(long* out, const long* a, const long* b,
+                             int step, int n) {
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (__builtin_sub_overflow(a[i], b[i * step], &out[i]))
+                        return CYNUMS_OVERFLOW;
+        return CYNUMS_OK;
+}
+
+static int cynums_sum_scalar(const long* a, int n, long* out) {
+        int i;
+        long total = 0;
+
+        for (i = 0; i < n; i++)
+                if (__builtin_add_overflow(total, a[i], &total))
+                        return 0;
+        *out = total;
+        return 1;
+}
+
+static long cynums_min_scalar(const long* a, int n) {
+        int i;
+        long least = a[0];
+
+        for (i = 1; i < n; i++)
+                if (a[i] < least)
+                        least = a[i];
+        return least;
+}
+
+static long cynums_max_scalar(const long* a, int n) {
+        int i;
+        long most = a[0];
+
+        for (i = 1; i < n; i++)
+                if (a[i] > most)
+                        most = a[i];
+        return most;
+}
+
+static const cykernels cynums_scalar = {
+        "scalar", cynums_add_scalar, cynums_sub_scalar, cynums_sum_scalar,
+        cynums_min_scalar, cynums_max_scalar
+};
+
+#ifdef CYNUMS_X86
+
+/*
+ * Purpose:    Finish a reduction over the lanes of a register, combining
+ *             the lane results stored in an array with the leftover
+ *             elements.
+ * Parameters: A pointer to the lane results, an int number of lanes, a
+ *             pointer to the leftover items, an int number of leftovers and
+ *             a pointer to a long to store the total in.
+ * Return:     1 if the total was stored, or 0 if it overflowed a long.
+ */
+static int cynums_sum_lanes(const long* lanes, int n_lanes, const long* a,
+                            int n, long* out) {
+        int i;
+        long total;
+
+        if (!cynums_sum_scalar(a, n, &total))
+                return 0;
+        for (i = 0; i < n_lanes; i++)
+                if (__builtin_add_overflow(total, lanes[i], &total))
+                        return 0;
+        *out = total;
+        return 1;
+}
+
+/*
+ * Purpose:    SSE4.2 kernels, working on two numbers at a time.
+ * Parameters: As for the matching public kernels in choccynums.h.
+ * Return:     As for the matching public kernels in choccynums.h.
+ */
+__attribute__((target("sse4.2")))
+static int cynums_add_sse42(long* out, const long* a, const long* b,
+                            int step, int n) {
+        int i = 0;
+        __m128i x;
+        __m128i y;
+        __m128i r;
+        __m128i over = _mm_setzero_si128();
+        __m128i one = _mm_set1_epi64x(n > 0 ? b[0] : 0);
+
+        for (; i + 2 <= n; i += 2) {
+                x = _mm_loadu_si128((const __m128i*) (a + i));
+                y = step ? _mm_loadu_si128((const __m128i*) (b + i)) : one;
+                r = _mm_add_epi64(x, y);
+                over = _mm_or_si128(over, _mm_and_si128(
+                        _mm_xor_si128(x, r), _mm_xor_si128(y, r)));
+                _mm_storeu_si128((__m128i*) (out + i), r);
+        }
+        if (_mm_movemask_pd(_mm_castsi128_pd(over)))
+                return CYNUMS_OVERFLOW;
+        return cynums_add_scalar(out + i, a + i, b + i * step, step, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static int cynums_sub_sse42(long* out, const long* a, const long* b,
+                            int step, int n) {
+        int i = 0;
+        __m128i x;
+        __m128i y;
+        __m128i r;
+        __m128i over = _mm_setzero_si128();
+        __m128i one = _mm_set1_epi64x(n > 0 ? b[0] : 0);
+
+        for (; i + 2 <= n; i += 2) {
+                x = _mm_loadu_si128((const __m128i*) (a + i));
+                y = step ? _mm_loadu_si128((const __m128i*) (b + i)) : one;
+                r = _mm_sub_epi64(x, y);
+                over = _mm_or_si128(over, _mm_and_si128(
+                        _mm_xor_si128(x, y), _mm_xor_si128(x, r)));
+                _mm_storeu_si128((__m128i*) (out + i), r);
+        }
+        if (_mm_movemask_pd(_mm_castsi128_pd(over)))
+                return CYNUMS_OVERFLOW;
+        return cynums_sub_scalar(out + i, a + i, b + i * step, step, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static int cynums_sum_sse42(const long* a, int n, long* out) {
+        int i = 0;
+        long lanes[2];
+        __m128i x;
+        __m128i r;
+        __m128i total = _mm_setzero_si128();
+        __m128i over = _mm_setzero_si128();
+
+        for (; i + 2 <= n; i += 2) {
+                x = _mm_loadu_si128((const __m128i*) (a + i));
+                r = _mm_add_epi64(total, x);
+                over = _mm_or_si128(over, _mm_and_si128(
+                        _mm_xor_si128(total, r), _mm_xor_si128(x, r)));
+                total = r;
+        }
+        if (_mm_movemask_pd(_mm_castsi128_pd(over)))
+                return 0;
+        _mm_storeu_si128((__m128i*) lanes, total);
+        return cynums_sum_lanes(lanes, 2, a + i, n - i, out);
+}
+
+__attribute__((target("sse4.2")))
+static long cynums_min_sse42(const long* a, int n) {
+        int i = 2;
+        long lanes[2];
+        __m128i x;
+        __m128i least;
+
+        if (n < 2)
+                return a[0];
+        least = _mm_loadu_si128((const __m128i*) a);
+        for (; i + 2 <= n; i += 2) {
+                x = _mm_loadu_si128((const __m128i*) (a + i));
+                least = _mm_blendv_epi8(least, x, _mm_cmpgt_epi64(least, x));
+        }
+        _mm_storeu_si128((__m128i*) lanes, least);
+        for (; i < n; i++)
+                if (a[i] < lanes[0])
+                        lanes[0] = a[i];
+        return lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+}
+
+__attribute__((target("sse4.2")))
+static long cynums_max_sse42(const long* a, int n) {
+        int i = 2;
+        long lanes[2];
+        __m128i x;
+        __m128i most;
+
+        if (n < 2)
+                return a[0];
+        most = _mm_loadu_si128((const __m128i*) a);
+        for (; i + 2 <= n; i += 2) {
+                x = _mm_loadu_si128((const __m128i*) (a + i));
+                most = _mm_blendv_epi8(most, x, _mm_cmpgt_epi64(x, most));
+        }
+        _mm_storeu_si128((__m128i*) lanes, most);
+        for (; i < n; i++)
+                if (a[i] > lanes[0])
+                        lanes[0] = a[i];
+        return lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+}
+
+static const cykernels cynums_sse42 = {
+        "sse4.2", cynums_add_sse42, cynums_sub_sse42, cynums_sum_sse42,
+        cynums_min_sse42, cynums_max_sse42
+};
+
+/*
+ * Purpose:    AVX2 kernels, working on four numbers at a time.
+ * Parameters: As for the matching public kernels in choccynums.h.
+ * Return:     As for the matching public kernels in choccynums.h.
+ */
+__attribute__((target("avx2")))
+static int cynums_add_avx2(long* out, const long* a, const long* b,
+                           int step, int n) {
+        int i = 0;
+        __m256i x;
+        __m256i y;
+        __m256i r;
+        __m256i over = _mm256_setzero_si256();
+        __m256i one = _mm256_set1_epi64x(n > 0 ? b[0] : 0);
+
+        for (; i + 4 <= n; i += 4) {
+                x = _mm256_loadu_si256((const __m256i*) (a + i));
+                y = step ? _mm256_loadu_si256((const __m256i*) (b + i)) : one;
+                r = _mm256_add_epi64(x, y);
+                over = _mm256_or_si256(over, _mm256_and_si256(
+                        _mm256_xor_si256(x, r), _mm256_xor_si256(y, r)));
+                _mm256_storeu_si256((__m256i*) (out + i), r);
+        }
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(over)))
+                return CYNUMS_OVERFLOW;
+        return cynums_add_scalar(out + i, a + i, b + i * step, step, n - i);
+}
+
+__attribute__((target("avx2")))
+static int cynums_sub_avx2(long* out, const long* a, const long* b,
+                           int step, int n) {
+        int i = 0;
+        __m256i x;
+        __m256i y;
+        __m256i r;
+        __m256i over = _mm256_setzero_si256();
+        __m256i one = _mm256_set1_epi64x(n > 0 ? b[0] : 0);
+
+        for (; i + 4 <= n; i += 4) {
+                x = _mm256_loadu_si256((const __m256i*) (a + i));
+                y = step ? _mm256_loadu_si256((const __m256i*) (b + i)) : one;
+                r = _mm256_sub_epi64(x, y);
+                over = _mm256_or_si256(over, _mm256_and_si256(
+                        _mm256_xor_si256(x, y), _mm256_xor_si256(x, r)));
+                _mm256_storeu_si256((__m256i*) (out + i), r);
+        }
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(over)))
+                return CYNUMS_OVERFLOW;
+        return cynums_sub_scalar(out + i, a + i, b + i * step, step, n - i);
+}
+
+__attribute__((target("avx2")))
+static int cynums_sum_avx2(const long* a, int n, long* out) {
+        int i = 0;
+        long lanes[4];
+        __m256i x;
+        __m256i r;
+        __m256i total = _mm256_setzero_si256();
+        __m256i over = _mm256_setzero_si256();
+
+        for (; i + 4 <= n; i += 4) {
+                x = _mm256_loadu_si256((const __m256i*) (a + i));
+                r = _mm256_add_epi64(total, x);
+                over = _mm256_or_si256(over, _mm256_and_si256(
+                        _mm256_xor_si256(total, r), _mm256_xor_si256(x, r)));
+                total = r;
+        }
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(over)))
+                return 0;
+        _mm256_storeu_si256((__m256i*) lanes, total);
+        return cynums_sum_lanes(lanes, 4, a + i, n - i, out);
+}
+
+__attribute__((target("avx2")))
+static long cynums_min_avx2(const long* a, int n) {
+        int i = 4;
+        long lanes[4];
+        __m256i x;
+        __m256i least;
+
+        if (n < 4)
+                return cynums_min_scalar(a, n);
+        least = _mm256_loadu_si256((const __m256i*) a);
+        for (; i + 4 <= n; i += 4) {
+                x = _mm256_loadu_si256((const __m256i*) (a + i));
+                least = _mm256_blendv_epi8(least, x,
+                                           _mm256_cmpgt_epi64(least, x));
+        }
+        _mm256_storeu_si256((__m256i*) lanes, least);
+        for (; i < n; i++)
+                if (a[i] < lanes[0])
+                        lanes[0] = a[i];
+        return cynums_min_scalar(lanes, 4);
+}
+
+__attribute__((target("avx2")))
+static long cynums_max_avx2(const long* a, int n) {
+        int i = 4;
+        long lanes[4];
+        __m256i x;
+        __m256i most;
+
+        if (n < 4)
+                return cynums_max_scalar(a, n);
+        most = _mm256_loadu_si256((const __m256i*) a);
+        for (; i + 4 <= n; i += 4) {
+                x = _mm256_loadu_si256((const __m256i*) (a + i));
+                most = _mm256_blendv_epi8(most, x,
+                                          _mm256_cmpgt_epi64(x, most));
+        }
+        _mm256_storeu_si256((__m256i*) lanes, most);
+        for (; i < n; i++)
+                if (a[i] > lanes[0])
+                        lanes[0] = a[i];
+        return cynums_max_scalar(lanes, 4);
+}
+
+static const cykernels cynums_avx2 = {
+        "avx2", cynums_add_avx2, cynums_sub_avx2, cynums_sum_avx2,
+        cynums_min_avx2, cynums_max_avx2
+};
+
+#endif
+
+/* The kernels picked for this CPU, or NULL until the first call. */
+static const cykernels* cynums_kernels = NULL;
+
+/*
+ * Purpose:    Pick the fastest kernels this CPU supports, once.
+ * Parameters: Void
+ * Return:     A pointer to the picked cykernels.
+ */
+static const cykernels* cynums_select(void) {
+        if (cynums_kernels != NULL)
+                return cynums_kernels;
+        cynums_kernels = &cynums_scalar;
+#ifdef CYNUMS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+                cynums_kernels = &cynums_avx2;
+        else if (__builtin_cpu_supports("sse4.2"))
+                cynums_kernels = &cynums_sse42;
+#endif
+        return cynums_kernels;
+}
+
+/*
+ * Purpose:    Name the set of kernels picked for this CPU.
+ * Parameters: Void
+ * Return:     A static c-string such as "avx2", "sse4.2" or "scalar".
+ */
+const char* cynums_isa(void) {
+        return cynums_select() -> isa;
+}
+
+/*
+ * Purpose:    Add, subtract, multiply or divide numbers element-wise,
+ *             storing each result in out[i]. The right operand is either a
+ *             vector or one number used for every element.
+ * Parameters: A pointer to the output items, which may be the left items,
+ *             a pointer to the left items, a pointer to the right items,
+ *             an int that is 1 if the right operand is a vector and 0 if it
+ *             is a single number, and an int number of elements.
+ * Return:     CYNUMS_OK, CYNUMS_OVERFLOW if any result does not fit in a
+ *             long, or CYNUMS_DIV_ZERO if any divisor is zero. The output is
+ *             unspecified unless CYNUMS_OK is returned.
+ */
+int cynums_add(long* out, const long* a, const long* b, int step, int n) {
+        return cynums_select() -> add(out, a, b, step, n);
+}
+
+int cynums_sub(long* out, const long* a, const long* b, int step, int n) {
+        return cynums_select() -> sub(out, a, b, step, n);
+}
+
+int cynums_mul(long* out, const long* a, const long* b, int step, int n) {
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (__builtin_mul_overflow(a[i], b[i * step], &out[i]))
+                        return CYNUMS_OVERFLOW;
+        return CYNUMS_OK;
+}
+
+int cynums_div(long* out, const long* a, const long* b, int step, int n) {
+        int i;
+        long d;
+
+        for (i = 0; i < n; i++) {
+                d = b[i * step];
+                if (d == 0)
+                        return CYNUMS_DIV_ZERO;
+                if (a[i] == LONG_MIN && d == -1)
+                        return CYNUMS_OVERFLOW;
+                out[i] = a[i] / d;
+        }
+        return CYNUMS_OK;
+}
+
+/*
+ * Purpose:    Sum numbers, or sum the element-wise products of two vectors.
+ * Parameters: Pointers to the items, an int number of elements and a
+ *             pointer to a long to store the result in.
+ * Return:     1 if the result was stored, or 0 if the running total
+ *             overflowed a long.
+ */
+int cynums_sum(const long* a, int n, long* out) {
+        return cynums_select() -> sum(a, n, out);
+}
+
+int cynums_dot(const long* a, const long* b, int n, long* out) {
+        int i;
+        long total = 0;
+        long product;
+
+        for (i = 0; i < n; i++)
+                if (__builtin_mul_overflow(a[i], b[i], &product) ||
+                    __builtin_add_overflow(total, product, &total))
+                        return 0;
+        *out = total;
+        return 1;
+}
+
+/*
+ * Purpose:    Find the smallest or largest of a nonempty run of numbers.
+ * Parameters: A pointer to the items and an int number of elements, which
+ *             must be at least 1.
+ * Return:     The smallest or largest number.
+ */
+long cynums_min(const long* a, int n) {
+        return cynums_select() -> min(a, n);
+}
+
+long cynums_max(const long* a, int n) {
+        return cynums_select() -> max(a, n);
+}
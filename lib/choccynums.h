@@ -0,0 +1,109 @@
+/*
+ * choccynums.h
+ * Header file for choccynums.c, declaring the packed numeric vectors that
+ * hold many numbers in one contiguous array, and the arithmetic kernels
+ * that run over them.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYNUMS_H
+#define CHOCCYNUMS_H
+
+/*
+ * Choccy numeric vector (cynums) struct, a reference-counted array of len
+ * numbers stored inline. A vector is never modified while more than one
+ * cyval refers to it, so copying a vector value only shares it. Its count
+ * is changed atomically, as threads evaluating in parallel may share it.
+ */
+typedef struct cynums {
+        int refs;
+        int len;
+        long items[];
+} cynums;
+
+/* Enumeration of the results of an element-wise kernel. */
+enum { CYNUMS_OK, CYNUMS_OVERFLOW, CYNUMS_DIV_ZERO };
+
+/*
+ * Purpose:    Allocate a numeric vector of the given length.
+ * Parameters: An int length.
+ * Return:     A pointer to a cynums with uninitialized items and one
+ *             reference.
+ */
+cynums* cynums_new(int len);
+
+/*
+ * Purpose:    Allocate a numeric vector with every item set to one number.
+ * Parameters: An int length and a long number.
+ * Return:     A pointer to a cynums with one reference.
+ */
+cynums* cynums_fill(int len, long num);
+
+/*
+ * Purpose:    Add a reference to a numeric vector.
+ * Parameters: A pointer to a cynums.
+ * Return:     The same pointer.
+ */
+cynums* cynums_retain(cynums* nums);
+
+/*
+ * Purpose:    Tell whether a numeric vector has a single reference, so its
+ *             holder may modify it.
+ * Parameters: A pointer to a cynums.
+ * Return:     1 if the vector is unshared, or 0 otherwise.
+ */
+int cynums_unshared(cynums* nums);
+
+/*
+ * Purpose:    Release a reference to a numeric vector, freeing it once no
+ *             cyval refers to it.
+ * Parameters: A pointer to a cynums, which may be NULL.
+ * Return:     Void
+ */
+void cynums_release(cynums* nums);
+
+/*
+ * Purpose:    Name the set of kernels picked for this CPU.
+ * Parameters: Void
+ * Return:     A static c-string such as "avx2", "sse4.2" or "scalar".
+ */
+const char* cynums_isa(void);
+
+/*
+ * Purpose:    Add, subtract, multiply or divide numbers element-wise,
+ *             storing each result in out[i]. The right operand is either a
+ *             vector or one number used for every element.
+ * Parameters: A pointer to the output items, which may be the left items,
+ *             a pointer to the left items, a pointer to the right items,
+ *             an int that is 1 if the right operand is a vector and 0 if it
+ *             is a single number, and an int number of elements.
+ * Return:     CYNUMS_OK, CYNUMS_OVERFLOW if any result does not fit in a
+ *             long, or CYNUMS_DIV_ZERO if any divisor is zero. The output is
+ *             unspecified unless CYNUMS_OK is returned.
+ */
+int cynums_add(long* out, const long* a, const long* b, int step, int n);
+int cynums_sub(long* out, const long* a, const long* b, int step, int n);
+int cynums_mul(long* out, const long* a, const long* b, int step, int n);
+int cynums_div(long* out, const long* a, const long* b, int step, int n);
+
+/*
+ * Purpose:    Sum numbers, or sum the element-wise products of two vectors.
+ * Parameters: Pointers to the items, an int number of elements and a
+ *             pointer to a long to store the result in.
+ * Return:     1 if the result was stored, or 0 if the running total
+ *             overflowed a long.
+ */
+int cynums_sum(const long* a, int n, long* out);
+int cynums_dot(const long* a, const long* b, int n, long* out);
+
+/*
+ * Purpose:    Find the smallest or largest of a nonempty run of numbers.
+ * Parameters: A pointer to the items and an int number of elements, which
+ *             must be at least 1.
+ * Return:     The smallest or largest number.
+ */
+long cynums_min(const long* a, int n);
+long cynums_max(const long* a, int n);
+
+#endif
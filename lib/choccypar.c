@@ -0,0 +1,522 @@
+/*
+ * choccypar.c
+ * Parallel evaluation for Choccy. Once the thread pool is started, each
+ * expression about to be compiled is first walked for calls to pure
+ * builtins holding at least CYPAR_MIN_NODES nodes, whose symbols are all
+ * bound to numbers, numeric vectors or builtins. Each such call becomes a
+ * task, which waits on the tasks made for the large calls among its
+ * arguments. A finished task's result replaces its call in the parent
+ * call, and the parent is queued once its last such argument is done.
+ *
+ * Tasks run on a work-stealing pool: each thread takes ready tasks from
+ * the back of its own deque and, when that is empty, steals from the front
+ * of another thread's. The evaluating thread runs tasks too until every
+ * one is done, then compiles what is left of the expression as usual.
+ *
+ * While tasks run the environment is only read, and every expression
+ * under a task is made that task's own before any task starts, so threads
+ * share nothing but numeric vectors, whose counts are atomic. Each thread
+ * has its own allocator and evaluation stacks.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include "choccypar.h"
+#include "choccyenv.h"
+#include "choccyfold.h"
+
+/* Initial number of slots allocated for the deques and the walk. */
+#define CYPAR_MIN_SLOTS 16
+
+/*
+ * A call evaluated as a task, or a function called on one index of a list
+ * of jobs (see cypar_each), and the task waiting on its result.
+ */
+typedef struct cytask {
+        cyenv* env;
+        cyval* value;
+        cyval** slot;
+        void (*job)(void* data, int index);
+        void* data;
+        int index;
+        struct cytask* parent;
+        int pending;
+} cytask;
+
+/* A thread's deque of ready tasks, taken from hi by its own thread. */
+typedef struct cydeque {
+        pthread_mutex_t lock;
+        cytask** tasks;
+        int lo;
+        int hi;
+        int cap;
+} cydeque;
+
+/*
+ * An expression being walked, the index of its next child, its number of
+ * nodes so far and whether another thread may evaluate it. Tasks made
+ * under the expression start at index base of the orphan stack.
+ */
+typedef struct cyparwork {
+        cyval* value;
+        int next;
+        int nodes;
+        int safe;
+        int base;
+} cyparwork;
+
+/* Number of threads in the pool, and each thread's deque. */
+static int cypar_threads = 1;
+static cydeque cypar_deques[CYPAR_MAX_THREADS];
+
+/* Index of the running thread in the pool; the main thread is 0. */
+static _Thread_local int cypar_self = 0;
+
+/* Number of tasks queued, and the idle threads waiting for more. */
+static int cypar_queued = 0;
+static pthread_mutex_t cypar_idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cypar_idle = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Number of unfinished tasks whose results replace calls outside any
+ * task, and whether tasks are running.
+ */
+static int cypar_roots = 0;
+static int cypar_running = 0;
+
+/*
+ * The walk's work stack, the tasks it has made whose parent is not yet
+ * known, and every task it has made. Only the main thread walks.
+ */
+static cyparwork* cypar_work = NULL;
+static int cypar_len_work = 0;
+static int cypar_cap_work = 0;
+static cytask** cypar_orphans = NULL;
+static int cypar_len_orphans = 0;
+static int cypar_cap_orphans = 0;
+static cytask** cypar_made = NULL;
+static int cypar_len_made = 0;
+static int cypar_cap_made = 0;
+
+/*
+ * Purpose:    Append a task to a growable array of tasks.
+ * Parameters: Pointers to the array, its length and its capacity, and a
+ *             pointer to the cytask to append.
+ * Return:     Void
+ */
+static void cypar_append(cytask*** tasks, int* len, int* cap,
+                         cytask* task) {
+        if (*len == *cap) {
+                *cap = *cap ? *cap * 2 : CYPAR_MIN_SLOTS;
+                *tasks = realloc(*tasks, sizeof(cytask*) * *cap);
+        }
+        (*tasks)[(*len)++] = task;
+}
+
+/*
+ * Purpose:    Push an expression onto the walk's work stack, first making
+ *             its children its own so no other expression shares them.
+ * Parameters: A pointer to a non-empty cyval S-expression.
+ * Return:     Void
+ */
+static void cypar_schedule(cyval* value) {
+        if (cypar_len_work == cypar_cap_work) {
+                cypar_cap_work = cypar_cap_work ?
+                                 cypar_cap_work * 2 : CYPAR_MIN_SLOTS;
+                cypar_work = realloc(cypar_work, sizeof(cyparwork) *
+                                                 cypar_cap_work);
+        }
+        cyval_own(value);
+        cypar_work[cypar_len_work].value = value;
+        cypar_work[cypar_len_work].next = 0;
+        cypar_work[cypar_len_work].nodes = 1;
+        cypar_work[cypar_len_work].safe = 1;
+        cypar_work[cypar_len_work].base = cypar_len_orphans;
+        cypar_len_work++;
+}
+
+/*
+ * Purpose:    Tell whether another thread may evaluate an argument that is
+ *             not a call. Anything holding a vector, such as a non-empty
+ *             Q-expression or a symbol bound to one, may share it with
+ *             other threads, and an unbound symbol is an error anyway.
+ * Parameters: A pointer to the cyenv to look symbols up in and a pointer
+ *             to a cyval.
+ * Return:     1 if the argument is safe, or 0 otherwise.
+ */
+static int cypar_leaf_safe(cyenv* env, cyval* value) {
+        int type = CY_TYPE(value);
+
+        if (type == CYVAL_S_EXP || type == CYVAL_Q_EXP)
+                return value -> len_cyvals == 0;
+        if (!CY_IS_SYM(value))
+                return 1;
+        value = cyenv_lookup(env, CY_SYM_OF(value));
+        if (value == NULL)
+                return 0;
+        type = CY_TYPE(value);
+        return type == CYVAL_NUM || type == CYVAL_BIG ||
+               type == CYVAL_NUMS || type == CYVAL_FUN;
+}
+
+/*
+ * Purpose:    Tell whether an S-expression calls a pure builtin, named by a
+ *             symbol or given directly.
+ * Parameters: A pointer to the cyenv to look functions up in and a pointer
+ *             to a cyval S-expression with at least two children.
+ * Return:     1 if the call is to a pure builtin, or 0 otherwise.
+ */
+static int cypar_is_pure(cyenv* env, cyval* value) {
+        cyval* fun = NULL;
+
+        if (CY_IS_FUN(value -> cyvals[0]))
+                fun = value -> cyvals[0];
+        else if (CY_IS_SYM(value -> cyvals[0]))
+                fun = cyenv_lookup(env, CY_SYM_OF(value -> cyvals[0]));
+        return fun != NULL && CY_IS_FUN(fun) &&
+               cyfold_is_pure(CY_FUN_OF(fun));
+}
+
+/*
+ * Purpose:    Queue a ready task on the running thread's deque and wake an
+ *             idle thread to take it.
+ * Parameters: A pointer to a cytask.
+ * Return:     Void
+ */
+static void cypar_queue(cytask* task) {
+        cydeque* deque = &cypar_deques[cypar_self];
+
+        pthread_mutex_lock(&deque -> lock);
+        if (deque -> hi == deque -> cap) {
+                /* Slide the tasks back to the start, or grow. */
+                if (deque -> lo > 0) {
+                        memmove(deque -> tasks, deque -> tasks + deque -> lo,
+                                sizeof(cytask*) * (deque -> hi - deque -> lo));
+                        deque -> hi -= deque -> lo;
+                        deque -> lo = 0;
+                } else {
+                        deque -> cap = deque -> cap ?
+                                       deque -> cap * 2 : CYPAR_MIN_SLOTS;
+                        deque -> tasks = realloc(deque -> tasks,
+                                                 sizeof(cytask*) *
+                                                 deque -> cap);
+                }
+        }
+        deque -> tasks[deque -> hi++] = task;
+        pthread_mutex_unlock(&deque -> lock);
+
+        __atomic_add_fetch(&cypar_queued, 1, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&cypar_idle_lock);
+        pthread_cond_signal(&cypar_idle);
+        pthread_mutex_unlock(&cypar_idle_lock);
+}
+
+/*
+ * Purpose:    Take a task from one end of a deque.
+ * Parameters: A pointer to a cydeque and an int that is nonzero to take
+ *             the newest task, as its own thread does, or 0 to take the
+ *             oldest, as a thief does.
+ * Return:     A pointer to the cytask taken, or NULL if the deque is empty.
+ */
+static cytask* cypar_take(cydeque* deque, int newest) {
+        cytask* task = NULL;
+
+        pthread_mutex_lock(&deque -> lock);
+        if (deque -> lo < deque -> hi) {
+                task = newest ? deque -> tasks[--deque -> hi] :
+                                deque -> tasks[deque -> lo++];
+                if (deque -> lo == deque -> hi)
+                        deque -> lo = deque -> hi = 0;
+        }
+        pthread_mutex_unlock(&deque -> lock);
+
+        return task;
+}
+
+/*
+ * Purpose:    Find a ready task, first on the running thread's own deque
+ *             and then by stealing from the others in turn.
+ * Parameters: Void
+ * Return:     A pointer to a cytask, or NULL if none is ready.
+ */
+static cytask* cypar_find(void) {
+        int i;
+        cytask* task = cypar_take(&cypar_deques[cypar_self], 1);
+
+        for (i = 1; task == NULL && i < cypar_threads; i++)
+                task = cypar_take(&cypar_deques[(cypar_self + i) %
+                                                cypar_threads], 0);
+        if (task != NULL)
+                __atomic_sub_fetch(&cypar_queued, 1, __ATOMIC_RELAXED);
+        return task;
+}
+
+/*
+ * Purpose:    Run a task, putting its result in place of its call and
+ *             queuing the task waiting on it once that has every result.
+ * Parameters: A pointer to a cytask, which is freed.
+ * Return:     Void
+ */
+static void cypar_run(cytask* task) {
+        cytask* parent = task -> parent;
+
+        if (task -> job != NULL)
+                task -> job(task -> data, task -> index);
+        else
+                *task -> slot = cyval_evaluate(task -> env, task -> value);
+        free(task);
+        if (parent == NULL)
+                __atomic_sub_fetch(&cypar_roots, 1, __ATOMIC_RELEASE);
+        else if (__atomic_sub_fetch(&parent -> pending, 1,
+                                    __ATOMIC_ACQ_REL) == 0)
+                cypar_queue(parent);
+}
+
+/*
+ * Purpose:    Run tasks as they become ready, sleeping while there are
+ *             none, for as long as the program runs.
+ * Parameters: A pointer holding the thread's int index in the pool.
+ * Return:     NULL, though it never returns.
+ */
+static void* cypar_worker(void* arg) {
+        cytask* task;
+
+        cypar_self = (int) (intptr_t) arg;
+        for (;;) {
+                if ((task = cypar_find()) != NULL) {
+                        cypar_run(task);
+                        continue;
+                }
+                pthread_mutex_lock(&cypar_idle_lock);
+                while (__atomic_load_n(&cypar_queued, __ATOMIC_ACQUIRE) == 0)
+                        pthread_cond_wait(&cypar_idle, &cypar_idle_lock);
+                pthread_mutex_unlock(&cypar_idle_lock);
+        }
+        return NULL;
+}
+
+/*
+ * Purpose:    Start the thread pool, so that expressions are evaluated on
+ *             the given number of threads, counting the calling thread,
+ *             which must be the one evaluating. The pool runs until the
+ *             program exits, and starting it again does nothing.
+ * Parameters: An int number of threads, at most CYPAR_MAX_THREADS.
+ * Return:     Void
+ */
+void cypar_start(int threads) {
+        int i;
+        pthread_t thread;
+
+        if (cypar_threads > 1 || threads < 2)
+                return;
+        if (threads > CYPAR_MAX_THREADS)
+                threads = CYPAR_MAX_THREADS;
+        /* Pick the vector kernels now, before threads can race to. */
+        cynums_isa();
+        for (i = 0; i < threads; i++)
+                pthread_mutex_init(&cypar_deques[i].lock, NULL);
+
+        /*
+         * A thread that fails to start leaves its deque empty, which the
+         * others only ever find empty when they steal.
+         */
+        cypar_threads = threads;
+        for (i = 1; i < threads; i++)
+                if (pthread_create(&thread, NULL, cypar_worker,
+                                   (void*) (intptr_t) i) == 0)
+                        pthread_detach(thread);
+}
+
+/*
+ * Purpose:    Pick how many chunks to split a number of independent calls
+ *             into, so that each thread in the pool gets several and any
+ *             that finish early can steal more, while each chunk stays
+ *             large enough to be a task of its own.
+ * Parameters: An int number of calls.
+ * Return:     The int number of chunks, 1 if the pool is not running.
+ */
+int cypar_chunks(int len) {
+        int chunks = cypar_threads * CYPAR_CHUNKS_PER_THREAD;
+
+        if (cypar_threads < 2 || cypar_self != 0 || cypar_running)
+                return 1;
+        if (len / chunks < CYPAR_MIN_CALLS)
+                chunks = len / CYPAR_MIN_CALLS;
+        return chunks > 1 ? chunks : 1;
+}
+
+/*
+ * Purpose:    Queue tasks that are ready and help run them and the tasks
+ *             that become ready after them, until every task outside any
+ *             other has finished.
+ * Parameters: A pointer to an array of pointers to ready cytasks, an int
+ *             number of them and an int number of tasks outside any task.
+ * Return:     Void
+ */
+static void cypar_help(cytask** ready, int len, int roots) {
+        int i;
+        cytask* task;
+
+        cypar_running = 1;
+        __atomic_store_n(&cypar_roots, roots, __ATOMIC_RELAXED);
+        for (i = 0; i < len; i++)
+                cypar_queue(ready[i]);
+        while (__atomic_load_n(&cypar_roots, __ATOMIC_ACQUIRE) > 0) {
+                if ((task = cypar_find()) != NULL)
+                        cypar_run(task);
+                else
+                        sched_yield();
+        }
+        cypar_running = 0;
+}
+
+/*
+ * Purpose:    Call a function on each index of a list of independent jobs,
+ *             on the thread pool if it is running and otherwise in order.
+ *             Expressions the jobs evaluate are not split up further.
+ * Parameters: An int number of jobs, a pointer to a function taking the
+ *             data pointer and an index, and a pointer to its data.
+ * Return:     Void
+ */
+void cypar_each(int len, void (*job)(void* data, int index), void* data) {
+        int i;
+
+        if (cypar_threads < 2 || cypar_self != 0 || cypar_running ||
+            len < 2) {
+                for (i = 0; i < len; i++)
+                        job(data, i);
+                return;
+        }
+        for (i = 0; i < len; i++) {
+                cypar_append(&cypar_made, &cypar_len_made, &cypar_cap_made,
+                             calloc(1, sizeof(cytask)));
+                cypar_made[i] -> job = job;
+                cypar_made[i] -> data = data;
+                cypar_made[i] -> index = i;
+        }
+        cypar_len_made = 0;
+        cypar_help(cypar_made, len, len);
+}
+
+/*
+ * Purpose:    Finish walking an expression: make it a task if it is a
+ *             large enough call that another thread may evaluate, with the
+ *             tasks made under it as the ones it waits on, or let those
+ *             tasks replace their calls in it directly if it is not safe.
+ * Parameters: A pointer to the cyenv to evaluate in, a pointer to the
+ *             finished cyparwork, a pointer to the slot its result goes in
+ *             and a pointer to an int count of tasks outside any task.
+ * Return:     Void
+ */
+static void cypar_close(cyenv* env, cyparwork* done, cyval** slot,
+                        int* roots) {
+        int i;
+        cytask* task;
+
+        if (!done -> safe) {
+                *roots += cypar_len_orphans - done -> base;
+                cypar_len_orphans = done -> base;
+                return;
+        }
+        if (done -> nodes < CYPAR_MIN_NODES)
+                return;
+
+        task = calloc(1, sizeof(*task));
+        task -> env = env;
+        task -> value = done -> value;
+        task -> slot = slot;
+        task -> pending = cypar_len_orphans - done -> base;
+        for (i = done -> base; i < cypar_len_orphans; i++)
+                cypar_orphans[i] -> parent = task;
+        cypar_len_orphans = done -> base;
+        cypar_append(&cypar_orphans, &cypar_len_orphans, &cypar_cap_orphans,
+                     task);
+        cypar_append(&cypar_made, &cypar_len_made, &cypar_cap_made, task);
+}
+
+/*
+ * Purpose:    Evaluate the large calls to pure builtins in an expression on
+ *             the thread pool, replacing each with its result, when the
+ *             pool is running. Calls are only evaluated ahead of the first
+ *             call that is not to a pure builtin, as that call may rebind
+ *             the symbols later ones go through.
+ * Parameters: A pointer to the cyenv the expression will be evaluated in
+ *             and a pointer to the cyval expression, which is consumed.
+ * Return:     A pointer to the expression left to evaluate.
+ */
+cyval* cypar_expr(cyenv* env, cyval* value) {
+        int i;
+        int impure = 0;
+        int roots = 0;
+        int ready = 0;
+        cyval* top = value;
+        cyval* result = NULL;
+        cyval* child;
+        cyval** slot;
+        cyparwork* work;
+        cyparwork done;
+
+        /* Tasks evaluating their calls never walk them again. */
+        if (cypar_threads < 2 || cypar_self != 0 || cypar_running ||
+            CY_TYPE(value) != CYVAL_S_EXP || value -> len_cyvals == 0)
+                return value;
+        cypar_schedule(value);
+        while (cypar_len_work > 0) {
+                work = &cypar_work[cypar_len_work - 1];
+                value = work -> value;
+
+                /* Walk the children first, in the order they evaluate. */
+                if (!impure && work -> next < value -> len_cyvals) {
+                        child = value -> cyvals[work -> next++];
+                        if (CY_TYPE(child) == CYVAL_S_EXP &&
+                            child -> len_cyvals > 0) {
+                                cypar_schedule(child);
+                                continue;
+                        }
+                        work -> nodes++;
+                        if (!cypar_leaf_safe(env, child))
+                                work -> safe = 0;
+                        continue;
+                }
+                done = *work;
+                cypar_len_work--;
+                if (!impure && value -> len_cyvals > 1 &&
+                    !cypar_is_pure(env, value))
+                        impure = 1;
+                if (impure)
+                        done.safe = 0;
+
+                slot = &result;
+                if (cypar_len_work > 0) {
+                        work = &cypar_work[cypar_len_work - 1];
+                        slot = &work -> value -> cyvals[work -> next - 1];
+                        work -> nodes += done.nodes;
+                        work -> safe = work -> safe && done.safe;
+                }
+                cypar_close(env, &done, slot, &roots);
+        }
+        roots += cypar_len_orphans;
+        cypar_len_orphans = 0;
+
+        /* A single task would run no faster on the pool. */
+        if (cypar_len_made < 2) {
+                for (i = 0; i < cypar_len_made; i++)
+                        free(cypar_made[i]);
+                cypar_len_made = 0;
+                return top;
+        }
+
+        /*
+         * Queue the tasks waiting on no others, picking them all out
+         * before any can finish and queue its parent.
+         */
+        for (i = 0; i < cypar_len_made; i++)
+                if (cypar_made[i] -> pending == 0)
+                        cypar_made[ready++] = cypar_made[i];
+        cypar_len_made = 0;
+        cypar_help(cypar_made, ready, roots);
+
+        return result != NULL ? result : top;
+}
@@ -0,0 +1,69 @@
+/*
+ * choccypar.h
+ * Header file for choccypar.c, declaring the work-stealing thread pool
+ * that evaluates large calls to pure builtins in parallel.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYPAR_H
+#define CHOCCYPAR_H
+
+#include "choccyparsing.h"
+
+/* Most threads the pool can run, counting the main thread. */
+#define CYPAR_MAX_THREADS 64
+
+/* Fewest nodes a call must hold to be evaluated as a task of its own. */
+#define CYPAR_MIN_NODES 64
+
+/*
+ * Chunks per thread that a list of independent calls, such as those made
+ * by "map", is split into, and fewest calls in each chunk.
+ */
+#define CYPAR_CHUNKS_PER_THREAD 4
+#define CYPAR_MIN_CALLS 32
+
+/*
+ * Purpose:    Start the thread pool, so that expressions are evaluated on
+ *             the given number of threads, counting the calling thread,
+ *             which must be the one evaluating. The pool runs until the
+ *             program exits, and starting it again does nothing.
+ * Parameters: An int number of threads, at most CYPAR_MAX_THREADS.
+ * Return:     Void
+ */
+void cypar_start(int threads);
+
+/*
+ * Purpose:    Evaluate the large calls to pure builtins in an expression on
+ *             the thread pool, replacing each with its result, when the
+ *             pool is running. Calls are only evaluated ahead of the first
+ *             call that is not to a pure builtin, as that call may rebind
+ *             the symbols later ones go through.
+ * Parameters: A pointer to the cyenv the expression will be evaluated in
+ *             and a pointer to the cyval expression, which is consumed.
+ * Return:     A pointer to the expression left to evaluate.
+ */
+cyval* cypar_expr(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    Call a function on each index of a list of independent jobs,
+ *             on the thread pool if it is running and otherwise in order.
+ *             Expressions the jobs evaluate are not split up further.
+ * Parameters: An int number of jobs, a pointer to a function taking the
+ *             data pointer and an index, and a pointer to its data.
+ * Return:     Void
+ */
+void cypar_each(int len, void (*job)(void* data, int index), void* data);
+
+/*
+ * Purpose:    Pick how many chunks to split a number of independent calls
+ *             into, so that each thread in the pool gets several and any
+ *             that finish early can steal more, while each chunk stays
+ *             large enough to be a task of its own.
+ * Parameters: An int number of calls.
+ * Return:     The int number of chunks, 1 if the pool is not running.
+ */
+int cypar_chunks(int len);
+
+#endif
@@ -5,10 +5,21 @@
  * www.buildyourownlisp.com.
  *
  * Written by:  Mohsin Rizvi
- * Last edited: 10/17/17
+ * Last edited: 10/16/26
  */
 
 #include "choccyparsing.h"
+#include "choccyenv.h"
+#include "choccyvm.h"
+#include "choccyfold.h"
+#include "choccymemo.h"
+#include "choccyhash.h"
+#include "choccycons.h"
+#include "choccyalloc.h"
+#include "choccyread.h"
+#include "choccypar.h"
+#include "choccyimage.h"
+#include "choccyser.h"
 
 /* 
  * Purpose:    Preprocessor macro to be used for error checking.
@@ -22,74 +33,317 @@
                 return cyval_error(ERROR); \
         }
 
-/* Purpose:    Execute the program and start the REPL.
- * Parameters: An int argc (argument count) and c-string argv
- *             (additional string arguments).
- * Return:     Returns an int.
+/* Initial number of slots allocated for the stacks below. */
+#define CYVAL_MIN_SLOTS 16
+
+/* An expression being printed and the index of its next child. */
+typedef struct cyprintframe {
+        cyval* value;
+        int next;
+} cyprintframe;
+
+/* An expression being persisted, its copy and the index of its next child. */
+typedef struct cypersistframe {
+        cyval* value;
+        cyval* copy;
+        int next;
+} cypersistframe;
+
+/*
+ * The expressions being printed or persisted, and the vectors waiting to
+ * be freed, kept on stacks between calls on this thread instead of on the
+ * C stack, so printing, persisting and releasing are limited by nothing
+ * but memory.
+ */
+static _Thread_local cypersistframe* cypersist_frames = NULL;
+static _Thread_local int cypersist_len_frames = 0;
+static _Thread_local int cypersist_cap_frames = 0;
+static _Thread_local cyprintframe* cyprint_frames = NULL;
+static _Thread_local int cyprint_len_frames = 0;
+static _Thread_local int cyprint_cap_frames = 0;
+static _Thread_local cyvec** cyrelease_vecs = NULL;
+static _Thread_local int cyrelease_len_vecs = 0;
+static _Thread_local int cyrelease_cap_vecs = 0;
+static _Thread_local int cyrelease_running = 0;
+
+/* Characters a symbol is made of. */
+#define CYGRAMMAR_SYM_CHARS "abcdefghijklmnopqrstuvwxyz" \
+                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ" \
+                            "0123456789_+-*/\\=<>!&%^"
+
+/*
+ * Purpose:    Make the parser for a regular expression of one or more
+ *             parts, each matching a string, as MPC compiles it: the parts
+ *             are matched in turn and their strings joined, by a DFA when
+ *             mpc_dfa can compile them into one.
+ * Parameters: An int number of parts, followed by a pointer to the MPC
+ *             parser for each part.
+ * Return:     A pointer to the MPC parser.
+ */
+static mpc_parser_t* cygrammar_regex(int n, ...) {
+        int i;
+        va_list parts;
+        mpc_parser_t* regex = mpc_lift(mpcf_ctor_str);
+
+        va_start(parts, n);
+        for (i = 0; i < n; i++)
+                regex = mpc_and(2, mpcf_strfold, regex,
+                                va_arg(parts, mpc_parser_t*), free);
+        va_end(parts);
+
+        return mpc_dfa(regex);
+}
+
+/*
+ * Purpose:    Make the parser for a token of the grammar, a string followed
+ *             by any whitespace, read as an AST leaf.
+ * Parameters: A pointer to the MPC parser for the string and a c-string tag
+ *             for the leaf.
+ * Return:     A pointer to the MPC parser.
+ */
+static mpc_parser_t* cygrammar_token(mpc_parser_t* string, const char* tag) {
+        return mpca_state(mpca_tag(mpc_apply(mpc_tok(string), mpcf_str_ast),
+                                   tag));
+}
+
+/*
+ * Purpose:    Make the parser for a use of a rule of the grammar, tagging
+ *             the AST it reads with the rule's name.
+ * Parameters: A pointer to the MPC parser for the rule and its c-string
+ *             name.
+ * Return:     A pointer to the MPC parser.
+ */
+static mpc_parser_t* cygrammar_rule(mpc_parser_t* rule, const char* name) {
+        return mpca_state(mpca_root(mpca_add_tag(rule, name)));
+}
+
+/*
+ * Purpose:    Make the parser for a sequence of parts of the grammar.
+ * Parameters: An int number of parts, followed by a pointer to the MPC
+ *             parser for each part.
+ * Return:     A pointer to the MPC parser.
+ */
+static mpc_parser_t* cygrammar_seq(int n, ...) {
+        int i;
+        va_list parts;
+        mpc_parser_t* seq = mpc_pass();
+
+        va_start(parts, n);
+        for (i = 0; i < n; i++)
+                seq = mpca_and(2, seq, va_arg(parts, mpc_parser_t*));
+        va_end(parts);
+
+        return seq;
+}
+
+/*
+ * Purpose:    Define a rule of the grammar, optimising its parser.
+ * Parameters: A pointer to the MPC parser made with mpc_new for the rule
+ *             and a pointer to the MPC parser it is defined as.
+ * Return:     Void
+ */
+static void cygrammar_define(mpc_parser_t* rule, mpc_parser_t* grammar) {
+        mpc_optimise(grammar);
+        mpc_define(rule, grammar);
+}
+
+/*
+ * Purpose:    Define the Choccy language, constructing the MPC parser for
+ *             each rule of its grammar. The parsers are built directly
+ *             from MPC's combinators, the same ones mpca_lang would build
+ *             from the grammar below, so no grammar text or regular
+ *             expression is parsed at startup. Parse trees and error
+ *             messages are unchanged.
+ *
+ *                 num   : /-?[0-9]+/ ;
+ *                 sym   : /[a-zA-Z0-9_+\-*\/\\=<>!&%^]+/ ;
+ *                 s_exp : '(' <exp>* ')' ;
+ *                 q_exp : '{' <exp>* '}' ;
+ *                 exp   : <num> | <sym> | <s_exp> | <q_exp> ;
+ *                 line  : /^/ <exp>* /$/ ;
+ *
+ * Parameters: Void
+ * Return:     A pointer to a heap-allocated cygrammar.
+ */
+cygrammar* cygrammar_new(void) {
+        cygrammar* grammar = malloc(sizeof(*grammar));
+        mpc_parser_t* alt;
+        mpc_parser_t* soi;
+        mpc_parser_t* eoi;
+
+        grammar -> num = mpc_new("num");
+        grammar -> sym = mpc_new("sym");
+        grammar -> s_exp = mpc_new("s_exp");
+        grammar -> q_exp = mpc_new("q_exp");
+        grammar -> exp = mpc_new("exp");
+        grammar -> line = mpc_new("line");
+
+        cygrammar_define(grammar -> num, cygrammar_seq(1, cygrammar_token(
+                cygrammar_regex(2,
+                        mpc_maybe_lift(mpc_char('-'), mpcf_ctor_str),
+                        mpc_many1(mpcf_strfold, mpc_oneof("0123456789"))),
+                "regex")));
+        cygrammar_define(grammar -> sym, cygrammar_seq(1, cygrammar_token(
+                cygrammar_regex(1, mpc_many1(mpcf_strfold,
+                                             mpc_oneof(CYGRAMMAR_SYM_CHARS))),
+                "regex")));
+        cygrammar_define(grammar -> s_exp, cygrammar_seq(3,
+                cygrammar_token(mpc_char('('), "char"),
+                mpca_many(cygrammar_rule(grammar -> exp, "exp")),
+                cygrammar_token(mpc_char(')'), "char")));
+        cygrammar_define(grammar -> q_exp, cygrammar_seq(3,
+                cygrammar_token(mpc_char('{'), "char"),
+                mpca_many(cygrammar_rule(grammar -> exp, "exp")),
+                cygrammar_token(mpc_char('}'), "char")));
+        /* The alternatives of a rule nest, the last two innermost. */
+        alt = mpca_or(2, cygrammar_seq(1, cygrammar_rule(grammar -> s_exp,
+                                                         "s_exp")),
+                      cygrammar_seq(1, cygrammar_rule(grammar -> q_exp,
+                                                      "q_exp")));
+        alt = mpca_or(2, cygrammar_seq(1, cygrammar_rule(grammar -> sym,
+                                                         "sym")), alt);
+        alt = mpca_or(2, cygrammar_seq(1, cygrammar_rule(grammar -> num,
+                                                         "num")), alt);
+        cygrammar_define(grammar -> exp, alt);
+
+        /* The anchors match an empty string at either end of the input. */
+        soi = mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
+        eoi = mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free);
+        cygrammar_define(grammar -> line, cygrammar_seq(3,
+                cygrammar_token(cygrammar_regex(1, soi), "regex"),
+                mpca_many(cygrammar_rule(grammar -> exp, "exp")),
+                cygrammar_token(cygrammar_regex(1, eoi), "regex")));
+
+        return grammar;
+}
+
+/*
+ * Purpose:    Deallocate a cygrammar and the MPC parsers it holds.
+ * Parameters: A pointer to a cygrammar to deallocate.
+ * Return:     Void
+ */
+void cygrammar_delete(cygrammar* grammar) {
+        mpc_cleanup(6, grammar -> num, grammar -> sym, grammar -> s_exp,
+                    grammar -> q_exp, grammar -> exp, grammar -> line);
+        free(grammar);
+}
+
+/*
+ * Purpose:    Parse a line of Choccy code, then evaluate it and print the
+ *             result, or print the parse error.
+ * Parameters: A pointer to the cyenv to evaluate in, a c-string name of the
+ *             input for error messages, a c-string line of code, a
+ *             pointer to the MPC parser for a line and a FILE pointer to
+ *             print to.
+ * Return:     1 if the line parsed, or 0 otherwise.
  */
-int main(int argc, char** argv) {
-        char* version = "v0.0.0.0.6";
-        char* read;
-        cyval* s_expression;
+int eval_print_line(cyenv* env, char* name, char* input,
+                    mpc_parser_t* line, FILE* out) {
+        mpc_result_t result;
+        cyval* value;
         cyval* evaluated;
-        (void) argc;
-        (void) argv;
-        (void) s_expression;
-
-    /* Define the language */
-        mpc_parser_t* num = mpc_new("num");
-        mpc_parser_t* sym = mpc_new("sym");
-        mpc_parser_t* s_exp = mpc_new("s_exp");
-        mpc_parser_t* q_exp = mpc_new("q_exp");
-        mpc_parser_t* exp = mpc_new("exp");
-        mpc_parser_t* line = mpc_new("line");
-    mpca_lang(MPCA_LANG_DEFAULT,
-        "                                                     \
-        num      : /-?[0-9]+/ ;                               \
-        sym      : \"list\" | \"head\" | \"tail\"             \
-                 | \"join\" | \"eval\"                        \
-                 | '-' | '+' | '*' | '/' | '%' | '^' ;        \
-        s_exp    : '(' <exp>* ')' ;                           \
-        q_exp    : '{' <exp>* '}' ;                           \
-        exp      : <num> | <sym> | <s_exp> | <q_exp> ;        \
-        line     : /^/ <exp>* /$/ ;                           \
-        ", num, sym, s_exp, q_exp, exp, line);
-        /* Begin the REPL */
-        printf("choccy %s\nTo exit, press ctrl+c\n", version);
-        while (1) {
-                read = readline("choccy> ");
-                add_history(read);
+
+        /*
+         * Read and evaluate inside the arena, then drop every value the
+         * line created in one reset.
+         */
+        cyalloc_arena_begin();
+        if (!cyread_line(input, &value)) {
+                /* Fall back on MPC, which reports why the line is invalid. */
+                if (!mpc_parse(name, input, line, &result)) {
+                        cyalloc_arena_reset();
+                        mpc_err_print_to(result.error, out);
+                        mpc_err_delete(result.error);
+                        return 0;
+                }
+                value = cyval_read_tree(result.output);
+                mpc_ast_delete(result.output);
+        }
+        evaluated = cyval_evaluate(env, value);
+        print_cyval_endl(evaluated, out);
+        cyalloc_arena_reset();
+
+        return 1;
+}
+
+/*
+ * Purpose:    Read Choccy code from a stream and evaluate each top-level
+ *             expression as soon as it is complete, printing its result.
+ *             Only the expression being read is held in memory, so scripts
+ *             of any length run in memory bounded by their largest
+ *             top-level expression.
+ * Parameters: A pointer to the cyenv to evaluate in, a FILE pointer to read
+ *             from, a c-string name of the input for error messages, a
+ *             pointer to the MPC parser for a line and a FILE pointer to
+ *             print to.
+ * Return:     0 if every expression parsed, or 1 otherwise.
+ */
+int run_stream(cyenv* env, FILE* input, char* name, mpc_parser_t* line,
+               FILE* out) {
+        int c;
+        int depth = 0;
+        int status = 0;
+        size_t len = 0;
+        size_t cap = 256;
+        char* buffer = malloc(cap);
+
+        while ((c = getc(input)) != EOF) {
                 /*
-                 * Parse input from standard input into read, checking for
-                 * correct choccy statement.
+                 * At the top level, whitespace or an opening bracket ends a
+                 * pending atom, which is then evaluated by itself.
                  */
-                mpc_result_t result;
-                /* Process input based on validity. */
-                if (mpc_parse("<stdin>", read, line, &result)) {
-                        evaluated = cyval_evaluate(
-                                cyval_read_tree(result.output));
-                        print_cyval_endl(evaluated);
-                        cyval_destructor(evaluated);
-                        
-                        mpc_ast_delete(result.output);
-                } else {
-                        mpc_err_print(result.error);
-                        mpc_err_delete(result.error);
+                if (depth == 0 && len > 0 &&
+                    (isspace(c) || c == '(' || c == '{')) {
+                        buffer[len] = '\0';
+                        if (!eval_print_line(env, name, buffer, line, out))
+                                status = 1;
+                        len = 0;
+                }
+                if (depth == 0 && isspace(c))
+                        continue;
+
+                /* Keep room for the char and a terminating null char. */
+                if (len + 2 > cap) {
+                        cap *= 2;
+                        buffer = realloc(buffer, cap);
                 }
-                free(read);
+                buffer[len++] = c;
+
+                /* A closing bracket may complete a top-level expression. */
+                if (c == '(' || c == '{') {
+                        depth++;
+                } else if ((c == ')' || c == '}') && --depth <= 0) {
+                        buffer[len] = '\0';
+                        if (!eval_print_line(env, name, buffer, line, out))
+                                status = 1;
+                        len = 0;
+                        depth = 0;
+                }
+        }
+        /* Evaluate a trailing atom, or report an unterminated expression. */
+        if (len > 0) {
+                buffer[len] = '\0';
+                if (!eval_print_line(env, name, buffer, line, out))
+                        status = 1;
         }
-    mpc_cleanup(6, num, sym, s_exp, q_exp, exp, line);
 
-    return 0;
+        free(buffer);
+        return status;
 }
 
 /*
- * Purpose:    Construct a cyval number instance on the heap.
+ * Purpose:    Construct a cyval number instance, as a fixnum when it fits
+ *             and on the heap otherwise.
  * Parameters: A long int number value for the cyval to store.
  * Return:     A pointer to a constructed cyval instance.
  */
 cyval* cyval_num(long num_value) {
-        cyval* value = malloc(sizeof(*value));
+        cyval* value;
+
+        if (num_value >= CY_FIXNUM_MIN && num_value <= CY_FIXNUM_MAX)
+                return CY_MAKE_FIXNUM(num_value);
+
+        value = cyalloc_node();
         value -> data_type = CYVAL_NUM;
 
         value -> num = num_value;
@@ -97,13 +351,50 @@ cyval* cyval_num(long num_value) {
         return value;
 }
 
+/*
+ * Purpose:    Construct a cyval number instance from a cybig, as a long
+ *             number when it fits in one and as a big number otherwise.
+ * Parameters: A pointer to a cybig, whose limbs the cyval takes over.
+ * Return:     A pointer to a constructed cyval instance.
+ */
+cyval* cyval_big(cybig* big) {
+        cyval* value;
+        long num;
+
+        if (cybig_to_long(big, &num)) {
+                cybig_free(big);
+                return cyval_num(num);
+        }
+
+        value = cyalloc_node();
+        value -> data_type = CYVAL_BIG;
+
+        value -> big = *big;
+
+        return value;
+}
+
+/*
+ * Purpose:    Construct a cyval numeric vector instance on the heap.
+ * Parameters: A pointer to a cynums, whose reference the cyval takes over.
+ * Return:     A pointer to a constructed cyval instance.
+ */
+cyval* cyval_nums(cynums* nums) {
+        cyval* value = cyalloc_node();
+
+        value -> data_type = CYVAL_NUMS;
+        value -> nums = nums;
+
+        return value;
+}
+
 /*
  * Purpose:    Construct a cyval error instance on the heap.
  * Parameters: A c-string representing an error message.
  * Return:     A pointer to a constructed cyval instance.
  */
 cyval* cyval_error(char* msg) {
-        cyval* value = malloc(sizeof(*value));
+        cyval* value = cyalloc_node();
         value -> data_type = CYVAL_ERROR;
 
         value -> error = malloc(strlen(msg) + 1);
@@ -113,18 +404,13 @@ cyval* cyval_error(char* msg) {
 }
 
 /*
- * Purpose:    Construct a cyval symbol instance on the heap.
+ * Purpose:    Construct a cyval symbol instance as an immediate interned
+ *             symbol id.
  * Parameters: A c-string representing a symbol.
  * Return:     A pointer to a constructed cyval instance.
  */
 cyval* cyval_sym(char* symbol) {
-        cyval* value = malloc(sizeof(*value));
-        value -> data_type = CYVAL_SYM;
-
-        value -> sym = malloc(strlen(symbol) + 1);
-        strcpy(value -> sym, symbol);
-
-        return value;
+        return CY_MAKE_SYM(cysym_intern(symbol));
 }
 
 /*
@@ -133,11 +419,13 @@ cyval* cyval_sym(char* symbol) {
  * Return:     A pointer to a constructed cyval instance.
  */
 cyval* cyval_s_exp(void) {
-        cyval* value = malloc(sizeof(*value));
+        cyval* value = cyalloc_node();
         value -> data_type = CYVAL_S_EXP;
 
         value -> cyvals = NULL;
         value -> len_cyvals = 0;
+        value -> off_cyvals = 0;
+        value -> vec = NULL;
 
         return value;
 }
@@ -148,42 +436,288 @@ cyval* cyval_s_exp(void) {
  * Return:     A pointer to an allocated cyval instance.
  */
 cyval* cyval_q_exp(void) {
-        cyval* value = malloc(sizeof(*value));
+        cyval* value = cyalloc_node();
         value -> data_type = CYVAL_Q_EXP;
 
         value -> cyvals = NULL;
         value -> len_cyvals = 0;
+        value -> off_cyvals = 0;
+        value -> vec = NULL;
 
         return value;
 }
 
 /*
- * Purpose:    Deallocate heap memory used by the given cyval pointer.
- * Parameters: A pointer to a cyval to deallocate memory for.
+ * Purpose:    Copy a cyval. Copying an S-expression or Q-expression shares
+ *             its vector of children instead of copying them, so any copy
+ *             takes constant time.
+ * Parameters: A pointer to a cyval to copy.
+ * Return:     A pointer to the copy, which is owned by the caller.
+ */
+cyval* cyval_copy(cyval* value) {
+        cyval* copy;
+
+        /* Immediates are copied by value. */
+        if (!CY_IS_HEAP(value))
+                return value;
+        if (value -> data_type == CYVAL_NUM)
+                return cyval_num(value -> num);
+        if (value -> data_type == CYVAL_ERROR)
+                return cyval_error(value -> error);
+
+        copy = cyalloc_node();
+        copy -> data_type = value -> data_type;
+        if (value -> data_type == CYVAL_BIG) {
+                cybig_copy(&copy -> big, &value -> big);
+                return copy;
+        }
+        if (value -> data_type == CYVAL_NUMS) {
+                copy -> nums = cynums_retain(value -> nums);
+                return copy;
+        }
+        copy -> len_cyvals = value -> len_cyvals;
+        copy -> off_cyvals = value -> off_cyvals;
+        copy -> vec = value -> vec;
+        copy -> cyvals = value -> cyvals;
+        if (copy -> vec != NULL)
+                copy -> vec -> refs++;
+
+        return copy;
+}
+
+/*
+ * Purpose:    Allocate a cyvec with room for the given number of children.
+ * Parameters: An int capacity.
+ * Return:     A pointer to an empty cyvec with one reference.
+ */
+static cyvec* cyvec_new(int cap) {
+        cyvec* vec = malloc(sizeof(cyvec) + sizeof(cyval*) * cap);
+
+        vec -> refs = 1;
+        vec -> cap = cap;
+        vec -> lo = 0;
+        vec -> hi = 0;
+        vec -> folded = NULL;
+        vec -> folded_epoch = 0;
+        vec -> consed = 0;
+        vec -> hash = 0;
+        vec -> cons_chain = NULL;
+
+        return vec;
+}
+
+/*
+ * Purpose:    Copy a node into one that outlives the arena, leaving the
+ *             children of an expression to be filled in, and pushing it
+ *             onto the stack of expressions being persisted if it has any.
+ * Parameters: A pointer to a cyval to copy, which is not consumed.
+ * Return:     A pointer to the copy.
+ */
+static cyval* cyval_persist_node(cyval* value) {
+        cyval* copy;
+
+        if (!CY_IS_HEAP(value))
+                return value;
+
+        copy = cyalloc_slab_node();
+        copy -> data_type = value -> data_type;
+        if (value -> data_type == CYVAL_NUM) {
+                copy -> num = value -> num;
+        } else if (value -> data_type == CYVAL_BIG) {
+                cybig_copy(&copy -> big, &value -> big);
+        } else if (value -> data_type == CYVAL_NUMS) {
+                /* Vectors are never modified, so they can stay shared. */
+                copy -> nums = cynums_retain(value -> nums);
+        } else if (value -> data_type == CYVAL_ERROR) {
+                copy -> error = malloc(strlen(value -> error) + 1);
+                strcpy(copy -> error, value -> error);
+        } else {
+                copy -> len_cyvals = value -> len_cyvals;
+                copy -> off_cyvals = 0;
+                copy -> vec = NULL;
+                copy -> cyvals = NULL;
+                if (value -> len_cyvals > 0) {
+                        copy -> vec = cyvec_new(value -> len_cyvals);
+                        copy -> vec -> hi = value -> len_cyvals;
+                        copy -> cyvals = copy -> vec -> items;
+                        if (cypersist_len_frames == cypersist_cap_frames) {
+                                cypersist_cap_frames = cypersist_cap_frames ?
+                                                       cypersist_cap_frames *
+                                                       2 : CYVAL_MIN_SLOTS;
+                                cypersist_frames = realloc(cypersist_frames,
+                                                   sizeof(cypersistframe) *
+                                                   cypersist_cap_frames);
+                        }
+                        cypersist_frames[cypersist_len_frames].value = value;
+                        cypersist_frames[cypersist_len_frames].copy = copy;
+                        cypersist_frames[cypersist_len_frames].next = 0;
+                        cypersist_len_frames++;
+                }
+        }
+
+        return copy;
+}
+
+/*
+ * Purpose:    Deep copy a cyval into nodes that outlive the arena, so it
+ *             can be kept after the line that made it. Expressions being
+ *             copied are kept on a stack instead of the C stack, so
+ *             nesting depth is limited only by memory.
+ * Parameters: A pointer to a cyval to copy, which is not consumed.
+ * Return:     A pointer to the copy, owned by the caller.
+ */
+cyval* cyval_persist(cyval* value) {
+        int base = cypersist_len_frames;
+        int i;
+        cyval* copy = cyval_persist_node(value);
+        cyval* parent;
+        cypersistframe* top;
+
+        while (cypersist_len_frames > base) {
+                top = &cypersist_frames[cypersist_len_frames - 1];
+                if (top -> next < top -> value -> len_cyvals) {
+                        /* Copying the child may move the stack. */
+                        parent = top -> copy;
+                        i = top -> next++;
+                        parent -> cyvals[i] =
+                                cyval_persist_node(top -> value -> cyvals[i]);
+                        continue;
+                }
+                /* Intern an expression once its children are copied. */
+                cycons_intern(top -> copy);
+                cypersist_len_frames--;
+        }
+
+        return copy;
+}
+
+/*
+ * Purpose:    Release a reference to a cyvec, destroying its children and
+ *             freeing it once no cyval refers to it.
+ * Parameters: A pointer to a cyvec, which may be NULL.
  * Return:     Void
  */
-void cyval_destructor(cyval* value) {
+void cyvec_release(cyvec* vec) {
         int i;
 
-        if (value != NULL) {
-                /* Handle the case where the cyval represents an error. */
-                if (value -> data_type == CYVAL_ERROR)
-                        free(value -> error);
-                /* Handle the case where the cyval represents a symbol. */
-                else if (value -> data_type == CYVAL_SYM)
-                        free(value -> sym);
-                /*
-                 * Recursively handle the case where the cyval represents
-                 * an expression, freeing all expressions it holds.
-                 */
-                else if (value -> data_type == CYVAL_S_EXP ||
-                         value -> data_type == CYVAL_Q_EXP) {
-                        for (i = 0; i < value -> len_cyvals; i++)
-                                cyval_destructor(value -> cyvals[i]);
-                        free(value -> cyvals);
-                }
+        if (vec == NULL || --vec -> refs > 0)
+                return;
+        if (cyrelease_len_vecs == cyrelease_cap_vecs) {
+                cyrelease_cap_vecs = cyrelease_cap_vecs ?
+                                     cyrelease_cap_vecs * 2 :
+                                     CYVAL_MIN_SLOTS;
+                cyrelease_vecs = realloc(cyrelease_vecs, sizeof(cyvec*) *
+                                                         cyrelease_cap_vecs);
+        }
+        cyrelease_vecs[cyrelease_len_vecs++] = vec;
+
+        /*
+         * Releasing a child's vector only queues it, so the call that
+         * started releasing frees every vector without recursing.
+         */
+        if (cyrelease_running)
+                return;
+        cyrelease_running = 1;
+        while (cyrelease_len_vecs > 0) {
+                vec = cyrelease_vecs[--cyrelease_len_vecs];
+                if (vec -> consed)
+                        cycons_forget(vec);
+                for (i = vec -> lo; i < vec -> hi; i++)
+                        cyval_destructor(vec -> items[i]);
+                cyval_destructor(vec -> folded);
+                free(vec);
+        }
+        cyrelease_running = 0;
+}
+
+/*
+ * Purpose:    Make a cyval's vector of children its own before modifying
+ *             it: a shared vector is replaced by a copy of the cyval's
+ *             slice, and children outside the slice of an unshared vector
+ *             are destroyed.
+ * Parameters: A pointer to a cyval S-expression or Q-expression.
+ * Return:     Void
+ */
+void cyval_own(cyval* value) {
+        int i;
+        int end = value -> off_cyvals + value -> len_cyvals;
+        cyvec* vec = value -> vec;
+        cyvec* copy;
+
+        if (vec == NULL)
+                return;
+        if (vec -> refs > 1) {
+                copy = cyvec_new(value -> len_cyvals > 4 ?
+                                 value -> len_cyvals : 4);
+                for (i = 0; i < value -> len_cyvals; i++)
+                        copy -> items[i] = cyval_copy(value -> cyvals[i]);
+                copy -> hi = value -> len_cyvals;
+                vec -> refs--;
+                value -> vec = copy;
+                value -> off_cyvals = 0;
+                value -> cyvals = copy -> items;
+                return;
         }
-        free(value);
+        /*
+         * The children may be about to change, so forget the folded body
+         * and the hash, and take the vector out of the hash-consing table.
+         */
+        cyval_destructor(vec -> folded);
+        vec -> folded = NULL;
+        if (vec -> consed)
+                cycons_forget(vec);
+        vec -> hash = 0;
+        for (i = vec -> lo; i < value -> off_cyvals; i++)
+                cyval_destructor(vec -> items[i]);
+        for (i = end; i < vec -> hi; i++)
+                cyval_destructor(vec -> items[i]);
+        vec -> lo = value -> off_cyvals;
+        vec -> hi = end;
+}
+
+/*
+ * Purpose:    Narrow a cyval's children to the given range in constant
+ *             time. Children outside the range stay in the vector until it
+ *             is released or the cyval is next modified.
+ * Parameters: A pointer to a cyval S-expression or Q-expression, an int
+ *             index of the first child to keep and an int number of
+ *             children to keep.
+ * Return:     Void
+ */
+void cyval_slice(cyval* value, int start, int len) {
+        value -> off_cyvals += start;
+        value -> cyvals += start;
+        value -> len_cyvals = len;
+}
+
+/*
+ * Purpose:    Deallocate heap memory used by the given cyval pointer.
+ * Parameters: A pointer to a cyval to deallocate memory for.
+ * Return:     Void
+ */
+void cyval_destructor(cyval* value) {
+        /*
+         * Immediate fixnums and symbols own no memory, and nodes mapped
+         * from a heap image live as long as the program.
+         */
+        if (value == NULL || !CY_IS_HEAP(value) ||
+            value -> owner == CYALLOC_IMAGE)
+                return;
+        /* Handle the case where the cyval represents an error. */
+        if (value -> data_type == CYVAL_ERROR)
+                free(value -> error);
+        else if (value -> data_type == CYVAL_BIG)
+                cybig_free(&value -> big);
+        else if (value -> data_type == CYVAL_NUMS)
+                cynums_release(value -> nums);
+        /*
+         * Handle the case where the cyval represents an expression,
+         * releasing its share of the vector holding its children.
+         */
+        else if (value -> data_type == CYVAL_S_EXP ||
+                 value -> data_type == CYVAL_Q_EXP)
+                cyvec_release(value -> vec);
+        cyalloc_free(value);
 }
 
 /*
@@ -191,52 +725,116 @@ void cyval_destructor(cyval* value) {
  *             and print print the opening char before and the ending char
  *             after.
  * Parameters: A pointer to a cyval s-expression to print from, a char
- *             opening to print first, and a char ending to print last.
+ *             opening to print first, a char ending to print last, and a
+ *             FILE pointer to print to.
  * Return:     Void
  */
-void print_cyval_exp(cyval* value, char opening, char ending) {
+void print_cyval_exp(cyval* value, char opening, char ending, FILE* out) {
         int i;
 
-        putchar(opening);
+        fputc(opening, out);
 
         /* Print everything within the s-expression. */
         for (i = 0; i < value -> len_cyvals; i++) {
-                print_cyval(value -> cyvals[i]);
+                print_cyval(value -> cyvals[i], out);
 
                 if (i != (value -> len_cyvals - 1))
-                        putchar(' ');
+                        fputc(' ', out);
         }
 
-        putchar(ending);
+        fputc(ending, out);
 }
 
 /*
- * Purpoes:    Print a cyval pointed to by the given pointer.
- * Parameters: A pointer to a cyval to print from.
+ * Purpose:    Print a cyval that is not an S-expression or Q-expression.
+ * Parameters: A pointer to a cyval to print from and a FILE pointer to
+ *             print to.
  * Return:     Void
  */
-void print_cyval(cyval* value) {
-        if (value -> data_type == CYVAL_NUM)
-                printf("%li", value -> num);
-        else if (value -> data_type == CYVAL_ERROR)
-                printf("Error: %s", value -> error);
-        else if (value -> data_type == CYVAL_SYM)
-                printf("%s", value -> sym);
-        else if (value -> data_type == CYVAL_Q_EXP)
-                print_cyval_exp(value, '{', '}');
-        else if (value -> data_type == CYVAL_S_EXP)
-                print_cyval_exp(value, '(', ')');
+static void print_cyval_leaf(cyval* value, FILE* out) {
+        int type = CY_TYPE(value);
+        int i;
+        char* digits;
+
+        if (type == CYVAL_NUM) {
+                fprintf(out, "%li", CY_NUM_OF(value));
+        } else if (type == CYVAL_BIG) {
+                digits = cybig_to_str(&value -> big);
+                fputs(digits, out);
+                free(digits);
+        } else if (type == CYVAL_NUMS) {
+                fputc('[', out);
+                for (i = 0; i < value -> nums -> len; i++)
+                        fprintf(out, i > 0 ? " %li" : "%li",
+                                value -> nums -> items[i]);
+                fputc(']', out);
+        } else if (type == CYVAL_ERROR)
+                fprintf(out, "Error: %s", value -> error);
+        else if (type == CYVAL_SYM)
+                fputs(cysym_name(CY_SYM_OF(value)), out);
+        else if (type == CYVAL_FUN)
+                fprintf(out, "<builtin %s>", cysym_name(CY_FUN_OF(value)));
+}
+
+/*
+ * Purpoes:    Print a cyval pointed to by the given pointer. Expressions
+ *             being printed are kept on a stack instead of the C stack, so
+ *             nesting depth is limited only by memory.
+ * Parameters: A pointer to a cyval to print from and a FILE pointer to
+ *             print to.
+ * Return:     Void
+ */
+void print_cyval(cyval* value, FILE* out) {
+        int base = cyprint_len_frames;
+        int type;
+        cyprintframe* top = NULL;
+
+        for (;;) {
+                type = CY_TYPE(value);
+                if (type == CYVAL_S_EXP || type == CYVAL_Q_EXP) {
+                        fputc(type == CYVAL_S_EXP ? '(' : '{', out);
+                        if (cyprint_len_frames == cyprint_cap_frames) {
+                                cyprint_cap_frames = cyprint_cap_frames ?
+                                                     cyprint_cap_frames * 2 :
+                                                     CYVAL_MIN_SLOTS;
+                                cyprint_frames = realloc(cyprint_frames,
+                                                 sizeof(cyprintframe) *
+                                                 cyprint_cap_frames);
+                        }
+                        cyprint_frames[cyprint_len_frames].value = value;
+                        cyprint_frames[cyprint_len_frames].next = 0;
+                        cyprint_len_frames++;
+                } else {
+                        print_cyval_leaf(value, out);
+                }
+
+                /* Close the expressions whose children have all printed. */
+                while (cyprint_len_frames > base) {
+                        top = &cyprint_frames[cyprint_len_frames - 1];
+                        if (top -> next < top -> value -> len_cyvals)
+                                break;
+                        fputc(CY_TYPE(top -> value) == CYVAL_S_EXP ?
+                              ')' : '}', out);
+                        cyprint_len_frames--;
+                }
+                if (cyprint_len_frames == base)
+                        return;
+                if (top -> next > 0)
+                        fputc(' ', out);
+                value = top -> value -> cyvals[top -> next++];
+        }
 }
 
 /*
  * Purpose:    Print the cyval pointed to by the given cyval pointer
  *             with a newline char at the end.
- * Parameters: A pointer to a cyval to print.
+ * Parameters: A pointer to a cyval to print and a FILE pointer to print
+ *             to.
  * Return:     Void
  */
-void print_cyval_endl(cyval* value) {
-        print_cyval(value);
-        putchar('\n');
+void print_cyval_endl(cyval* value, FILE* out) {
+        print_cyval(value, out);
+        fputc('\n', out);
 }
 
 /*
@@ -287,14 +885,21 @@ cyval* cyval_read_tree(mpc_ast_t* node) {
  */
 cyval* cyval_read_node(mpc_ast_t* node) {
         long num;
+        cybig big;
+        char* digits = node -> contents;
 
         errno = 0;
-        num = strtol(node -> contents, NULL, 10);
+        num = strtol(digits, NULL, 10);
 
         if (errno != ERANGE)
                 return cyval_num(num);
-        else
-                return cyval_error("Invalid number");
+        /* Read numbers too large for a long as big numbers. */
+        if (*digits == '-') {
+                cybig_from_digits(&big, digits + 1, strlen(digits + 1), 1);
+                return cyval_big(&big);
+        }
+        cybig_from_digits(&big, digits, strlen(digits), 0);
+        return cyval_big(&big);
 }
 
 /*
@@ -307,49 +912,58 @@ cyval* cyval_read_node(mpc_ast_t* node) {
  *             pointers.
  */
 cyval* cyval_add(cyval* value, cyval* to_add) {
-        /* Increase amt of pointers stored and allocate space accordingly. */
         if (value == NULL)
         	return NULL;
-        value -> len_cyvals++;
-        value -> cyvals = realloc(value -> cyvals,
-                                    sizeof(cyval*) * value -> len_cyvals);
-        /* Add the given cyval pointer to the list. */
-        value -> cyvals[value -> len_cyvals - 1] = to_add;
+        /* Make room for one more pointer, then add it to the list. */
+        cyval_reserve(value, 1);
+        value -> cyvals[value -> len_cyvals++] = to_add;
+        value -> vec -> hi++;
         return value;
 }
 
 /*
- * Purpose:    Evaluate a cyval s-expression pointed to by the given pointer.
- * Parameters: A pointer pointing to a cyval s-expression.
- * Return:     A cyval pointer pointing to the evaluated result.
+ * Purpose:    Ensure a given cyval's list of cyval pointers has room for at
+ *             least the given number of additional pointers, growing its
+ *             capacity geometrically. The list is made the cyval's own.
+ * Parameters: A pointer to a cyval with a list of cyval pointers and an int
+ *             number of pointers about to be added.
+ * Return:     Void
  */
-cyval* cyval_evaluate_s_exp(cyval* value) {
-        int i;
-        cyval* first;
-        cyval* result;
-        /* Evaluate children of the given cyval s-expression. */
-        for (i = 0; i < value -> len_cyvals; i++)
-                value -> cyvals[i] = cyval_evaluate(value -> cyvals[i]);
-        /* Check for errors in the given cyval s-expression. */
-        for (i = 0; i < value -> len_cyvals; i++)
-                if(value -> cyvals[i] -> data_type == CYVAL_ERROR)
-                        return cyval_take(value, i);
-        /* Check for s-expression with either zero elements or one element. */
-        if (value -> len_cyvals == 0)
-                return value;
-        if (value -> len_cyvals == 1)
-                return cyval_take(value, 0);
-        /* Check if the first element in s-expression is a symbol. */
-        first = cyval_pop(value, 0);
-        if (first -> data_type != CYVAL_SYM) {
-                cyval_destructor(first);
-                cyval_destructor(value);
-                return cyval_error("S-expression doesn't start with symbol");
+void cyval_reserve(cyval* value, int extra) {
+        int needed = value -> len_cyvals + extra;
+        int cap;
+        cyvec* vec;
+
+        if (value -> vec == NULL) {
+                value -> vec = cyvec_new(needed > 4 ? needed : 4);
+                value -> off_cyvals = 0;
+                value -> cyvals = value -> vec -> items;
+                return;
         }
-        /* Call the builtin operator or function. */
-        result = builtins(value, first -> sym);
-        cyval_destructor(first);
-        return result;
+        cyval_own(value);
+        vec = value -> vec;
+        if (value -> off_cyvals + needed <= vec -> cap)
+                return;
+        /*
+         * Slide the live pointers back to the start if popping from the
+         * front has freed at least as many slots as are in use, and grow
+         * the vector only if that still leaves too little room.
+         */
+        if (value -> off_cyvals >= value -> len_cyvals) {
+                memmove(vec -> items, value -> cyvals,
+                        sizeof(cyval*) * value -> len_cyvals);
+                value -> off_cyvals = vec -> lo = 0;
+                vec -> hi = value -> len_cyvals;
+        }
+        if (value -> off_cyvals + needed > vec -> cap) {
+                cap = vec -> cap * 2;
+                if (cap < value -> off_cyvals + needed)
+                        cap = value -> off_cyvals + needed;
+                vec = realloc(vec, sizeof(cyvec) + sizeof(cyval*) * cap);
+                vec -> cap = cap;
+                value -> vec = vec;
+        }
+        value -> cyvals = vec -> items + value -> off_cyvals;
 }
 
 /*
@@ -362,18 +976,49 @@ cyval* cyval_evaluate_s_exp(cyval* value) {
  */
 cyval* cyval_pop(cyval* value, int i) {
         cyval* extracted;
+        int last = value -> len_cyvals - 1;
+
+        /*
+         * The ends of a shared list are popped by copying the child and
+         * narrowing this cyval's view. Anything else needs the list to be
+         * the cyval's own.
+         */
+        if (value -> vec -> refs > 1 && (i == 0 || i == last)) {
+                extracted = cyval_copy(value -> cyvals[i]);
+                if (i == 0) {
+                        value -> cyvals++;
+                        value -> off_cyvals++;
+                }
+                value -> len_cyvals--;
+                return extracted;
+        }
+        cyval_own(value);
 
         extracted = value -> cyvals[i];
-
-        /* Shift memory over to remove the extracted cyval pointer. */
-        memmove(&value -> cyvals[i], 
-                    &value -> cyvals[i + 1],
-                    sizeof(cyval*) * (value -> len_cyvals - i - 1));
         value -> len_cyvals--;
 
-        /* Reallocate the memory. */
-        value -> cyvals = realloc(value -> cyvals,
-                                    sizeof(cyval*) * value -> len_cyvals);
+        /*
+         * Popping the front only advances the start of the list, and
+         * popping the back only shortens it. Anything else shifts the
+         * pointers after i over the extracted one.
+         */
+        if (i == 0) {
+                value -> cyvals++;
+                value -> off_cyvals++;
+                value -> vec -> lo++;
+        } else {
+                if (i < value -> len_cyvals)
+                        memmove(&value -> cyvals[i],
+                                &value -> cyvals[i + 1],
+                                sizeof(cyval*) * (value -> len_cyvals - i));
+                value -> vec -> hi--;
+        }
+        /* Reuse the vector from the start once the list empties. */
+        if (value -> len_cyvals == 0) {
+                value -> cyvals = value -> vec -> items;
+                value -> off_cyvals = value -> vec -> lo = 0;
+                value -> vec -> hi = 0;
+        }
 
         return extracted;
 }
@@ -397,129 +1042,974 @@ cyval* cyval_take(cyval* value, int i) {
         return extracted;
 }
 
+/*
+ * Dispatch table of builtin functions, indexed by the interned symbol id
+ * of the builtin's name (see choccysym.h).
+ */
+static const cybuiltin builtin_table[CYSYM_BUILTINS] = {
+        builtin_list, builtin_head, builtin_tail, builtin_join, builtin_eval,
+        builtin_add, builtin_sub, builtin_mul, builtin_div, builtin_mod,
+        builtin_pow, builtin_def, builtin_put, builtin_vec, builtin_sum,
+        builtin_min, builtin_max, builtin_dot, builtin_memo, builtin_eq,
+        builtin_ne, builtin_map, builtin_filter, builtin_fold,
+        builtin_save_image, builtin_serialize, builtin_deserialize
+};
+
 /*
  * Purpose:    Call a builtin function or operator.
- * Parameters: A cyval to call with and a C-string operator or function name.
+ * Parameters: A pointer to the cyenv to call in, a cyval to call with and
+ *             an int interned symbol id naming the operator or function.
  * Return:     A cyval with the operation result.
  */
-cyval* builtins(cyval* value, char* func) {
-        if (strcmp("head", func) == 0)
-                return builtin_head(value);
-        else if (strcmp("tail", func) == 0)
-                return builtin_tail(value);
-        else if (strcmp("list", func) == 0)
-                return builtin_list(value);
-        else if (strcmp("join", func) == 0)
-                return builtin_join(value);
-        else if (strcmp("eval", func) == 0)
-                return builtin_eval(value);
-        else if (strstr("+-/*%^", func))
-                return builtin_ops(value, func);
+cyval* builtins(cyenv* env, cyval* value, int func) {
+        if (func >= 0 && func < CYSYM_BUILTINS)
+                return builtin_table[func](env, value);
 
         cyval_destructor(value);
 
         return cyval_error("Unknown function");
 }
 
+/*
+ * Purpose:    Bind every builtin function to its name in a scope.
+ * Parameters: A pointer to a cyenv, normally the global scope.
+ * Return:     Void
+ */
+void cyenv_add_builtins(cyenv* env) {
+        int i;
+
+        for (i = 0; i < CYSYM_BUILTINS; i++)
+                cyenv_put(env, i, CY_MAKE_FUN(i));
+}
+
+/*
+ * Purpose:    Apply an operator to two longs, checking for overflow.
+ * Parameters: An int interned symbol id of the operator, two long operands
+ *             and a pointer to a long to store the result in. The divisor
+ *             must be nonzero and the exponent must not be negative.
+ * Return:     1 if the result fits in a long and was stored, or 0 if the
+ *             operation overflows.
+ */
+static int builtin_ops_long(int ops, long a, long b, long* out) {
+        long base = a;
+        long result = 1;
+
+        if (ops == CYSYM_ADD)
+                return !__builtin_add_overflow(a, b, out);
+        else if (ops == CYSYM_SUB)
+                return !__builtin_sub_overflow(a, b, out);
+        else if (ops == CYSYM_MUL)
+                return !__builtin_mul_overflow(a, b, out);
+        /* LONG_MIN / -1 is the only quotient that can overflow. */
+        if (ops == CYSYM_DIV) {
+                if (a == LONG_MIN && b == -1)
+                        return 0;
+                *out = a / b;
+                return 1;
+        }
+        if (ops == CYSYM_MOD) {
+                *out = (b == -1) ? 0 : a % b;
+                return 1;
+        }
+        /* Raise to a power by repeated squaring. */
+        while (b > 0) {
+                if ((b & 1) && __builtin_mul_overflow(result, base, &result))
+                        return 0;
+                b >>= 1;
+                if (b > 0 && __builtin_mul_overflow(base, base, &base))
+                        return 0;
+        }
+        *out = result;
+        return 1;
+}
+
+/*
+ * Purpose:    Apply an operator to a cybig and a cyval number in place.
+ * Parameters: An int interned symbol id of the operator, a pointer to the
+ *             cybig left operand to replace with the result and a pointer
+ *             to a cyval number right operand. The divisor must be nonzero
+ *             and the exponent must be a non-negative long.
+ * Return:     Void
+ */
+static void builtin_ops_big(int ops, cybig* acc, cyval* arg) {
+        cybig num;
+        cybig out;
+        const cybig* b = &num;
+
+        if (CY_TYPE(arg) == CYVAL_BIG)
+                b = &arg -> big;
+        else
+                cybig_from_long(&num, CY_NUM_OF(arg));
+
+        if (ops == CYSYM_ADD)
+                cybig_add(&out, acc, b);
+        else if (ops == CYSYM_SUB)
+                cybig_sub(&out, acc, b);
+        else if (ops == CYSYM_MUL)
+                cybig_mul(&out, acc, b);
+        else if (ops == CYSYM_DIV)
+                cybig_divmod(&out, NULL, acc, b);
+        else if (ops == CYSYM_MOD)
+                cybig_divmod(NULL, &out, acc, b);
+        else
+                cybig_pow(&out, acc, (unsigned long) CY_NUM_OF(arg));
+
+        if (b == &num)
+                cybig_free(&num);
+        cybig_free(acc);
+        *acc = out;
+}
+
+/*
+ * Purpose:    Operates element-wise on arguments that include at least one
+ *             numeric vector, using each plain number for every element.
+ * Parameters: A cyval s-expression pointer containing arguments, each a
+ *             number or a numeric vector, and an int interned symbol id of
+ *             the operator.
+ * Return:     A pointer to a cyval numeric vector, or to an error.
+ */
+static cyval* builtin_ops_nums(cyval* value, int ops) {
+        int i;
+        int len = -1;
+        int step;
+        int status = CYNUMS_OK;
+        long num = 0;
+        long next;
+        const long* b;
+        cyval* arg;
+        cynums* acc = NULL;
+        cynums* out;
+
+        CY_ASSERT(value, (ops != CYSYM_MOD && ops != CYSYM_POW),
+                  "Operator not supported for vectors");
+        /* Check the vectors agree in length and every number fits. */
+        for (i = 0; i < value -> len_cyvals; i++) {
+                arg = value -> cyvals[i];
+                CY_ASSERT(value, (CY_TYPE(arg) != CYVAL_BIG),
+                          "Number too large for a vector");
+                if (CY_TYPE(arg) != CYVAL_NUMS)
+                        continue;
+                if (len < 0)
+                        len = arg -> nums -> len;
+                CY_ASSERT(value, (arg -> nums -> len == len),
+                          "Vector lengths differ");
+        }
+        /* Read the first element, negating it if it is the only one. */
+        arg = value -> cyvals[0];
+        if (CY_TYPE(arg) == CYVAL_NUMS) {
+                acc = cynums_retain(arg -> nums);
+        } else {
+                num = CY_NUM_OF(arg);
+        }
+        if (ops == CYSYM_SUB && value -> len_cyvals == 1) {
+                out = cynums_fill(len, 0);
+                status = cynums_sub(out -> items, out -> items,
+                                    acc -> items, 1, len);
+                cynums_release(acc);
+                acc = out;
+        }
+        for (i = 1; i < value -> len_cyvals && status == CYNUMS_OK; i++) {
+                arg = value -> cyvals[i];
+                /* Numbers before the first vector combine as numbers. */
+                if (acc == NULL && CY_TYPE(arg) == CYVAL_NUM) {
+                        if (builtin_ops_long(ops, num, CY_NUM_OF(arg), &next))
+                                num = next;
+                        else
+                                status = CYNUMS_OVERFLOW;
+                        continue;
+                }
+                if (acc == NULL)
+                        acc = cynums_fill(len, num);
+                if (CY_TYPE(arg) == CYVAL_NUMS) {
+                        b = arg -> nums -> items;
+                        step = 1;
+                } else {
+                        next = CY_NUM_OF(arg);
+                        b = &next;
+                        step = 0;
+                }
+                /* Work in place once the vector is this call's alone. */
+                out = cynums_unshared(acc) ? acc : cynums_new(len);
+                if (ops == CYSYM_ADD)
+                        status = cynums_add(out -> items, acc -> items, b,
+                                            step, len);
+                else if (ops == CYSYM_SUB)
+                        status = cynums_sub(out -> items, acc -> items, b,
+                                            step, len);
+                else if (ops == CYSYM_MUL)
+                        status = cynums_mul(out -> items, acc -> items, b,
+                                            step, len);
+                else
+                        status = cynums_div(out -> items, acc -> items, b,
+                                            step, len);
+                if (out != acc)
+                        cynums_release(acc);
+                acc = out;
+        }
+        cyval_destructor(value);
+
+        if (status != CYNUMS_OK) {
+                cynums_release(acc);
+                if (status == CYNUMS_DIV_ZERO)
+                        return cyval_error("Division by zero");
+                return cyval_error("Vector element overflow");
+        }
+        return cyval_nums(acc);
+}
+
 /*
  * Purpose:    Operates on a given cyval representing arguments using the
- *             given c-string operator.
- * Parameters: A cyval s-expression pointer containing arguments to
- *             operate on and a given c-string operator.
+ *             given operator. Arithmetic is done on longs until a result
+ *             overflows, then on big numbers until a result fits in a long
+ *             again.
+ * Parameters: A pointer to the cyenv called in, a cyval s-expression
+ *             pointer containing arguments to operate on and an int interned
+ *             symbol id of the operator.
  * Return:     A pointer to a cyval containing the result of operating.
  */
-cyval* builtin_ops(cyval* value, char* ops) {
+cyval* builtin_ops(cyenv* env, cyval* value, int ops) {
         int i;
-        cyval* extract;
-        cyval* next;
+        int type;
+        int big = 0;
+        int vector = 0;
+        long result = 0;
+        long next;
+        cyval* arg;
+        cybig acc;
+
+        (void) env;
         /* Check if all arguments in the s-expression are valid numbers. */
-        for (i = 0; i < value -> len_cyvals; i++)
-                if (value -> cyvals[i] -> data_type != CYVAL_NUM) {
+        for (i = 0; i < value -> len_cyvals; i++) {
+                arg = value -> cyvals[i];
+                type = CY_TYPE(arg);
+                if (type != CYVAL_NUM && type != CYVAL_BIG &&
+                    type != CYVAL_NUMS) {
                         cyval_destructor(value);
                         return cyval_error(
                                 "Non-number passed as operation argument");
                 }
-        /* Extract the first element. */
-        extract = cyval_pop(value, 0);
+                if (type == CYVAL_NUMS)
+                        vector = 1;
+                if (i == 0 || type == CYVAL_NUMS)
+                        continue;
+                /* Big numbers are never zero or negative exponents. */
+                if ((ops == CYSYM_DIV || ops == CYSYM_MOD) &&
+                    type == CYVAL_NUM && CY_NUM_OF(arg) == 0) {
+                        cyval_destructor(value);
+                        return cyval_error("Division by zero");
+                }
+                if (ops == CYSYM_POW && type == CYVAL_BIG) {
+                        cyval_destructor(value);
+                        return cyval_error("Exponent too large");
+                }
+                if (ops == CYSYM_POW && CY_NUM_OF(arg) < 0) {
+                        cyval_destructor(value);
+                        return cyval_error("Negative exponent");
+                }
+        }
+        if (vector)
+                return builtin_ops_nums(value, ops);
+        /* Read the first element. */
+        arg = value -> cyvals[0];
+        if (CY_TYPE(arg) == CYVAL_BIG) {
+                cybig_copy(&acc, &arg -> big);
+                big = 1;
+        } else {
+                result = CY_NUM_OF(arg);
+        }
         /* If subtracting with no additonal arguments, negate the number. */
-        if ((strcmp(ops, "-") == 0) && (value -> len_cyvals == 0))
-                extract -> num = -(extract -> num);
-        /* Perform operations while arguments remain. */
-        while (value -> len_cyvals > 0) {
-                next = cyval_pop(value, 0);
-                /* Perform operations. */
-                if (strcmp(ops, "+") == 0)
-                        extract -> num += next -> num;
-                else if (strcmp(ops, "-") == 0)
-                        extract -> num -= next -> num;
-                else if (strcmp(ops, "*") == 0)
-                        extract -> num *= next -> num;
-                else if (strcmp(ops, "/") == 0) {
-                        /* Check for division by zero. */
-                        if (next -> num == 0) {
-                                cyval_destructor(extract);
-                                cyval_destructor(next);
-                                extract = cyval_error("Division by zero");
-                                break;
+        if (ops == CYSYM_SUB && value -> len_cyvals == 1) {
+                if (!big && result == LONG_MIN) {
+                        cybig_from_long(&acc, result);
+                        big = 1;
+                }
+                if (big)
+                        acc.sign = -acc.sign;
+                else
+                        result = -result;
+        }
+        /* Perform operations on each remaining argument in place. */
+        for (i = 1; i < value -> len_cyvals; i++) {
+                arg = value -> cyvals[i];
+                /* The result is left alone when the operation overflows. */
+                if (!big && CY_TYPE(arg) == CYVAL_NUM &&
+                    builtin_ops_long(ops, result, CY_NUM_OF(arg), &next)) {
+                        result = next;
+                        continue;
+                }
+                /* Promote the result on overflow or a big argument. */
+                if (!big)
+                        cybig_from_long(&acc, result);
+                builtin_ops_big(ops, &acc, arg);
+                big = !cybig_to_long(&acc, &result);
+                if (!big)
+                        cybig_free(&acc);
+        }
+        cyval_destructor(value);
+        if (big)
+                return cyval_big(&acc);
+        return cyval_num(result);
+}
+
+/*
+ * Purpose:    Built-in operators "+", "-", "*", "/", "%" and "^", each
+ *             calling builtin_ops with its own operator.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval containing the result of operating.
+ */
+cyval* builtin_add(cyenv* env, cyval* value) {
+        return builtin_ops(env, value, CYSYM_ADD);
+}
+
+cyval* builtin_sub(cyenv* env, cyval* value) {
+        return builtin_ops(env, value, CYSYM_SUB);
+}
+
+cyval* builtin_mul(cyenv* env, cyval* value) {
+        return builtin_ops(env, value, CYSYM_MUL);
+}
+
+cyval* builtin_div(cyenv* env, cyval* value) {
+        return builtin_ops(env, value, CYSYM_DIV);
+}
+
+cyval* builtin_mod(cyenv* env, cyval* value) {
+        return builtin_ops(env, value, CYSYM_MOD);
+}
+
+cyval* builtin_pow(cyenv* env, cyval* value) {
+        return builtin_ops(env, value, CYSYM_POW);
+}
+
+/*
+ * Purpose:    A built-in function "vec" that packs a Q-expression of
+ *             numbers into a numeric vector.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             s-expression holding one Q-expression of numbers.
+ * Return:     A pointer to a cyval numeric vector.
+ */
+cyval* builtin_vec(cyenv* env, cyval* value) {
+        int i;
+        cyval* args;
+        cynums* nums;
+
+        (void) env;
+        CY_ASSERT(value, (value -> len_cyvals == 1), "\"vec\" function \
+                  passed too many args");
+        CY_ASSERT(value, (CY_TYPE(value -> cyvals[0]) == CYVAL_Q_EXP),
+                  "\"vec\" function passed incorrect types");
+
+        args = value -> cyvals[0];
+        for (i = 0; i < args -> len_cyvals; i++) {
+                CY_ASSERT(value, (CY_TYPE(args -> cyvals[i]) != CYVAL_BIG),
+                          "\"vec\" function passed a big integer, which "
+                          "cannot be packed into a numeric vector");
+                CY_ASSERT(value, (CY_TYPE(args -> cyvals[i]) == CYVAL_NUM),
+                          "\"vec\" function passed non-number");
+        }
+        nums = cynums_new(args -> len_cyvals);
+        for (i = 0; i < args -> len_cyvals; i++)
+                nums -> items[i] = CY_NUM_OF(args -> cyvals[i]);
+        cyval_destructor(value);
+
+        return cyval_nums(nums);
+}
+
+/*
+ * Purpose:    Build the error for a builtin passed bad arguments, naming
+ *             the builtin.
+ * Parameters: A cyval s-expression pointer containing the arguments, an
+ *             int interned symbol id naming the builtin and a c-string
+ *             describing the problem.
+ * Return:     A pointer to a cyval error.
+ */
+static cyval* builtin_error(cyval* value, int func, const char* problem) {
+        char* name = cysym_name(func);
+        char* msg = malloc(strlen(name) + strlen(problem) +
+                           sizeof("\"\" function "));
+        cyval* error;
+
+        sprintf(msg, "\"%s\" function %s", name, problem);
+        error = cyval_error(msg);
+        free(msg);
+        cyval_destructor(value);
+
+        return error;
+}
+
+/*
+ * Purpose:    Reduce one numeric vector to its sum, minimum or maximum, or
+ *             two to their dot product. Totals too large for a long are
+ *             added up again as big numbers.
+ * Parameters: A pointer to the cyenv called in, a cyval s-expression
+ *             pointer containing the vector arguments and an int interned
+ *             symbol id of the function.
+ * Return:     A pointer to a cyval number.
+ */
+cyval* builtin_reduce(cyenv* env, cyval* value, int func) {
+        int i;
+        int n_args = (func == CYSYM_DOT) ? 2 : 1;
+        long result;
+        cynums* a;
+        cynums* b;
+        cybig total;
+        cybig x;
+        cybig y;
+        cybig sum;
+
+        (void) env;
+        if (value -> len_cyvals != n_args)
+                return builtin_error(value, func,
+                                     "passed wrong number of args");
+        for (i = 0; i < n_args; i++)
+                if (CY_TYPE(value -> cyvals[i]) != CYVAL_NUMS)
+                        return builtin_error(value, func,
+                                             "passed incorrect types");
+        a = value -> cyvals[0] -> nums;
+        b = value -> cyvals[n_args - 1] -> nums;
+        if (a -> len != b -> len)
+                return builtin_error(value, func,
+                                     "passed vectors of different lengths");
+        if ((func == CYSYM_MIN || func == CYSYM_MAX) && a -> len == 0)
+                return builtin_error(value, func, "passed empty vector");
+
+        if (func == CYSYM_MIN) {
+                result = cynums_min(a -> items, a -> len);
+        } else if (func == CYSYM_MAX) {
+                result = cynums_max(a -> items, a -> len);
+        } else if (!(func == CYSYM_SUM ?
+                     cynums_sum(a -> items, a -> len, &result) :
+                     cynums_dot(a -> items, b -> items, a -> len, &result))) {
+                /* The total overflowed a long, so add it up exactly. */
+                cybig_from_long(&total, 0);
+                for (i = 0; i < a -> len; i++) {
+                        cybig_from_long(&x, a -> items[i]);
+                        if (func == CYSYM_DOT) {
+                                cybig_from_long(&y, b -> items[i]);
+                                cybig_mul(&sum, &x, &y);
+                                cybig_free(&x);
+                                cybig_free(&y);
+                                x = sum;
                         }
-                        extract -> num /= next -> num;
+                        cybig_add(&sum, &total, &x);
+                        cybig_free(&total);
+                        cybig_free(&x);
+                        total = sum;
+                }
+                cyval_destructor(value);
+                return cyval_big(&total);
+        }
+        cyval_destructor(value);
+
+        return cyval_num(result);
+}
+
+/*
+ * Purpose:    Built-in functions "sum", "min", "max" and "dot", each
+ *             calling builtin_reduce with its own function.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval number.
+ */
+cyval* builtin_sum(cyenv* env, cyval* value) {
+        return builtin_reduce(env, value, CYSYM_SUM);
+}
+
+cyval* builtin_min(cyenv* env, cyval* value) {
+        return builtin_reduce(env, value, CYSYM_MIN);
+}
+
+cyval* builtin_max(cyenv* env, cyval* value) {
+        return builtin_reduce(env, value, CYSYM_MAX);
+}
+
+cyval* builtin_dot(cyenv* env, cyval* value) {
+        return builtin_reduce(env, value, CYSYM_DOT);
+}
+
+/*
+ * Purpose:    Compare two values by structure, in constant time when they
+ *             share their children or are hash-consed (see choccycons.h).
+ * Parameters: A pointer to the cyenv called in, a cyval s-expression
+ *             pointer containing the two values and an int interned symbol
+ *             id of the function, CYSYM_EQ or CYSYM_NE.
+ * Return:     A pointer to a cyval number, 1 if the comparison holds or 0
+ *             otherwise.
+ */
+cyval* builtin_cmp(cyenv* env, cyval* value, int func) {
+        int equal;
+
+        (void) env;
+        if (value -> len_cyvals != 2)
+                return builtin_error(value, func,
+                                     "passed wrong number of args");
+        equal = cyval_equal(value -> cyvals[0], value -> cyvals[1]);
+        cyval_destructor(value);
+
+        return cyval_num(func == CYSYM_EQ ? equal : !equal);
+}
+
+/*
+ * Purpose:    Built-in functions "==" and "!=", each calling builtin_cmp
+ *             with its own function.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval number.
+ */
+cyval* builtin_eq(cyenv* env, cyval* value) {
+        return builtin_cmp(env, value, CYSYM_EQ);
+}
+
+cyval* builtin_ne(cyenv* env, cyval* value) {
+        return builtin_cmp(env, value, CYSYM_NE);
+}
+
+/*
+ * Purpose:    Build a call to a function passed to "map", "filter" or
+ *             "fold": a builtin, or a Q-expression whose children begin the
+ *             call, like a function already given its first arguments.
+ * Parameters: A pointer to the cyval function, which is copied, and
+ *             pointers to one or two cyval arguments, the second NULL if
+ *             there is only one.
+ * Return:     A pointer to a cyval S-expression.
+ */
+static cyval* builtin_call(cyval* fn, cyval* a, cyval* b) {
+        cyval* call;
+
+        if (CY_TYPE(fn) == CYVAL_Q_EXP) {
+                call = cyval_copy(fn);
+                call -> data_type = CYVAL_S_EXP;
+        } else {
+                call = cyval_add(cyval_s_exp(), fn);
+        }
+        cyval_add(call, a);
+        if (b != NULL)
+                cyval_add(call, b);
+        return call;
+}
+
+/*
+ * Purpose:    Call a function on each element of a list, with the calls
+ *             split into chunks that the thread pool, if it is running,
+ *             evaluates side by side (see choccypar.h).
+ * Parameters: A pointer to the cyenv to evaluate in, a pointer to the
+ *             cyval function and a pointer to the cyval Q-expression list.
+ * Return:     A pointer to a cyval Q-expression of the results in order,
+ *             or the first error.
+ */
+static cyval* builtin_each(cyenv* env, cyval* fn, cyval* list) {
+        int i;
+        int len = list -> len_cyvals;
+        int chunks = cypar_chunks(len);
+        int size = (len + chunks - 1) / chunks;
+        cyval* expr;
+        cyval* chunk = NULL;
+
+        if (len == 0)
+                return cyval_q_exp();
+
+        /* Build (join (list (fn x0) (fn x1) ...) (list ...) ...). */
+        expr = cyval_add(cyval_s_exp(), CY_MAKE_FUN(CYSYM_JOIN));
+        for (i = 0; i < len; i++) {
+                if (i % size == 0) {
+                        chunk = cyval_add(cyval_s_exp(),
+                                          CY_MAKE_FUN(CYSYM_LIST));
+                        cyval_add(expr, chunk);
+                }
+                cyval_add(chunk, builtin_call(fn, cyval_copy(list ->
+                                                             cyvals[i]),
+                                              NULL));
+        }
+        return cyval_evaluate(env, cypar_expr(env, expr));
+}
+
+/*
+ * Purpose:    Keep the elements of a list whose results from "filter"'s
+ *             predicate are numbers other than 0.
+ * Parameters: A pointer to the cyval Q-expression list and a pointer to a
+ *             cyval Q-expression holding one result per element, or an
+ *             error, which is consumed.
+ * Return:     A pointer to a cyval Q-expression of the elements kept, or
+ *             an error.
+ */
+static cyval* builtin_keep(cyval* list, cyval* results) {
+        int i;
+        int type;
+        cyval* kept;
+
+        if (CY_TYPE(results) == CYVAL_ERROR)
+                return results;
+        kept = cyval_q_exp();
+        for (i = 0; i < results -> len_cyvals; i++) {
+                type = CY_TYPE(results -> cyvals[i]);
+                if (type != CYVAL_NUM && type != CYVAL_BIG) {
+                        cyval_destructor(kept);
+                        cyval_destructor(results);
+                        return cyval_error("\"filter\" function passed "
+                                           "predicate returning non-number");
                 }
-                cyval_destructor(next);
+                if (type == CYVAL_BIG || CY_NUM_OF(results -> cyvals[i]))
+                        kept = cyval_add(kept, cyval_copy(list ->
+                                                          cyvals[i]));
+        }
+        cyval_destructor(results);
+
+        return kept;
+}
+
+/*
+ * Purpose:    Combine the elements of a list with a function, starting
+ *             from an initial value. Neighbouring elements are paired up
+ *             into a balanced tree of calls, so the thread pool, if it is
+ *             running, can combine separate halves side by side; the
+ *             order of the elements is kept, but the function must be
+ *             associative for the grouping not to matter.
+ * Parameters: A pointer to the cyenv to evaluate in, a pointer to the
+ *             cyval function, a pointer to the cyval initial value and a
+ *             pointer to the cyval Q-expression list.
+ * Return:     A pointer to the combined cyval.
+ */
+static cyval* builtin_combine(cyenv* env, cyval* fn, cyval* init,
+                              cyval* list) {
+        int i;
+        int len = list -> len_cyvals;
+        cyval** trees;
+        cyval* expr;
+
+        if (len == 0)
+                return cyval_copy(init);
+        trees = malloc(sizeof(cyval*) * len);
+        for (i = 0; i < len; i++)
+                trees[i] = cyval_copy(list -> cyvals[i]);
+        /* Pair up neighbouring trees until one is left. */
+        while (len > 1) {
+                for (i = 0; i + 1 < len; i += 2)
+                        trees[i / 2] = builtin_call(fn, trees[i],
+                                                    trees[i + 1]);
+                if (i < len)
+                        trees[i / 2] = trees[i];
+                len = (len + 1) / 2;
+        }
+        expr = builtin_call(fn, cyval_copy(init), trees[0]);
+        free(trees);
+
+        return cyval_evaluate(env, cypar_expr(env, expr));
+}
+
+/*
+ * Purpose:    Unpack a numeric vector into a list of its numbers, so "map",
+ *             "filter" and "fold" can walk it as they walk a Q-expression.
+ * Parameters: A pointer to a cynums, which is not consumed.
+ * Return:     A pointer to a cyval Q-expression.
+ */
+static cyval* builtin_unpack(cynums* nums) {
+        int i;
+        cyval* list = cyval_q_exp();
+
+        cyval_reserve(list, nums -> len);
+        for (i = 0; i < nums -> len; i++)
+                cyval_add(list, cyval_num(nums -> items[i]));
+        return list;
+}
+
+/*
+ * Purpose:    Pack the results of "map" or "filter" over a numeric vector
+ *             back into a numeric vector.
+ * Parameters: A pointer to a cyval Q-expression of results or an error,
+ *             which is consumed, and an int interned symbol id of the
+ *             function, CYSYM_MAP or CYSYM_FILTER.
+ * Return:     A pointer to a cyval numeric vector, or an error.
+ */
+static cyval* builtin_pack(cyval* results, int func) {
+        int i;
+        cynums* nums;
+
+        if (CY_TYPE(results) == CYVAL_ERROR)
+                return results;
+        for (i = 0; i < results -> len_cyvals; i++)
+                if (CY_TYPE(results -> cyvals[i]) != CYVAL_NUM)
+                        return builtin_error(results, func,
+                                             "passed function returning a "
+                                             "value that cannot be packed "
+                                             "into a numeric vector");
+        nums = cynums_new(results -> len_cyvals);
+        for (i = 0; i < results -> len_cyvals; i++)
+                nums -> items[i] = CY_NUM_OF(results -> cyvals[i]);
+        cyval_destructor(results);
+
+        return cyval_nums(nums);
+}
+
+/*
+ * Purpose:    Apply a function, a builtin or a Q-expression beginning a
+ *             call, to the elements of a list: to each one for "map" and
+ *             "filter", or to combine them all for "fold". Each element is
+ *             passed as if it were written in the call, and large lists
+ *             are evaluated on the thread pool if it is running. The list
+ *             may also be a numeric vector, whose numbers are passed one
+ *             by one, and then "map" and "filter" give a numeric vector.
+ * Parameters: A pointer to the cyenv to evaluate in, a cyval s-expression
+ *             pointer containing the function, the initial value for
+ *             "fold" and the list, and an int interned symbol id of the
+ *             function, CYSYM_MAP, CYSYM_FILTER or CYSYM_FOLD.
+ * Return:     A pointer to a cyval Q-expression or numeric vector of
+ *             results for "map" or of the elements kept for "filter", the
+ *             combined cyval for "fold", or the first error.
+ */
+cyval* builtin_apply(cyenv* env, cyval* value, int func) {
+        int n_args = (func == CYSYM_FOLD) ? 3 : 2;
+        int packed;
+        cyval* fn;
+        cyval* list;
+        cyval* result;
+
+        if (value -> len_cyvals != n_args)
+                return builtin_error(value, func,
+                                     "passed wrong number of args");
+        fn = value -> cyvals[0];
+        list = value -> cyvals[n_args - 1];
+        packed = CY_TYPE(list) == CYVAL_NUMS;
+        if ((!CY_IS_FUN(fn) && CY_TYPE(fn) != CYVAL_Q_EXP) ||
+            (CY_TYPE(list) != CYVAL_Q_EXP && !packed))
+                return builtin_error(value, func, "passed incorrect types");
+        if (packed)
+                list = builtin_unpack(list -> nums);
+
+        if (func == CYSYM_FOLD)
+                result = builtin_combine(env, fn, value -> cyvals[1], list);
+        else if (func == CYSYM_FILTER)
+                result = builtin_keep(list, builtin_each(env, fn, list));
+        else
+                result = builtin_each(env, fn, list);
+        if (packed && func != CYSYM_FOLD)
+                result = builtin_pack(result, func);
+        if (packed)
+                cyval_destructor(list);
+        cyval_destructor(value);
+
+        return result;
+}
+
+/*
+ * Purpose:    Built-in functions "map", "filter" and "fold", each calling
+ *             builtin_apply with its own function.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval result.
+ */
+cyval* builtin_map(cyenv* env, cyval* value) {
+        return builtin_apply(env, value, CYSYM_MAP);
+}
+
+cyval* builtin_filter(cyenv* env, cyval* value) {
+        return builtin_apply(env, value, CYSYM_FILTER);
+}
+
+cyval* builtin_fold(cyenv* env, cyval* value) {
+        return builtin_apply(env, value, CYSYM_FOLD);
+}
+
+/*
+ * Purpose:    Tell whether an argument names a file, as a Q-expression of
+ *             one symbol, since Choccy has no strings.
+ * Parameters: A pointer to a cyval argument.
+ * Return:     1 if the argument names a file, or 0 otherwise.
+ */
+static int builtin_is_path(cyval* arg) {
+        return CY_TYPE(arg) == CYVAL_Q_EXP && arg -> len_cyvals == 1 &&
+               CY_IS_SYM(arg -> cyvals[0]);
+}
+
+/*
+ * Purpose:    Construct an error for a builtin that could not use a file.
+ * Parameters: A cyval s-expression pointer of the call's arguments, which
+ *             is consumed, an int interned symbol id of the function, a
+ *             c-string "read" or "write", the c-string path of the file
+ *             and a c-string describing the problem.
+ * Return:     A pointer to a cyval error.
+ */
+static cyval* builtin_file_error(cyval* value, int func, const char* verb,
+                                 const char* path, const char* problem) {
+        char* msg = malloc(strlen(verb) + strlen(path) + strlen(problem) +
+                           sizeof("cannot  : "));
+        cyval* error;
+
+        sprintf(msg, "cannot %s %s: %s", verb, path, problem);
+        error = builtin_error(value, func, msg);
+        free(msg);
+
+        return error;
+}
+
+/*
+ * Purpose:    A built-in function "save-image" that saves the global scope
+ *             to a heap image file (see choccyimage.h), named by the
+ *             symbol in a Q-expression.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing a Q-expression of one symbol.
+ * Return:     A pointer to an empty cyval S-expression, or an error if the
+ *             image cannot be written.
+ */
+cyval* builtin_save_image(cyenv* env, cyval* value) {
+        char* path;
+        const char* problem;
+
+        if (value -> len_cyvals != 1)
+                return builtin_error(value, CYSYM_SAVE_IMAGE,
+                                     "passed wrong number of args");
+        if (!builtin_is_path(value -> cyvals[0]))
+                return builtin_error(value, CYSYM_SAVE_IMAGE,
+                                     "passed incorrect types");
+
+        path = cysym_name(CY_SYM_OF(value -> cyvals[0] -> cyvals[0]));
+        if ((problem = cyimage_save(env, path)) != NULL)
+                return builtin_file_error(value, CYSYM_SAVE_IMAGE, "write",
+                                          path, problem);
+        cyval_destructor(value);
+
+        return cyval_s_exp();
+}
+
+/*
+ * Purpose:    A built-in function "serialize" that writes a value to a
+ *             file in the binary encoding of choccyser.h, named by the
+ *             symbol in a Q-expression.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing a Q-expression of one symbol and the
+ *             value to write.
+ * Return:     A pointer to an empty cyval S-expression, or an error if the
+ *             file cannot be written.
+ */
+cyval* builtin_serialize(cyenv* env, cyval* value) {
+        int written;
+        char* path;
+        FILE* file;
+        cyser* ser;
+
+        (void) env;
+        if (value -> len_cyvals != 2)
+                return builtin_error(value, CYSYM_SERIALIZE,
+                                     "passed wrong number of args");
+        if (!builtin_is_path(value -> cyvals[0]))
+                return builtin_error(value, CYSYM_SERIALIZE,
+                                     "passed incorrect types");
+
+        path = cysym_name(CY_SYM_OF(value -> cyvals[0] -> cyvals[0]));
+        if ((file = fopen(path, "wb")) == NULL)
+                return builtin_file_error(value, CYSYM_SERIALIZE, "write",
+                                          path, strerror(errno));
+        ser = cyser_writer(file);
+        written = cyser_write(ser, value -> cyvals[1]);
+        cyser_close(ser);
+        if (fclose(file) != 0 || !written)
+                return builtin_file_error(value, CYSYM_SERIALIZE, "write",
+                                          path, strerror(errno));
+        cyval_destructor(value);
+
+        return cyval_s_exp();
+}
+
+/*
+ * Purpose:    A built-in function "deserialize" that reads back a value
+ *             written by "serialize", from a file named by the symbol in a
+ *             Q-expression.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing a Q-expression of one symbol.
+ * Return:     A pointer to the cyval read, or an error if the file cannot
+ *             be read.
+ */
+cyval* builtin_deserialize(cyenv* env, cyval* value) {
+        char* path;
+        FILE* file;
+        cyser* ser;
+        cyval* result;
+
+        (void) env;
+        if (value -> len_cyvals != 1)
+                return builtin_error(value, CYSYM_DESERIALIZE,
+                                     "passed wrong number of args");
+        if (!builtin_is_path(value -> cyvals[0]))
+                return builtin_error(value, CYSYM_DESERIALIZE,
+                                     "passed incorrect types");
+
+        path = cysym_name(CY_SYM_OF(value -> cyvals[0] -> cyvals[0]));
+        if ((file = fopen(path, "rb")) == NULL)
+                return builtin_file_error(value, CYSYM_DESERIALIZE, "read",
+                                          path, strerror(errno));
+        if ((ser = cyser_reader(file)) == NULL) {
+                fclose(file);
+                return builtin_file_error(value, CYSYM_DESERIALIZE, "read",
+                                          path, "not serialized by this "
+                                          "version of Choccy");
         }
+        result = cyser_read(ser);
+        cyser_close(ser);
+        fclose(file);
+        if (result == NULL)
+                return builtin_file_error(value, CYSYM_DESERIALIZE, "read",
+                                          path, "no value in file");
         cyval_destructor(value);
-        return extract;
+
+        return result;
 }
 
 /*
  * Purpose:    A built-in function "head" that returns a Q-expression
  *             with only the first element.
- * Parameters: A pointer to a cyval that is a valid Q-expressions.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             that is a valid Q-expressions.
  * Return:     A pointer to a cyval.
  */
-cyval* builtin_head(cyval* value) {
+cyval* builtin_head(cyenv* env, cyval* value) {
         cyval* args;
+
+        (void) env;
         CY_ASSERT(value, (value -> len_cyvals == 1), "\"head\" function \
                   passed too many args");
-        CY_ASSERT(value, (value -> cyvals[0] -> data_type == CYVAL_Q_EXP),
+        CY_ASSERT(value, (CY_TYPE(value -> cyvals[0]) == CYVAL_Q_EXP),
                   "\"head\" function passed incorrect types");
         CY_ASSERT(value, (value -> cyvals[0] -> len_cyvals != 0),
                   "\"head\" function passed no args");
 
-        /* Get the arguments and destroy all but the last. */
+        /* Get the arguments and keep only the first. */
         args = cyval_take(value, 0);
-        while (args -> len_cyvals > 1)
-                cyval_destructor(cyval_pop(args, 1));
+        cyval_slice(args, 0, 1);
         return args;
 }
 
 /*
  * Purpose:    A built-in function "tail" that returns a Q-expression with
  *             all elements but the first one taken.
- * Parameters: A pointer to a cyval that is a valid Q-expression and contains
- *             the list of cyvals.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             that is a valid Q-expression and contains the list of cyvals.
  * Return:     A pointer to a cyval.
  */
-cyval* builtin_tail(cyval* value) {
+cyval* builtin_tail(cyenv* env, cyval* value) {
         cyval* args;
+
+        (void) env;
         CY_ASSERT(value, (value -> len_cyvals == 1), "\"tail\" function \
                   passed too many args");
-        CY_ASSERT(value, (value -> cyvals[0] -> data_type == CYVAL_Q_EXP),
+        CY_ASSERT(value, (CY_TYPE(value -> cyvals[0]) == CYVAL_Q_EXP),
                   "\"tail\" function passed incorrect types");
         CY_ASSERT(value, (value -> cyvals[0] -> len_cyvals != 0),
                   "\"tail\" function passed no args");
 
-        /* Get arguments and destroy the first. */
+        /* Get the arguments and drop the first. */
         args = cyval_take(value, 0);
-        cyval_destructor(cyval_pop(args, 0));
+        cyval_slice(args, 1, args -> len_cyvals - 1);
         return args;
 }
 
 /*
  * Purpose:    Converts a given cyval S-expression to a Q-expression.
- * Parameters: A pointer to an S-expression cyval.
+ * Parameters: A pointer to the cyenv called in and a pointer to an
+ *             S-expression cyval.
  * Return:     A pointer to a Q-expression cyval.
  */
-cyval* builtin_list(cyval* value) {
+cyval* builtin_list(cyenv* env, cyval* value) {
+        (void) env;
         value -> data_type = CYVAL_Q_EXP;
         return value;
 }
@@ -527,33 +2017,112 @@ cyval* builtin_list(cyval* value) {
 /*
  * Purpose:    Converts a given cyval Q-expression to an S-expression and
  *             evaluates it.
- * Parameters: A pointer to a cyval Q-expression to convert.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression to convert.
  * Return:     A pointer to an evaluated cyval S-expression.
  */
-cyval* builtin_eval(cyval* value) {
+cyval* builtin_eval(cyenv* env, cyval* value) {
         cyval* args;
 
         CY_ASSERT(value, (value -> len_cyvals == 1), "\"eval\" function \
                   passed too many args");
-        CY_ASSERT(value, (value -> cyvals[0] -> data_type == CYVAL_Q_EXP),
+        CY_ASSERT(value, (CY_TYPE(value -> cyvals[0]) == CYVAL_Q_EXP),
                   "\"eval\" function passed incorrect types");
 
         args = cyval_take(value, 0);
         args -> data_type = CYVAL_S_EXP;
-        return cyval_evaluate(args);
+        return cyval_evaluate(env, args);
+}
+
+/*
+ * Purpose:    A built-in function "memo" that evaluates a Q-expression like
+ *             "eval", remembering the result so that evaluating the same
+ *             expression with the same inputs again is a lookup.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression to evaluate.
+ * Return:     A pointer to a cyval with the result.
+ */
+cyval* builtin_memo(cyenv* env, cyval* value) {
+        CY_ASSERT(value, (value -> len_cyvals == 1), "\"memo\" function \
+                  passed too many args");
+        CY_ASSERT(value, (CY_TYPE(value -> cyvals[0]) == CYVAL_Q_EXP),
+                  "\"memo\" function passed incorrect types");
+
+        return cymemo_eval(env, cyval_take(value, 0));
+}
+
+/*
+ * Purpose:    Bind each symbol in a Q-expression to the matching argument
+ *             that follows it, in the global scope for "def" or in the
+ *             current scope for "=".
+ * Parameters: A pointer to the cyenv called in, a pointer to a cyval
+ *             s-expression holding a Q-expression of symbols followed by
+ *             one value per symbol, and an int interned symbol id of the
+ *             function, CYSYM_DEF or CYSYM_PUT.
+ * Return:     A pointer to an empty cyval S-expression.
+ */
+cyval* builtin_var(cyenv* env, cyval* value, int func) {
+        int i;
+        cyval* syms;
+
+        CY_ASSERT(value, (CY_TYPE(value -> cyvals[0]) == CYVAL_Q_EXP),
+                  func == CYSYM_DEF ?
+                  "\"def\" function passed incorrect types" :
+                  "\"=\" function passed incorrect types");
+        syms = value -> cyvals[0];
+        for (i = 0; i < syms -> len_cyvals; i++)
+                CY_ASSERT(value, (CY_IS_SYM(syms -> cyvals[i])),
+                          func == CYSYM_DEF ?
+                          "\"def\" function cannot define non-symbol" :
+                          "\"=\" function cannot define non-symbol");
+        CY_ASSERT(value, (syms -> len_cyvals == value -> len_cyvals - 1),
+                  func == CYSYM_DEF ?
+                  "\"def\" function passed wrong number of values" :
+                  "\"=\" function passed wrong number of values");
+
+        /* Bind each symbol to a copy of its value. */
+        for (i = 0; i < syms -> len_cyvals; i++) {
+                if (func == CYSYM_DEF)
+                        cyenv_def(env, CY_SYM_OF(syms -> cyvals[i]),
+                                  value -> cyvals[i + 1]);
+                else
+                        cyenv_put(env, CY_SYM_OF(syms -> cyvals[i]),
+                                  value -> cyvals[i + 1]);
+        }
+        cyval_destructor(value);
+
+        return cyval_s_exp();
+}
+
+/*
+ * Purpose:    Built-in functions "def" and "=", each calling builtin_var
+ *             with its own function.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             s-expression of arguments.
+ * Return:     A pointer to an empty cyval S-expression.
+ */
+cyval* builtin_def(cyenv* env, cyval* value) {
+        return builtin_var(env, value, CYSYM_DEF);
+}
+
+cyval* builtin_put(cyenv* env, cyval* value) {
+        return builtin_var(env, value, CYSYM_PUT);
 }
 
 /*
  * Purpose:    Takes a cyval Q-expression and joins together its children.
- * Parameters: A pointer to a cyval to join children of.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             to join children of.
  * Return:     The joined cyval.
  */
-cyval* builtin_join(cyval* value) {
+cyval* builtin_join(cyenv* env, cyval* value) {
         cyval* args;
         int i;
 
+        (void) env;
+
         for (i = 0; i < value -> len_cyvals; i++)
-                CY_ASSERT(value, (value -> cyvals[i] -> data_type ==
+                CY_ASSERT(value, (CY_TYPE(value -> cyvals[i]) ==
                           CYVAL_Q_EXP), "\"join\" function passed incorrect \
                           types");
 
@@ -574,9 +2143,17 @@ cyval* builtin_join(cyval* value) {
  * Return:     A joined cyval.
  */
 cyval* cyval_join(cyval* a, cyval* b) {
-        /* Add each child of cyval b to cyval a. */
-        while (b -> len_cyvals)
-                a = cyval_add(a, cyval_pop(b, 0));
+        /* Move all of cyval b's children onto the end of cyval a at once. */
+        if (b -> len_cyvals > 0) {
+                cyval_reserve(a, b -> len_cyvals);
+                cyval_own(b);
+                memcpy(&a -> cyvals[a -> len_cyvals], b -> cyvals,
+                       sizeof(cyval*) * b -> len_cyvals);
+                a -> len_cyvals += b -> len_cyvals;
+                a -> vec -> hi += b -> len_cyvals;
+                b -> vec -> hi = b -> vec -> lo;
+                b -> len_cyvals = 0;
+        }
 
         cyval_destructor(b);
         return a;
@@ -584,15 +2161,28 @@ cyval* cyval_join(cyval* a, cyval* b) {
 
 /*
  * Purpose:    Evaluate the cyval pointed to by the given pointer if it
- *             represents an s-expression.
- * Parameters: A pointer to a cyval.
+ *             represents an s-expression or a symbol.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval.
  * Return:     A pointer to a cyval that is evaluated if it is an
- *             s-expression, or is the same as the original argument
- *             otherwise.
+ *             s-expression, the value bound to it if it is a symbol, or is
+ *             the same as the original argument otherwise.
  */
-cyval* cyval_evaluate(cyval* value) {
-        if (value -> data_type == CYVAL_S_EXP)
-                return cyval_evaluate_s_exp(value);
-        
-        return value;
+cyval* cyval_evaluate(cyenv* env, cyval* value) {
+        cyprog* prog;
+        cyval* result;
+
+        if (CY_IS_SYM(value))
+                return cyenv_get(env, CY_SYM_OF(value));
+        if (CY_TYPE(value) != CYVAL_S_EXP)
+                return value;
+        /*
+         * Fold, evaluate large pure calls on the thread pool if it is
+         * running, then compile what is left to bytecode and run it.
+         */
+        prog = cyprog_compile(cypar_expr(env, cyfold_expr(env, value, NULL)));
+        result = cyvm_run(env, prog);
+        cyprog_destructor(prog);
+
+        return result;
 }
@@ -5,50 +5,198 @@
  * Algorithms provided by www.buildyourownlisp.com.
  *
  * Written by:  Mohsin Rizvi
- * Last edited: 10/17/17
+ * Last edited: 10/16/26
  */
 
+#ifndef CHOCCYPARSING_H
+#define CHOCCYPARSING_H
+
 #include <stdio.h>
 #include <stdlib.h>
-#include <editline/readline.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
+#include <ctype.h>
 #include "mpc/mpc.h"
+#include "choccysym.h"
+#include "choccybig.h"
+#include "choccynums.h"
 
 /* Enumeration of possible types of cyvals: numbers and errors. */
-enum { CYVAL_NUM, CYVAL_ERROR, CYVAL_SYM, CYVAL_S_EXP, CYVAL_Q_EXP};
+enum { CYVAL_NUM, CYVAL_ERROR, CYVAL_SYM, CYVAL_S_EXP, CYVAL_Q_EXP,
+       CYVAL_FUN, CYVAL_BIG, CYVAL_NUMS };
+
+/* Choccy environment (cyenv), defined in choccyenv.h. */
+typedef struct cyenv cyenv;
 
 /*
- * TODO--UPDATE UNION FOR TYPES OF CYVAL DATA
+ * Choccy vector (cyvec) struct, the reference-counted storage behind the
+ * children of S-expressions and Q-expressions. A vector owns the children
+ * in items[lo] up to items[hi]. While more than one cyval refers to it, a
+ * vector is never modified, so each cyval can view its own slice of it;
+ * a cyval about to change its children first makes its vector its own
+ * with cyval_own.
  *
- * Choccy data (cydata) union, meant to hold evaluated long int or
- * an int representing an error.
- *
- * typedef union {
- *      long num;
- *      int error;
- * } cydata;
-*/
+ * A vector evaluated as a stored Q-expression may also cache its folded
+ * body (see choccyfold.h), and a hashed vector caches the hash of its
+ * children (see choccyhash.h); both are dropped when the vector is
+ * modified. A hash-consed vector is chained into the table of such vectors
+ * (see choccycons.h), and is unique among them.
+ */
+typedef struct cyvec {
+        int refs;
+        int cap;
+        int lo;
+        int hi;
+        struct cyval* folded;
+        int folded_epoch;
+        int consed;
+        uint64_t hash;
+        struct cyvec* cons_chain;
+        struct cyval* items[];
+} cyvec;
 
 /*
- * Choccy value (cyval) struct, meant to hold data (see cydata union).
+ * Choccy value (cyval) struct, holding the data of a heap-allocated value.
+ * Only one member of the union is live, chosen by data_type.
+ *
+ * Small values never get a node at all: a cyval pointer with its low bit
+ * set is a fixnum holding the number in its remaining bits, one with its
+ * low two bits set to 10 is an interned symbol id, and one with its low
+ * three bits set to 100 is a builtin function, named by the symbol id of
+ * its name. Nodes are at least 8-byte aligned, so real pointers always
+ * have their low three bits clear. Use
+ * the CY_* macros below rather than reading data_type directly whenever a
+ * cyval may be an immediate.
  */
 typedef struct cyval {
-        int data_type;
-        long num;
-        char* error;
-        char* sym;
-        /* Array of cyvals to point to */
-        int len_cyvals;
-        struct cyval** cyvals;
+        unsigned char data_type;
+        /* Where the node's memory came from (see choccyalloc.h) */
+        unsigned char owner;
+        union {
+                /* A number too large for a fixnum */
+                long num;
+                /* A number too large for a long */
+                cybig big;
+                /* A packed vector of numbers, shared between copies */
+                cynums* nums;
+                char* error;
+                /*
+                 * Array of cyvals to point to: a slice of len_cyvals
+                 * pointers starting off_cyvals items into a shared vector,
+                 * which cyvals points at directly. Popping the front only
+                 * moves the start of the slice.
+                 */
+                struct {
+                        int len_cyvals;
+                        int off_cyvals;
+                        cyvec* vec;
+                        struct cyval** cyvals;
+                };
+        };
 } cyval;
 
+/* Range of numbers that fit in a fixnum. */
+#define CY_FIXNUM_MIN (LONG_MIN >> 1)
+#define CY_FIXNUM_MAX (LONG_MAX >> 1)
+
+/* Tests for the kind of a cyval pointer. */
+#define CY_IS_FIXNUM(V) (((uintptr_t) (V) & 1) == 1)
+#define CY_IS_SYM(V)    (((uintptr_t) (V) & 3) == 2)
+#define CY_IS_FUN(V)    (((uintptr_t) (V) & 7) == 4)
+#define CY_IS_HEAP(V)   (((uintptr_t) (V) & 7) == 0)
+
+/* Encode an immediate fixnum, symbol id or builtin as a cyval pointer. */
+#define CY_MAKE_FIXNUM(N) ((cyval*) (((uintptr_t) (N) << 1) | 1))
+#define CY_MAKE_SYM(ID)   ((cyval*) (((uintptr_t) (ID) << 2) | 2))
+#define CY_MAKE_FUN(ID)   ((cyval*) (((uintptr_t) (ID) << 3) | 4))
+
+/* The type of any cyval pointer, immediate or not. */
+#define CY_TYPE(V) (CY_IS_FIXNUM(V) ? CYVAL_NUM :                     \
+                    CY_IS_SYM(V) ? CYVAL_SYM :                        \
+                    CY_IS_FUN(V) ? CYVAL_FUN : (V) -> data_type)
+
+/* The long value of a cyval number and the id of a cyval symbol. */
+#define CY_NUM_OF(V) (CY_IS_FIXNUM(V) ? (long) ((intptr_t) (V) >> 1) : \
+                      (V) -> num)
+#define CY_SYM_OF(V) ((int) ((uintptr_t) (V) >> 2))
+#define CY_FUN_OF(V) ((int) ((uintptr_t) (V) >> 3))
+
+/*
+ * Choccy grammar (cygrammar) struct, holding the MPC parser for each rule
+ * of the language. The line parser accepts a whole line of code.
+ */
+typedef struct cygrammar {
+        mpc_parser_t* num;
+        mpc_parser_t* sym;
+        mpc_parser_t* s_exp;
+        mpc_parser_t* q_exp;
+        mpc_parser_t* exp;
+        mpc_parser_t* line;
+} cygrammar;
+
+/*
+ * Purpose:    Define the Choccy language, constructing the MPC parser for
+ *             each rule of its grammar.
+ * Parameters: Void
+ * Return:     A pointer to a heap-allocated cygrammar.
+ */
+cygrammar* cygrammar_new(void);
+
+/*
+ * Purpose:    Deallocate a cygrammar and the MPC parsers it holds.
+ * Parameters: A pointer to a cygrammar to deallocate.
+ * Return:     Void
+ */
+void cygrammar_delete(cygrammar* grammar);
+
+/*
+ * Purpose:    Parse a line of Choccy code, then evaluate it and print the
+ *             result, or print the parse error.
+ * Parameters: A pointer to the cyenv to evaluate in, a c-string name of the
+ *             input for error messages, a c-string line of code, a
+ *             pointer to the MPC parser for a line and a FILE pointer to
+ *             print to.
+ * Return:     1 if the line parsed, or 0 otherwise.
+ */
+int eval_print_line(cyenv* env, char* name, char* input,
+                    mpc_parser_t* line, FILE* out);
+
+/*
+ * Purpose:    Read Choccy code from a stream and evaluate each top-level
+ *             expression as soon as it is complete, printing its result.
+ * Parameters: A pointer to the cyenv to evaluate in, a FILE pointer to read
+ *             from, a c-string name of the input for error messages, a
+ *             pointer to the MPC parser for a line and a FILE pointer to
+ *             print to.
+ * Return:     0 if every expression parsed, or 1 otherwise.
+ */
+int run_stream(cyenv* env, FILE* input, char* name, mpc_parser_t* line,
+               FILE* out);
+
 /*
- * Purpose:    Construct a cyval number instance on the heap.
+ * Purpose:    Construct a cyval number instance, as a fixnum when it fits
+ *             and on the heap otherwise.
  * Parameters: A long int number value for the cyval to store.
  * Return:     A pointer to a constructed cyval instance.
  */
 cyval* cyval_num(long num_value);
 
+/*
+ * Purpose:    Construct a cyval number instance from a cybig, as a long
+ *             number when it fits in one and as a big number otherwise.
+ * Parameters: A pointer to a cybig, whose limbs the cyval takes over.
+ * Return:     A pointer to a constructed cyval instance.
+ */
+cyval* cyval_big(cybig* big);
+
+/*
+ * Purpose:    Construct a cyval numeric vector instance on the heap.
+ * Parameters: A pointer to a cynums, whose reference the cyval takes over.
+ * Return:     A pointer to a constructed cyval instance.
+ */
+cyval* cyval_nums(cynums* nums);
+
 /*
  * Purpose:    Construct a cyval error instance on the heap.
  * Parameters: A c-string representing an error message.
@@ -57,7 +205,8 @@ cyval* cyval_num(long num_value);
 cyval* cyval_error(char* msg);
 
 /*
- * Purpose:    Construct a cyval symbol instance on the heap.
+ * Purpose:    Construct a cyval symbol instance as an immediate interned
+ *             symbol id.
  * Parameters: A c-string representing a symbol.
  * Return:     A pointer to a constructed cyval instance.
  */
@@ -77,6 +226,52 @@ cyval* cyval_s_exp(void);
  */
 cyval* cyval_q_exp(void);
 
+/*
+ * Purpose:    Copy a cyval. Copying an S-expression or Q-expression shares
+ *             its vector of children instead of copying them, so any copy
+ *             takes constant time.
+ * Parameters: A pointer to a cyval to copy.
+ * Return:     A pointer to the copy, which is owned by the caller.
+ */
+cyval* cyval_copy(cyval* value);
+
+/*
+ * Purpose:    Deep copy a cyval into nodes that outlive the arena, so it
+ *             can be kept after the line that made it.
+ * Parameters: A pointer to a cyval to copy, which is not consumed.
+ * Return:     A pointer to the copy, owned by the caller.
+ */
+cyval* cyval_persist(cyval* value);
+
+/*
+ * Purpose:    Release a reference to a cyvec, destroying its children and
+ *             freeing it once no cyval refers to it.
+ * Parameters: A pointer to a cyvec, which may be NULL.
+ * Return:     Void
+ */
+void cyvec_release(cyvec* vec);
+
+/*
+ * Purpose:    Make a cyval's vector of children its own before modifying
+ *             it: a shared vector is replaced by a copy of the cyval's
+ *             slice, and children outside the slice of an unshared vector
+ *             are destroyed.
+ * Parameters: A pointer to a cyval S-expression or Q-expression.
+ * Return:     Void
+ */
+void cyval_own(cyval* value);
+
+/*
+ * Purpose:    Narrow a cyval's children to the given range in constant
+ *             time. Children outside the range stay in the vector until it
+ *             is released or the cyval is next modified.
+ * Parameters: A pointer to a cyval S-expression or Q-expression, an int
+ *             index of the first child to keep and an int number of
+ *             children to keep.
+ * Return:     Void
+ */
+void cyval_slice(cyval* value, int start, int len);
+
 /*
  * Purpose:    Deallocate heap memory used by the given cyval pointer.
  * Parameters: A pointer to a cyval to deallocate memory for.
@@ -89,25 +284,28 @@ void cyval_destructor(cyval* value);
  *             and print print the opening char before and the ending char
  *             after.
  * Parameters: A pointer to a cyval s-expression to print from, a char
- *             opening to print first, and a char ending to print last.
+ *             opening to print first, a char ending to print last, and a
+ *             FILE pointer to print to.
  * Return:     Void
  */
-void print_cyval_exp(cyval* value, char opening, char ending);
+void print_cyval_exp(cyval* value, char opening, char ending, FILE* out);
 
 /*
  * Purpoes:    Print a cyval pointed to by the given pointer.
- * Parameters: A pointer to a cyval to print from.
+ * Parameters: A pointer to a cyval to print from and a FILE pointer to
+ *             print to.
  * Return:     Void
  */
-void print_cyval(cyval* value);
+void print_cyval(cyval* value, FILE* out);
 
 /*
  * Purpose:    Print the cyval pointed to by the given cyval pointer
  *             with a newline char at the end.
- * Parameters: A pointer to a cyval to print.
+ * Parameters: A pointer to a cyval to print and a FILE pointer to print
+ *             to.
  * Return:     Void
  */
-void print_cyval_endl(cyval* value);
+void print_cyval_endl(cyval* value, FILE* out);
 
 /*
  * Purpose:    Recursively read an MPC abstract syntax tree from the given
@@ -129,6 +327,16 @@ cyval* cyval_read_tree(mpc_ast_t* node);
  */
 cyval* cyval_add(cyval* value, cyval* to_add);
 
+/*
+ * Purpose:    Ensure a given cyval's list of cyval pointers has room for at
+ *             least the given number of additional pointers, growing its
+ *             capacity geometrically.
+ * Parameters: A pointer to a cyval with a list of cyval pointers and an int
+ *             number of pointers about to be added.
+ * Return:     Void
+ */
+void cyval_reserve(cyval* value, int extra);
+
 /*
  * Purpose:    Read a node from an MPC abstract syntax tree given by the
  *             given MPC abstract syntax tree pointer.
@@ -138,57 +346,100 @@ cyval* cyval_add(cyval* value, cyval* to_add);
 cyval* cyval_read_node(mpc_ast_t* node);
 
 /*
- * Purpose:    Evaluate a cyval s-expression pointed to by the given pointer.
- * Parameters: A pointer pointing to a cyval s-expression.
- * Return:     A cyval pointer pointing to the evaluated result.
+ * Builtin function (cybuiltin) type, taking the environment it is called
+ * in and a cyval s-expression of arguments and returning the call's result.
  */
-cyval* cyval_evaluate_s_exp(cyval* value);
+typedef cyval* (*cybuiltin)(cyenv*, cyval*);
 
 /*
  * Purpose:    Call a builtin function or operator.
- * Parameters: A cyval to call with and a C-string operator or function name.
+ * Parameters: A pointer to the cyenv to call in, a cyval to call with and
+ *             an int interned symbol id naming the operator or function.
  * Return:     A cyval with the operation result.
  */
-cyval* builtins(cyval* value, char* func);
+cyval* builtins(cyenv* env, cyval* value, int func);
+
+/*
+ * Purpose:    Bind every builtin function to its name in a scope.
+ * Parameters: A pointer to a cyenv, normally the global scope.
+ * Return:     Void
+ */
+void cyenv_add_builtins(cyenv* env);
 
 /*
  * Purpose:    A built-in function "head" that returns a Q-expression
  *             with only the first element.
- * Parameters: A pointer to a cyval that is a valid Q-expressions.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             that is a valid Q-expressions.
  * Return:     A pointer to a cyval.
  */
-cyval* builtin_head(cyval* a);
+cyval* builtin_head(cyenv* env, cyval* value);
 
 /*
  * Purpose:    A built-in function "tail" that returns a Q-expression with
  *             all elements but the first one taken.
- * Parameters: A pointer to a cyval that is a valid Q-expression and contains
- *             the list of cyvals.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             that is a valid Q-expression and contains the list of cyvals.
  * Return:     A pointer to a cyval.
  */
-cyval* builtin_tail(cyval* value);
+cyval* builtin_tail(cyenv* env, cyval* value);
 
 /*
  * Purpose:    Converts a given cyval S-expression to a Q-expression.
- * Parameters: A pointer to an S-expression cyval.
+ * Parameters: A pointer to the cyenv called in and a pointer to an
+ *             S-expression cyval.
  * Return:     A pointer to a Q-expression cyval.
  */
-cyval* builtin_list(cyval* value);
+cyval* builtin_list(cyenv* env, cyval* value);
 
 /*
  * Purpose:    Converts a given cyval Q-expression to an S-expression and
  *             evaluates it.
- * Parameters: A pointer to a cyval Q-expression to convert.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression to convert.
  * Return:     A pointer to an evaluated cyval S-expression.
  */
-cyval* builtin_eval(cyval* value);
+cyval* builtin_eval(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    A built-in function "memo" that evaluates a Q-expression like
+ *             "eval", remembering the result so that evaluating the same
+ *             expression with the same inputs again is a lookup.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval Q-expression to evaluate.
+ * Return:     A pointer to a cyval with the result.
+ */
+cyval* builtin_memo(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    Bind each symbol in a Q-expression to the matching argument
+ *             that follows it, in the global scope for "def" or in the
+ *             current scope for "=".
+ * Parameters: A pointer to the cyenv called in, a pointer to a cyval
+ *             s-expression holding a Q-expression of symbols followed by
+ *             one value per symbol, and an int interned symbol id of the
+ *             function, CYSYM_DEF or CYSYM_PUT.
+ * Return:     A pointer to an empty cyval S-expression.
+ */
+cyval* builtin_var(cyenv* env, cyval* value, int func);
+
+/*
+ * Purpose:    Built-in functions "def" and "=", each calling builtin_var
+ *             with its own function.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             s-expression of arguments.
+ * Return:     A pointer to an empty cyval S-expression.
+ */
+cyval* builtin_def(cyenv* env, cyval* value);
+cyval* builtin_put(cyenv* env, cyval* value);
 
 /*
  * Purpose:    Takes a cyval Q-expression and joins together its children.
- * Parameters: A pointer to a cyval to join children of.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             to join children of.
  * Return:     The joined cyval.
  */
-cyval* builtin_join(cyval* value);
+cyval* builtin_join(cyenv* env, cyval* value);
 
 /*
  * Purpose:    Takes two cyvals and joins the children of the second one to
@@ -201,13 +452,14 @@ cyval* cyval_join(cyval* a, cyval* b);
 
 /*
  * Purpose:    Evaluate the cyval pointed to by the given pointer if it
- *             represents an s-expression.
- * Parameters: A pointer to a cyval.
+ *             represents an s-expression or a symbol.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval.
  * Return:     A pointer to a cyval that is evaluated if it is an
- *             s-expression, or is the same as the original argument
- *             otherwise.
+ *             s-expression, the value bound to it if it is a symbol, or is
+ *             the same as the original argument otherwise.
  */
-cyval* cyval_evaluate(cyval* value);
+cyval* cyval_evaluate(cyenv* env, cyval* value);
 
 /*
  * Purpose:    Removes a cyval pointer from the given pointed to cyval's
@@ -232,12 +484,143 @@ cyval* cyval_take(cyval* value, int i);
 
 /*
  * Purpose:    Operates on a given cyval representing arguments using the
- *             given c-string operator.
- * Parameters: A cyval s-expression pointer containing arguments to
- *             operate on and a given c-string operator.
+ *             given operator.
+ * Parameters: A pointer to the cyenv called in, a cyval s-expression
+ *             pointer containing arguments to operate on and an int interned
+ *             symbol id of the operator.
+ * Return:     A pointer to a cyval containing the result of operating.
+ */
+cyval* builtin_ops(cyenv* env, cyval* value, int ops);
+
+/*
+ * Purpose:    Built-in operators "+", "-", "*", "/", "%" and "^", each
+ *             calling builtin_ops with its own operator.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
  * Return:     A pointer to a cyval containing the result of operating.
  */
-cyval* builtin_ops(cyval* value, char* ops);
+cyval* builtin_add(cyenv* env, cyval* value);
+cyval* builtin_sub(cyenv* env, cyval* value);
+cyval* builtin_mul(cyenv* env, cyval* value);
+cyval* builtin_div(cyenv* env, cyval* value);
+cyval* builtin_mod(cyenv* env, cyval* value);
+cyval* builtin_pow(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    A built-in function "vec" that packs a Q-expression of
+ *             numbers into a numeric vector.
+ * Parameters: A pointer to the cyenv called in and a pointer to a cyval
+ *             s-expression holding one Q-expression of numbers.
+ * Return:     A pointer to a cyval numeric vector.
+ */
+cyval* builtin_vec(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    Reduce one numeric vector to its sum, minimum or maximum, or
+ *             two to their dot product. Totals too large for a long are
+ *             added up again as big numbers.
+ * Parameters: A pointer to the cyenv called in, a cyval s-expression
+ *             pointer containing the vector arguments and an int interned
+ *             symbol id of the function.
+ * Return:     A pointer to a cyval number.
+ */
+cyval* builtin_reduce(cyenv* env, cyval* value, int func);
+
+/*
+ * Purpose:    Built-in functions "sum", "min", "max" and "dot", each
+ *             calling builtin_reduce with its own function.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval number.
+ */
+cyval* builtin_sum(cyenv* env, cyval* value);
+cyval* builtin_min(cyenv* env, cyval* value);
+cyval* builtin_max(cyenv* env, cyval* value);
+cyval* builtin_dot(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    Compare two values by structure, in constant time when they
+ *             share their children or are hash-consed (see choccycons.h).
+ * Parameters: A pointer to the cyenv called in, a cyval s-expression
+ *             pointer containing the two values and an int interned symbol
+ *             id of the function, CYSYM_EQ or CYSYM_NE.
+ * Return:     A pointer to a cyval number, 1 if the comparison holds or 0
+ *             otherwise.
+ */
+cyval* builtin_cmp(cyenv* env, cyval* value, int func);
+
+/*
+ * Purpose:    Built-in functions "==" and "!=", each calling builtin_cmp
+ *             with its own function.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval number.
+ */
+cyval* builtin_eq(cyenv* env, cyval* value);
+cyval* builtin_ne(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    Apply a function, a builtin or a Q-expression beginning a
+ *             call, to the elements of a list: to each one for "map" and
+ *             "filter", or to combine them all for "fold". Each element is
+ *             passed as if it were written in the call, and large lists
+ *             are evaluated on the thread pool if it is running. The list
+ *             may also be a numeric vector, whose numbers are passed one
+ *             by one, and then "map" and "filter" give a numeric vector.
+ * Parameters: A pointer to the cyenv to evaluate in, a cyval s-expression
+ *             pointer containing the function, the initial value for
+ *             "fold" and the list, and an int interned symbol id of the
+ *             function, CYSYM_MAP, CYSYM_FILTER or CYSYM_FOLD.
+ * Return:     A pointer to a cyval Q-expression or numeric vector of
+ *             results for "map" or of the elements kept for "filter", the
+ *             combined cyval for "fold", or the first error.
+ */
+cyval* builtin_apply(cyenv* env, cyval* value, int func);
+
+/*
+ * Purpose:    Built-in functions "map", "filter" and "fold", each calling
+ *             builtin_apply with its own function.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing arguments.
+ * Return:     A pointer to a cyval result.
+ */
+cyval* builtin_map(cyenv* env, cyval* value);
+cyval* builtin_filter(cyenv* env, cyval* value);
+cyval* builtin_fold(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    A built-in function "save-image" that saves the global scope
+ *             to a heap image file (see choccyimage.h), named by the
+ *             symbol in a Q-expression, as Choccy has no strings.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing a Q-expression of one symbol.
+ * Return:     A pointer to an empty cyval S-expression, or an error if the
+ *             image cannot be written.
+ */
+cyval* builtin_save_image(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    A built-in function "serialize" that writes a value to a
+ *             file in the binary encoding of choccyser.h, named by the
+ *             symbol in a Q-expression.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing a Q-expression of one symbol and the
+ *             value to write.
+ * Return:     A pointer to an empty cyval S-expression, or an error if the
+ *             file cannot be written.
+ */
+cyval* builtin_serialize(cyenv* env, cyval* value);
+
+/*
+ * Purpose:    A built-in function "deserialize" that reads back a value
+ *             written by "serialize", from a file named by the symbol in a
+ *             Q-expression.
+ * Parameters: A pointer to the cyenv called in and a cyval s-expression
+ *             pointer containing a Q-expression of one symbol.
+ * Return:     A pointer to the cyval read, or an error if the file cannot
+ *             be read.
+ */
+cyval* builtin_deserialize(cyenv* env, cyval* value);
 
 /*
  * Purpose:    Recursively evaluate a line of choccy code.
@@ -253,3 +636,5 @@ cyval evaluate(mpc_ast_t* node);
  * Return:     A cyval with the finished data.
  */
 cyval operate(cyval first, cyval second, char* ops);
+
+#endif
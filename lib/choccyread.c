@@ -0,0 +1,165 @@
+/*
+ * choccyread.c
+ * A hand-written reader for Choccy. It scans source text once, building
+ * cyvals as it goes: numbers are parsed in place and symbols map straight
+ * to their interned ids, so no MPC abstract syntax tree is built. Open
+ * expressions are kept on an explicit stack rather than the C stack.
+ *
+ * The reader follows the MPC grammar in main token for token, trying a
+ * number before a symbol and skipping whitespace after every token, so
+ * anything it rejects can be handed to MPC to report the error.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyread.h"
+
+/* Initial number of open expressions the reader's stack can hold. */
+#define CYREAD_MIN_DEPTH 16
+
+/*
+ * Purpose:    Test whether a char may appear in a symbol, matching the
+ *             grammar's /[a-zA-Z0-9_+\-*\/\\=<>!&%^]+/.
+ * Parameters: A char to test.
+ * Return:     Nonzero if the char may appear in a symbol, or 0 otherwise.
+ */
+static int cyread_is_sym_char(char c) {
+        return isalnum((unsigned char) c) || (c != '\0' &&
+               strchr("_+-*/\\=<>!&%^", c) != NULL);
+}
+
+/*
+ * Purpose:    Skip over whitespace.
+ * Parameters: A c-string position to start from.
+ * Return:     The position of the first non-whitespace char.
+ */
+static const char* cyread_skip(const char* p) {
+        while (isspace((unsigned char) *p))
+                p++;
+        return p;
+}
+
+/*
+ * Purpose:    Read a number matching /-?[0-9]+/ at the given position.
+ * Parameters: A c-string position to read from, and a pointer to a cyval
+ *             pointer to store the number, which is a big number if it is
+ *             too large for a long.
+ * Return:     The position after the number, or NULL if there is none.
+ */
+static const char* cyread_num(const char* p, cyval** result) {
+        int negative = 0;
+        int overflow = 0;
+        const char* digits;
+        unsigned long num = 0;
+        cybig big;
+        unsigned long limit;
+        unsigned long digit;
+
+        if (*p == '-') {
+                negative = 1;
+                p++;
+        }
+        if (!isdigit((unsigned char) *p))
+                return NULL;
+        digits = p;
+
+        /* Accumulate digits, noting when they leave the range of a long. */
+        limit = negative ? (unsigned long) LONG_MAX + 1 : LONG_MAX;
+        for (; isdigit((unsigned char) *p); p++) {
+                digit = *p - '0';
+                if (num > (limit - digit) / 10)
+                        overflow = 1;
+                else
+                        num = num * 10 + digit;
+        }
+
+        if (overflow) {
+                cybig_from_digits(&big, digits, p - digits, negative);
+                *result = cyval_big(&big);
+        } else if (negative)
+                *result = cyval_num(num == (unsigned long) LONG_MAX + 1 ?
+                                    LONG_MIN : -(long) num);
+        else
+                *result = cyval_num((long) num);
+
+        return p;
+}
+
+/*
+ * Purpose:    Read a symbol at the given position, interning its name
+ *             without copying it out of the source first.
+ * Parameters: A c-string position to read from, and a pointer to a cyval
+ *             pointer to store the symbol.
+ * Return:     The position after the symbol, or NULL if there is none.
+ */
+static const char* cyread_sym(const char* p, cyval** result) {
+        const char* start = p;
+
+        while (cyread_is_sym_char(*p))
+                p++;
+        if (p == start)
+                return NULL;
+        *result = CY_MAKE_SYM(cysym_intern_n(start, p - start));
+        return p;
+}
+
+/*
+ * Purpose:    Read a line of Choccy code straight into cyvals, accepting
+ *             exactly the inputs the MPC grammar for a line accepts.
+ * Parameters: A c-string line of code, and a pointer to a cyval pointer to
+ *             store the result in.
+ * Return:     1 if the line was read, storing an S-expression holding its
+ *             top-level expressions, or 0 if it is not valid Choccy, in
+ *             which case nothing is stored.
+ */
+int cyread_line(const char* input, cyval** result) {
+        const char* p = cyread_skip(input);
+        const char* next;
+        cyval** stack = malloc(sizeof(cyval*) * CYREAD_MIN_DEPTH);
+        int len_stack = 1;
+        int cap_stack = CYREAD_MIN_DEPTH;
+        cyval* value;
+
+        stack[0] = cyval_s_exp();
+        while (*p) {
+                if (*p == '(' || *p == '{') {
+                        /* Open a new expression on top of the stack. */
+                        if (len_stack == cap_stack) {
+                                cap_stack *= 2;
+                                stack = realloc(stack,
+                                                sizeof(cyval*) * cap_stack);
+                        }
+                        stack[len_stack++] = *p == '(' ? cyval_s_exp() :
+                                                         cyval_q_exp();
+                        p++;
+                } else if (*p == ')' || *p == '}') {
+                        /* Close the top expression if the bracket matches. */
+                        if (len_stack == 1 ||
+                            stack[len_stack - 1] -> data_type !=
+                            (*p == ')' ? CYVAL_S_EXP : CYVAL_Q_EXP))
+                                break;
+                        value = stack[--len_stack];
+                        cyval_add(stack[len_stack - 1], value);
+                        p++;
+                } else if ((next = cyread_num(p, &value)) != NULL ||
+                           (next = cyread_sym(p, &value)) != NULL) {
+                        cyval_add(stack[len_stack - 1], value);
+                        p = next;
+                } else {
+                        break;
+                }
+                p = cyread_skip(p);
+        }
+
+        /* Fail on leftover input or unclosed expressions. */
+        if (*p || len_stack != 1) {
+                while (len_stack > 0)
+                        cyval_destructor(stack[--len_stack]);
+                free(stack);
+                return 0;
+        }
+
+        *result = stack[0];
+        free(stack);
+        return 1;
+}
@@ -0,0 +1,25 @@
+/*
+ * choccyread.h
+ * Header file for choccyread.c, declaring the single-pass reader that turns
+ * Choccy source text directly into cyvals.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYREAD_H
+#define CHOCCYREAD_H
+
+#include "choccyparsing.h"
+
+/*
+ * Purpose:    Read a line of Choccy code straight into cyvals, accepting
+ *             exactly the inputs the MPC grammar for a line accepts.
+ * Parameters: A c-string line of code, and a pointer to a cyval pointer to
+ *             store the result in.
+ * Return:     1 if the line was read, storing an S-expression holding its
+ *             top-level expressions, or 0 if it is not valid Choccy, in
+ *             which case nothing is stored.
+ */
+int cyread_line(const char* input, cyval** result);
+
+#endif
@@ -0,0 +1,620 @@
+/*
+ * choccyser.c
+ * A compact binary encoding of Choccy values. A stream starts with a magic
+ * number and version, followed by any number of values. Each value is a
+ * tag followed by its data:
+ *
+ *   number        a zigzag varint
+ *   big number    its sign, its number of limbs and each limb, as varints
+ *   error         its length in bytes as a varint, then its chars
+ *   symbol        a symbol reference
+ *   builtin       a symbol reference to its name
+ *   expression    its number of children as a varint, then each child
+ *   numeric vec   its length as a varint, then each number as a zigzag
+ *                 varint
+ *
+ * A symbol reference is a varint: 0 for a symbol named for the first time
+ * in the stream, followed by the length and chars of its name, or n for
+ * the n-th symbol named so far. Symbol ids are only meaningful within one
+ * process, so each stream keeps a table of its own.
+ *
+ * Values are written and read with explicit stacks instead of recursion,
+ * and straight from the file, so neither nesting depth nor length is
+ * limited by anything but memory.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyser.h"
+
+/* Chars a stream starts with. */
+#define CYSER_MAGIC "CYSR"
+
+/* Initial number of slots allocated for the stacks and symbol tables. */
+#define CYSER_MIN_SLOTS 16
+
+/*
+ * Most children, limbs, numbers or chars reserved for a value before they
+ * are read, so that a corrupt length cannot claim much memory before the
+ * stream runs out.
+ */
+#define CYSER_MAX_RESERVE (1 << 20)
+
+/* Enumeration of the tags that start each encoded value. */
+enum { CYSER_NUM, CYSER_BIG, CYSER_ERROR, CYSER_SYM, CYSER_FUN,
+       CYSER_S_EXP, CYSER_Q_EXP, CYSER_NUMS };
+
+/* An expression being written and the index of its next child. */
+typedef struct cyserframe {
+        cyval* value;
+        int next;
+} cyserframe;
+
+/*
+ * Choccy serializer (cyser) struct. A writer maps each symbol id to its
+ * place in the stream's table plus one, or 0 if it is not named yet; a
+ * reader maps each place in the table to the symbol id it was interned as.
+ */
+struct cyser {
+        FILE* file;
+        int* syms;
+        int len_syms;
+        int cap_syms;
+        cyserframe* frames;
+        int len_frames;
+        int cap_frames;
+};
+
+/*
+ * Purpose:    Allocate a cyser for a file.
+ * Parameters: A FILE pointer.
+ * Return:     A pointer to a heap-allocated cyser with empty tables.
+ */
+static cyser* cyser_new(FILE* file) {
+        cyser* ser = calloc(1, sizeof(cyser));
+
+        ser -> file = file;
+        return ser;
+}
+
+/*
+ * Purpose:    Write an unsigned number as a varint: seven bits per byte,
+ *             least significant first, with the high bit of each byte but
+ *             the last set.
+ * Parameters: A pointer to a cyser and a uint64_t number.
+ * Return:     Void
+ */
+static void cyser_put(cyser* ser, uint64_t num) {
+        unsigned char bytes[10];
+        int len = 0;
+
+        while (num >= 0x80) {
+                bytes[len++] = (unsigned char) (num | 0x80);
+                num >>= 7;
+        }
+        bytes[len++] = (unsigned char) num;
+        fwrite(bytes, 1, len, ser -> file);
+}
+
+/*
+ * Purpose:    Write a signed number as a zigzag varint, so numbers near
+ *             zero take few bytes whatever their sign.
+ * Parameters: A pointer to a cyser and a long number.
+ * Return:     Void
+ */
+static void cyser_put_signed(cyser* ser, long num) {
+        cyser_put(ser, ((uint64_t) num << 1) ^ (num < 0 ? UINT64_MAX : 0));
+}
+
+/*
+ * Purpose:    Write a reference to a symbol, naming it if the stream has
+ *             not named it yet.
+ * Parameters: A pointer to a writing cyser and an int interned symbol id.
+ * Return:     Void
+ */
+static void cyser_put_sym(cyser* ser, int id) {
+        int old = ser -> cap_syms;
+        char* name;
+
+        if (id >= ser -> cap_syms) {
+                while (id >= ser -> cap_syms)
+                        ser -> cap_syms = ser -> cap_syms ?
+                                          ser -> cap_syms * 2 :
+                                          CYSER_MIN_SLOTS;
+                ser -> syms = realloc(ser -> syms, sizeof(int) *
+                                                   ser -> cap_syms);
+                memset(ser -> syms + old, 0, sizeof(int) *
+                                             (ser -> cap_syms - old));
+        }
+        if (ser -> syms[id] != 0) {
+                cyser_put(ser, ser -> syms[id]);
+                return;
+        }
+        ser -> syms[id] = ++ser -> len_syms;
+
+        name = cysym_name(id);
+        cyser_put(ser, 0);
+        cyser_put(ser, strlen(name));
+        fwrite(name, 1, strlen(name), ser -> file);
+}
+
+/*
+ * Purpose:    Write a value that has no children: a number, symbol,
+ *             builtin, error or numeric vector.
+ * Parameters: A pointer to a writing cyser and a pointer to a cyval.
+ * Return:     Void
+ */
+static void cyser_put_leaf(cyser* ser, cyval* value) {
+        int i;
+        int type = CY_TYPE(value);
+
+        if (type == CYVAL_NUM) {
+                cyser_put(ser, CYSER_NUM);
+                cyser_put_signed(ser, CY_NUM_OF(value));
+        } else if (type == CYVAL_SYM) {
+                cyser_put(ser, CYSER_SYM);
+                cyser_put_sym(ser, CY_SYM_OF(value));
+        } else if (type == CYVAL_FUN) {
+                cyser_put(ser, CYSER_FUN);
+                cyser_put_sym(ser, CY_FUN_OF(value));
+        } else if (type == CYVAL_BIG) {
+                cyser_put(ser, CYSER_BIG);
+                cyser_put_signed(ser, value -> big.sign);
+                cyser_put(ser, value -> big.len_limbs);
+                for (i = 0; i < value -> big.len_limbs; i++)
+                        cyser_put(ser, value -> big.limbs[i]);
+        } else if (type == CYVAL_NUMS) {
+                cyser_put(ser, CYSER_NUMS);
+                cyser_put(ser, value -> nums -> len);
+                for (i = 0; i < value -> nums -> len; i++)
+                        cyser_put_signed(ser, value -> nums -> items[i]);
+        } else {
+                cyser_put(ser, CYSER_ERROR);
+                cyser_put(ser, strlen(value -> error));
+                fwrite(value -> error, 1, strlen(value -> error),
+                       ser -> file);
+        }
+}
+
+/*
+ * Purpose:    Push an expression onto the stack of expressions being
+ *             written or read.
+ * Parameters: A pointer to a cyser and a pointer to a cyval S-expression or
+ *             Q-expression.
+ * Return:     Void
+ */
+static void cyser_push(cyser* ser, cyval* value) {
+        if (ser -> len_frames == ser -> cap_frames) {
+                ser -> cap_frames = ser -> cap_frames ?
+                                    ser -> cap_frames * 2 : CYSER_MIN_SLOTS;
+                ser -> frames = realloc(ser -> frames, sizeof(cyserframe) *
+                                                       ser -> cap_frames);
+        }
+        ser -> frames[ser -> len_frames].value = value;
+        ser -> frames[ser -> len_frames].next = 0;
+        ser -> len_frames++;
+}
+
+/*
+ * Purpose:    Start writing encoded values to a file, writing the header
+ *             of the stream.
+ * Parameters: A FILE pointer to write to, which the cyser does not close.
+ * Return:     A pointer to a heap-allocated cyser.
+ */
+cyser* cyser_writer(FILE* out) {
+        cyser* ser = cyser_new(out);
+
+        fwrite(CYSER_MAGIC, 1, strlen(CYSER_MAGIC), out);
+        cyser_put(ser, CYSER_VERSION);
+
+        return ser;
+}
+
+/*
+ * Purpose:    Encode a value onto a stream.
+ * Parameters: A pointer to a cyser made by cyser_writer and a pointer to a
+ *             cyval, which is not consumed.
+ * Return:     1 if the value was written, or 0 if the file reported an
+ *             error.
+ */
+int cyser_write(cyser* ser, cyval* value) {
+        int type;
+        cyserframe* top = NULL;
+
+        ser -> len_frames = 0;
+        for (;;) {
+                type = CY_TYPE(value);
+                if (type == CYVAL_S_EXP || type == CYVAL_Q_EXP) {
+                        cyser_put(ser, type == CYVAL_S_EXP ?
+                                       CYSER_S_EXP : CYSER_Q_EXP);
+                        cyser_put(ser, value -> len_cyvals);
+                        cyser_push(ser, value);
+                } else {
+                        cyser_put_leaf(ser, value);
+                }
+
+                /* Move on to the next child not yet written. */
+                while (ser -> len_frames > 0) {
+                        top = &ser -> frames[ser -> len_frames - 1];
+                        if (top -> next < top -> value -> len_cyvals)
+                                break;
+                        ser -> len_frames--;
+                }
+                if (ser -> len_frames == 0)
+                        break;
+                value = top -> value -> cyvals[top -> next++];
+        }
+
+        return !ferror(ser -> file);
+}
+
+/*
+ * Purpose:    Read a varint.
+ * Parameters: A pointer to a reading cyser and a pointer to a uint64_t to
+ *             store the number in.
+ * Return:     1 if a number was read, or 0 if the stream ended first or
+ *             the number does not fit in 64 bits.
+ */
+static int cyser_get(cyser* ser, uint64_t* num) {
+        int c;
+        int shift = 0;
+
+        *num = 0;
+        while ((c = getc(ser -> file)) != EOF) {
+                if (shift > 63 || (shift == 63 && (c & 0x7e)))
+                        return 0;
+                *num |= (uint64_t) (c & 0x7f) << shift;
+                if (!(c & 0x80))
+                        return 1;
+                shift += 7;
+        }
+        return 0;
+}
+
+/*
+ * Purpose:    Start reading encoded values from a file, reading the header
+ *             of the stream.
+ * Parameters: A FILE pointer to read from, which the cyser does not close.
+ * Return:     A pointer to a heap-allocated cyser, or NULL if the file does
+ *             not start with a stream of this version.
+ */
+cyser* cyser_reader(FILE* in) {
+        char magic[sizeof(CYSER_MAGIC) - 1];
+        uint64_t version;
+        cyser* ser;
+
+        if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+            memcmp(magic, CYSER_MAGIC, sizeof(magic)) != 0)
+                return NULL;
+        ser = cyser_new(in);
+        if (!cyser_get(ser, &version) || version != CYSER_VERSION) {
+                cyser_close(ser);
+                return NULL;
+        }
+
+        return ser;
+}
+
+/*
+ * Purpose:    Read a zigzag varint.
+ * Parameters: A pointer to a reading cyser and a pointer to a long to
+ *             store the number in.
+ * Return:     1 if a number was read, or 0 otherwise.
+ */
+static int cyser_get_signed(cyser* ser, long* num) {
+        uint64_t word;
+
+        if (!cyser_get(ser, &word))
+                return 0;
+        *num = (long) (word >> 1) ^ -(long) (word & 1);
+        return 1;
+}
+
+/*
+ * Purpose:    Read a count of items, which must fit in an int.
+ * Parameters: A pointer to a reading cyser and a pointer to an int to
+ *             store the count in.
+ * Return:     1 if a count was read, or 0 otherwise.
+ */
+static int cyser_get_len(cyser* ser, int* len) {
+        uint64_t word;
+
+        if (!cyser_get(ser, &word) || word > INT_MAX)
+                return 0;
+        *len = (int) word;
+        return 1;
+}
+
+/*
+ * Purpose:    Make room for the next item of an array being read, growing
+ *             it no further than its length or than the items read so far
+ *             justify.
+ * Parameters: A pointer to the array (or NULL), a pointer to the int
+ *             number of items it has room for, the int length it is read
+ *             up to and the size_t size of an item.
+ * Return:     The possibly moved array.
+ */
+static void* cyser_grow(void* items, int* cap, int len, size_t size) {
+        if (*cap == 0)
+                *cap = len < CYSER_MAX_RESERVE ? len : CYSER_MAX_RESERVE;
+        else
+                *cap = *cap < len / 2 ? *cap * 2 : len;
+        return realloc(items, size * *cap);
+}
+
+/*
+ * Purpose:    Read a given number of chars, as the name of a symbol or
+ *             the message of an error.
+ * Parameters: A pointer to a reading cyser and the int number of chars.
+ * Return:     A heap c-string of the chars read, or NULL if the stream
+ *             ended first.
+ */
+static char* cyser_get_chars(cyser* ser, int len) {
+        int cap = 0;
+        int read = 0;
+        char* chars = NULL;
+
+        while (read < len) {
+                chars = cyser_grow(chars, &cap, len, 1);
+                if (fread(chars + read, 1, cap - read, ser -> file) !=
+                    (size_t) (cap - read)) {
+                        free(chars);
+                        return NULL;
+                }
+                read = cap;
+        }
+        chars = realloc(chars, len + 1);
+        chars[len] = '\0';
+        return chars;
+}
+
+/*
+ * Purpose:    Read a symbol reference, interning the symbol if the stream
+ *             names it here.
+ * Parameters: A pointer to a reading cyser and a pointer to an int to
+ *             store the interned symbol id in.
+ * Return:     1 if a symbol was read, or 0 otherwise.
+ */
+static int cyser_get_sym(cyser* ser, int* id) {
+        int len;
+        uint64_t ref;
+        char* name;
+
+        if (!cyser_get(ser, &ref))
+                return 0;
+        if (ref != 0) {
+                if (ref > (uint64_t) ser -> len_syms)
+                        return 0;
+                *id = ser -> syms[ref - 1];
+                return 1;
+        }
+
+        if (!cyser_get_len(ser, &len) ||
+            (name = cyser_get_chars(ser, len)) == NULL)
+                return 0;
+        *id = cysym_intern_n(name, len);
+        free(name);
+
+        if (ser -> len_syms == ser -> cap_syms) {
+                ser -> cap_syms = ser -> cap_syms ?
+                                  ser -> cap_syms * 2 : CYSER_MIN_SLOTS;
+                ser -> syms = realloc(ser -> syms, sizeof(int) *
+                                                   ser -> cap_syms);
+        }
+        ser -> syms[ser -> len_syms++] = *id;
+        return 1;
+}
+
+/*
+ * Purpose:    Read the data of a value that has no children, after its
+ *             tag.
+ * Parameters: A pointer to a reading cyser and the int tag read.
+ * Return:     A pointer to the cyval read, or NULL if it is malformed.
+ */
+static cyval* cyser_get_leaf(cyser* ser, int tag) {
+        int i;
+        int id;
+        int len;
+        int cap = 0;
+        long num;
+        long* items = NULL;
+        uint64_t limb;
+        char* msg;
+        cybig big;
+        cynums* nums;
+        cyval* value;
+
+        if (tag == CYSER_NUM)
+                return cyser_get_signed(ser, &num) ? cyval_num(num) : NULL;
+        if (tag == CYSER_SYM)
+                return cyser_get_sym(ser, &id) ? CY_MAKE_SYM(id) : NULL;
+        if (tag == CYSER_FUN) {
+                if (!cyser_get_sym(ser, &id) || id >= CYSYM_BUILTINS)
+                        return NULL;
+                return CY_MAKE_FUN(id);
+        }
+
+        if (tag == CYSER_BIG) {
+                if (!cyser_get_signed(ser, &num) || num < -1 || num > 1 ||
+                    !cyser_get_len(ser, &len) || (num == 0) != (len == 0))
+                        return NULL;
+                big.sign = (int) num;
+                big.len_limbs = len;
+                big.limbs = NULL;
+                for (i = 0; i < len; i++) {
+                        if (!cyser_get(ser, &limb) || limb > UINT32_MAX) {
+                                free(big.limbs);
+                                return NULL;
+                        }
+                        if (i == cap)
+                                big.limbs = cyser_grow(big.limbs, &cap, len,
+                                                       sizeof(uint32_t));
+                        big.limbs[i] = (uint32_t) limb;
+                }
+                if (len > 0 && big.limbs[len - 1] == 0) {
+                        free(big.limbs);
+                        return NULL;
+                }
+                return cyval_big(&big);
+        }
+
+        if (tag == CYSER_NUMS) {
+                if (!cyser_get_len(ser, &len))
+                        return NULL;
+                for (i = 0; i < len; i++) {
+                        if (!cyser_get_signed(ser, &num)) {
+                                free(items);
+                                return NULL;
+                        }
+                        if (i == cap)
+                                items = cyser_grow(items, &cap, len,
+                                                   sizeof(long));
+                        items[i] = num;
+                }
+                nums = cynums_new(len);
+                if (len > 0)
+                        memcpy(nums -> items, items, sizeof(long) * len);
+                free(items);
+                return cyval_nums(nums);
+        }
+
+        if (tag == CYSER_ERROR) {
+                if (!cyser_get_len(ser, &len) ||
+                    (msg = cyser_get_chars(ser, len)) == NULL)
+                        return NULL;
+                value = cyval_error(msg);
+                free(msg);
+                return value;
+        }
+
+        return NULL;
+}
+
+/*
+ * Purpose:    Read the length of an expression after its tag, and make an
+ *             empty expression of its type with room for its children.
+ * Parameters: A pointer to a reading cyser, the int tag read and a pointer
+ *             to an int to store the number of children in.
+ * Return:     A pointer to the empty cyval expression, or NULL if the
+ *             length is malformed.
+ */
+static cyval* cyser_get_exp(cyser* ser, int tag, int* len) {
+        cyval* value;
+
+        if (!cyser_get_len(ser, len))
+                return NULL;
+        value = tag == CYSER_S_EXP ? cyval_s_exp() : cyval_q_exp();
+        if (*len > 0)
+                cyval_reserve(value, *len < CYSER_MAX_RESERVE ?
+                                     *len : CYSER_MAX_RESERVE);
+        return value;
+}
+
+/*
+ * Purpose:    Read the tag of the next value.
+ * Parameters: A pointer to a reading cyser.
+ * Return:     The int tag, or EOF if the stream has ended.
+ */
+static int cyser_get_tag(cyser* ser) {
+        uint64_t tag;
+
+        if (!cyser_get(ser, &tag))
+                return EOF;
+        return tag > CYSER_NUMS ? CYSER_NUMS + 1 : (int) tag;
+}
+
+/*
+ * Purpose:    Decode the next value of a stream, reading the file no
+ *             further than its end.
+ * Parameters: A pointer to a cyser made by cyser_reader.
+ * Return:     A pointer to the cyval read, owned by the caller, NULL if the
+ *             stream has ended, or a cyval error if it is malformed.
+ */
+cyval* cyser_read(cyser* ser) {
+        int tag;
+        int len;
+        cyval* root = NULL;
+        cyval* value;
+        cyserframe* top = NULL;
+
+        if ((tag = cyser_get_tag(ser)) == EOF)
+                return NULL;
+
+        /*
+         * Each expression is added to its parent as soon as it is made,
+         * and stays on the stack until its children have all been read.
+         */
+        ser -> len_frames = 0;
+        for (;;) {
+                len = 0;
+                if (tag == CYSER_S_EXP || tag == CYSER_Q_EXP)
+                        value = cyser_get_exp(ser, tag, &len);
+                else if (tag == EOF)
+                        value = NULL;
+                else
+                        value = cyser_get_leaf(ser, tag);
+                if (value == NULL)
+                        break;
+
+                if (root == NULL)
+                        root = value;
+                else
+                        cyval_add(ser -> frames[ser -> len_frames - 1].value,
+                                  value);
+                if (len > 0) {
+                        cyser_push(ser, value);
+                        ser -> frames[ser -> len_frames - 1].next = len;
+                }
+
+                /* Close the expressions whose children have all been read. */
+                while (ser -> len_frames > 0) {
+                        top = &ser -> frames[ser -> len_frames - 1];
+                        if (top -> next > 0)
+                                break;
+                        ser -> len_frames--;
+                }
+                if (ser -> len_frames == 0)
+                        return root;
+                top -> next--;
+                tag = cyser_get_tag(ser);
+        }
+
+        cyval_destructor(root);
+        return cyval_error("Malformed serialized value");
+}
+
+/*
+ * Purpose:    Start decoding the next value of a stream one child at a
+ *             time, if it is an S-expression or Q-expression, so a huge
+ *             list can be read without holding all of it. Each child is
+ *             then read with cyser_read.
+ * Parameters: A pointer to a cyser made by cyser_reader and a pointer to
+ *             an int to store the type of the expression in.
+ * Return:     The int number of children that follow, or -1 if the next
+ *             value is not an expression, in which case the stream can no
+ *             longer be read.
+ */
+int cyser_read_list(cyser* ser, int* type) {
+        int tag = cyser_get_tag(ser);
+        int len;
+
+        if ((tag != CYSER_S_EXP && tag != CYSER_Q_EXP) ||
+            !cyser_get_len(ser, &len))
+                return -1;
+        *type = tag == CYSER_S_EXP ? CYVAL_S_EXP : CYVAL_Q_EXP;
+
+        return len;
+}
+
+/*
+ * Purpose:    Deallocate a cyser, leaving its file open.
+ * Parameters: A pointer to a cyser, which may be NULL.
+ * Return:     Void
+ */
+void cyser_close(cyser* ser) {
+        if (ser == NULL)
+                return;
+        free(ser -> syms);
+        free(ser -> frames);
+        free(ser);
+}
@@ -0,0 +1,79 @@
+/*
+ * choccyser.h
+ * Header file for choccyser.c, declaring the compact binary encoding of
+ * cyvals, which writes and reads values as a stream without going through
+ * their text.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYSER_H
+#define CHOCCYSER_H
+
+#include "choccyparsing.h"
+
+/* Version of the encoding, changed whenever the encoding changes. */
+#define CYSER_VERSION 1
+
+/*
+ * Choccy serializer (cyser), a stream of encoded values being written to
+ * or read from a file, with the table of symbols it has named so far.
+ */
+typedef struct cyser cyser;
+
+/*
+ * Purpose:    Start writing encoded values to a file, writing the header
+ *             of the stream.
+ * Parameters: A FILE pointer to write to, which the cyser does not close.
+ * Return:     A pointer to a heap-allocated cyser.
+ */
+cyser* cyser_writer(FILE* out);
+
+/*
+ * Purpose:    Start reading encoded values from a file, reading the header
+ *             of the stream.
+ * Parameters: A FILE pointer to read from, which the cyser does not close.
+ * Return:     A pointer to a heap-allocated cyser, or NULL if the file does
+ *             not start with a stream of this version.
+ */
+cyser* cyser_reader(FILE* in);
+
+/*
+ * Purpose:    Deallocate a cyser, leaving its file open.
+ * Parameters: A pointer to a cyser, which may be NULL.
+ * Return:     Void
+ */
+void cyser_close(cyser* ser);
+
+/*
+ * Purpose:    Encode a value onto a stream.
+ * Parameters: A pointer to a cyser made by cyser_writer and a pointer to a
+ *             cyval, which is not consumed.
+ * Return:     1 if the value was written, or 0 if the file reported an
+ *             error.
+ */
+int cyser_write(cyser* ser, cyval* value);
+
+/*
+ * Purpose:    Decode the next value of a stream, reading the file no
+ *             further than its end.
+ * Parameters: A pointer to a cyser made by cyser_reader.
+ * Return:     A pointer to the cyval read, owned by the caller, NULL if the
+ *             stream has ended, or a cyval error if it is malformed.
+ */
+cyval* cyser_read(cyser* ser);
+
+/*
+ * Purpose:    Start decoding the next value of a stream one child at a
+ *             time, if it is an S-expression or Q-expression, so a huge
+ *             list can be read without holding all of it. Each child is
+ *             then read with cyser_read.
+ * Parameters: A pointer to a cyser made by cyser_reader and a pointer to
+ *             an int to store the type of the expression in.
+ * Return:     The int number of children that follow, or -1 if the next
+ *             value is not an expression, in which case the stream can no
+ *             longer be read.
+ */
+int cyser_read_list(cyser* ser, int* type);
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * choccysym.c
+ * The symbol interning table for Choccy. Names are stored once, indexed by
+ * id, and found again through an open-addressing hash table so that the
+ * evaluator can compare and dispatch on symbols as plain ints.
+ *
+ * The table is shared by every thread, so it is locked while in use.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "choccysym.h"
+
+/* Initial number of hash slots; always kept a power of two. */
+#define CYSYM_MIN_SLOTS 64
+
+/* Names of the builtin symbols, in the order of their enumeration. */
+static const char* cysym_builtin_names[CYSYM_BUILTINS] = {
+        "list", "head", "tail", "join", "eval",
+        "+", "-", "*", "/", "%", "^", "def", "=", "vec", "sum", "min", "max",
+        "dot", "memo", "==", "!=", "map", "filter", "fold", "save-image",
+        "serialize", "deserialize"
+};
+
+/* Interned names indexed by id. */
+static char** cysym_names = NULL;
+static int cysym_len_names = 0;
+static int cysym_cap_names = 0;
+
+/* Hash slots holding id + 1, or 0 when empty. */
+static int* cysym_slots = NULL;
+static int cysym_cap_slots = 0;
+
+/* Lock held while the table is read or changed. */
+static pthread_mutex_t cysym_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int cysym_find(const char* name, int len);
+
+/*
+ * Purpose:    Hash the chars of a name with FNV-1a.
+ * Parameters: A pointer to the chars to hash and an int number of chars.
+ * Return:     The unsigned hash of the chars.
+ */
+static unsigned cysym_hash(const char* name, int len) {
+        unsigned hash = 2166136261u;
+
+        while (len-- > 0) {
+                hash ^= (unsigned char) *name++;
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+/*
+ * Purpose:    Rebuild the hash slots with the given capacity.
+ * Parameters: An int capacity, a power of two.
+ * Return:     Void
+ */
+static void cysym_rehash(int capacity) {
+        int i;
+        unsigned j;
+
+        free(cysym_slots);
+        cysym_slots = calloc(capacity, sizeof(int));
+        cysym_cap_slots = capacity;
+        for (i = 0; i < cysym_len_names; i++) {
+                j = cysym_hash(cysym_names[i], strlen(cysym_names[i])) &
+                    (capacity - 1);
+                while (cysym_slots[j])
+                        j = (j + 1) & (capacity - 1);
+                cysym_slots[j] = i + 1;
+        }
+}
+
+/*
+ * Purpose:    Add a new name to the table without checking for an existing
+ *             entry.
+ * Parameters: A pointer to the chars of a symbol name, an int length and
+ *             the unsigned slot to store it in.
+ * Return:     The int id of the new symbol.
+ */
+static int cysym_insert(const char* name, int len, unsigned slot) {
+        int id = cysym_len_names;
+
+        if (cysym_len_names == cysym_cap_names) {
+                cysym_cap_names = cysym_cap_names ?
+                                  cysym_cap_names * 2 : CYSYM_MIN_SLOTS;
+                cysym_names = realloc(cysym_names,
+                                      sizeof(char*) * cysym_cap_names);
+        }
+        cysym_names[id] = malloc(len + 1);
+        memcpy(cysym_names[id], name, len);
+        cysym_names[id][len] = '\0';
+        cysym_len_names++;
+        cysym_slots[slot] = id + 1;
+
+        /* Keep the load factor at or below one half. */
+        if (cysym_len_names * 2 > cysym_cap_slots)
+                cysym_rehash(cysym_cap_slots * 2);
+
+        return id;
+}
+
+/*
+ * Purpose:    Create the table and seed it with the builtin symbols, so
+ *             their ids are valid before anything is interned.
+ * Parameters: Void
+ * Return:     Void
+ */
+static void cysym_seed(void) {
+        int i;
+
+        cysym_rehash(CYSYM_MIN_SLOTS);
+        for (i = 0; i < CYSYM_BUILTINS; i++)
+                cysym_find(cysym_builtin_names[i],
+                           strlen(cysym_builtin_names[i]));
+}
+
+/*
+ * Purpose:    Find a symbol name in the table, adding it if it has not
+ *             been seen before. The lock must be held.
+ * Parameters: A pointer to the chars of a symbol name and an int length.
+ * Return:     The int id uniquely identifying the symbol name.
+ */
+static int cysym_find(const char* name, int len) {
+        unsigned j;
+        char* found;
+
+        if (cysym_slots == NULL)
+                cysym_seed();
+
+        j = cysym_hash(name, len) & (cysym_cap_slots - 1);
+        while (cysym_slots[j]) {
+                found = cysym_names[cysym_slots[j] - 1];
+                if (strncmp(found, name, len) == 0 && found[len] == '\0')
+                        return cysym_slots[j] - 1;
+                j = (j + 1) & (cysym_cap_slots - 1);
+        }
+        return cysym_insert(name, len, j);
+}
+
+/*
+ * Purpose:    Intern a symbol name, adding it to the table if it has not
+ *             been seen before.
+ * Parameters: A c-string symbol name.
+ * Return:     The int id uniquely identifying the symbol name.
+ */
+int cysym_intern(const char* name) {
+        return cysym_intern_n(name, strlen(name));
+}
+
+/*
+ * Purpose:    Intern a symbol name given by its length rather than a null
+ *             char, such as a name read straight out of source text.
+ * Parameters: A pointer to the chars of a symbol name and an int length.
+ * Return:     The int id uniquely identifying the symbol name.
+ */
+int cysym_intern_n(const char* name, int len) {
+        int id;
+
+        pthread_mutex_lock(&cysym_lock);
+        id = cysym_find(name, len);
+        pthread_mutex_unlock(&cysym_lock);
+
+        return id;
+}
+
+/*
+ * Purpose:    Look up the name of an interned symbol.
+ * Parameters: An int id returned by cysym_intern.
+ * Return:     The interned c-string name, owned by the table.
+ */
+char* cysym_name(int id) {
+        char* name;
+
+        pthread_mutex_lock(&cysym_lock);
+        if (cysym_slots == NULL)
+                cysym_seed();
+        name = cysym_names[id];
+        pthread_mutex_unlock(&cysym_lock);
+
+        return name;
+}
+
+/*
+ * Purpose:    Count the interned symbols, whose ids run from 0 to one less
+ *             than the count.
+ * Parameters: Void
+ * Return:     The int number of interned symbols.
+ */
+int cysym_count(void) {
+        int count;
+
+        pthread_mutex_lock(&cysym_lock);
+        if (cysym_slots == NULL)
+                cysym_seed();
+        count = cysym_len_names;
+        pthread_mutex_unlock(&cysym_lock);
+
+        return count;
+}
@@ -0,0 +1,57 @@
+/*
+ * choccysym.h
+ * Header file for choccysym.c, declaring the symbol interning table that
+ * maps every distinct symbol name to a small unique int id.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYSYM_H
+#define CHOCCYSYM_H
+
+/*
+ * Enumeration of the symbols that name builtins. These are interned first,
+ * in this order, so a builtin's id can index the builtin dispatch table
+ * directly. CYSYM_BUILTINS is the number of builtin symbols.
+ */
+enum {
+        CYSYM_LIST, CYSYM_HEAD, CYSYM_TAIL, CYSYM_JOIN, CYSYM_EVAL,
+        CYSYM_ADD, CYSYM_SUB, CYSYM_MUL, CYSYM_DIV, CYSYM_MOD, CYSYM_POW,
+        CYSYM_DEF, CYSYM_PUT, CYSYM_VEC, CYSYM_SUM, CYSYM_MIN, CYSYM_MAX,
+        CYSYM_DOT, CYSYM_MEMO, CYSYM_EQ, CYSYM_NE, CYSYM_MAP, CYSYM_FILTER,
+        CYSYM_FOLD, CYSYM_SAVE_IMAGE, CYSYM_SERIALIZE,
+        CYSYM_DESERIALIZE, CYSYM_BUILTINS
+};
+
+/*
+ * Purpose:    Intern a symbol name, adding it to the table if it has not
+ *             been seen before.
+ * Parameters: A c-string symbol name.
+ * Return:     The int id uniquely identifying the symbol name.
+ */
+int cysym_intern(const char* name);
+
+/*
+ * Purpose:    Intern a symbol name given by its length rather than a null
+ *             char, such as a name read straight out of source text.
+ * Parameters: A pointer to the chars of a symbol name and an int length.
+ * Return:     The int id uniquely identifying the symbol name.
+ */
+int cysym_intern_n(const char* name, int len);
+
+/*
+ * Purpose:    Look up the name of an interned symbol.
+ * Parameters: An int id returned by cysym_intern.
+ * Return:     The interned c-string name, owned by the table.
+ */
+char* cysym_name(int id);
+
+/*
+ * Purpose:    Count the interned symbols, whose ids run from 0 to one less
+ *             than the count.
+ * Parameters: Void
+ * Return:     The int number of interned symbols.
+ */
+int cysym_count(void);
+
+#endif
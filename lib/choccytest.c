@@ -0,0 +1,859 @@
+/*
+ * choccytest.c
+ * Regression tests for the Choccy interpreter. Each test evaluates lines
+ * of Choccy as the REPL does, or drives a library interface directly, and
+ * compares what it prints or returns with what is expected. Failures are
+ * printed one per line, and the exit status is the number that failed,
+ * so `make test` stops on any of them.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "choccyparsing.h"
+#include "choccyenv.h"
+#include "choccyalloc.h"
+#include "choccyread.h"
+#include "choccysym.h"
+#include "choccycons.h"
+#include "choccymemo.h"
+#include "choccypar.h"
+#include "choccybatch.h"
+#include "choccyimage.h"
+#include "choccyser.h"
+#include "choccyhash.h"
+
+/* Number of checks run and failed so far. */
+static int cytest_runs = 0;
+static int cytest_failures = 0;
+
+/*
+ * Purpose:    Record the outcome of a check, printing it if it failed.
+ * Parameters: An int that is nonzero if the check passed, a c-string name
+ *             of the test, and c-strings of the value expected and the
+ *             value found, which may be NULL.
+ * Return:     Void
+ */
+static void cytest_check(int passed, const char* name, const char* expected,
+                         const char* found) {
+        cytest_runs++;
+        if (passed)
+                return;
+        cytest_failures++;
+        printf("FAIL %s", name);
+        if (expected != NULL)
+                printf(": expected %s, got %s", expected,
+                       found != NULL ? found : "nothing");
+        printf("\n");
+}
+
+/*
+ * Purpose:    Evaluate a line of Choccy as the REPL does and catch what it
+ *             prints.
+ * Parameters: A pointer to the cyenv to evaluate in, a pointer to the
+ *             cygrammar, a c-string name of the input and a c-string line
+ *             of code.
+ * Return:     A heap c-string of what was printed, without its newline.
+ */
+static char* cytest_output(cyenv* env, cygrammar* grammar, const char* name,
+                           const char* input) {
+        char* found = NULL;
+        size_t len = 0;
+        FILE* out = open_memstream(&found, &len);
+
+        eval_print_line(env, (char*) name, (char*) input, grammar -> line,
+                        out);
+        fclose(out);
+        if (len > 0 && found[len - 1] == '\n')
+                found[--len] = '\0';
+        return found;
+}
+
+/*
+ * Purpose:    Evaluate a line of Choccy as the REPL does and check what it
+ *             prints.
+ * Parameters: A pointer to the cyenv to evaluate in, a pointer to the
+ *             cygrammar, a c-string name of the test, a c-string line of
+ *             code and the c-string it should print, without its newline.
+ * Return:     Void
+ */
+static void cytest_line(cyenv* env, cygrammar* grammar, const char* name,
+                        const char* input, const char* expected) {
+        char* found = cytest_output(env, grammar, name, input);
+
+        cytest_check(strcmp(found, expected) == 0, name, expected, found);
+        free(found);
+}
+
+/*
+ * Purpose:    Make a Q-expression nested to the given depth, such as
+ *             {{{1}}}, optionally inside a line of code.
+ * Parameters: A c-string to put before it, an int depth and a c-string to
+ *             put after it.
+ * Return:     A heap c-string.
+ */
+static char* cytest_nested(const char* before, int depth, const char* after) {
+        size_t len = strlen(before);
+        char* s = malloc(len + depth * 2 + 2 + strlen(after));
+
+        strcpy(s, before);
+        memset(s + len, '{', depth);
+        s[len + depth] = '1';
+        memset(s + len + depth + 1, '}', depth);
+        strcpy(s + len + depth * 2 + 1, after);
+        return s;
+}
+
+/*
+ * Purpose:    Check that values nested deeper than the C stack could
+ *             recurse are evaluated, printed, defined and released.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_deep(cyenv* env, cygrammar* grammar) {
+        int depth = 200000;
+        char* deep = cytest_nested("", depth, "");
+        char* def = cytest_nested("(def {deep} ", depth, ")");
+        cyenv* loaded = cyenv_new(NULL);
+
+        cytest_line(env, grammar, "deep_print", deep, deep);
+        cytest_line(env, grammar, "deep_def", def, "()");
+        cytest_line(env, grammar, "deep_def", "deep", deep);
+        cytest_line(env, grammar, "deep_image", "(save-image {deep})", "()");
+        cytest_check(cyimage_load(loaded, "deep") == NULL, "deep_image",
+                     NULL, NULL);
+        cytest_line(loaded, grammar, "deep_image", "deep", deep);
+
+        remove("deep");
+        cyenv_delete(loaded);
+        free(def);
+        free(deep);
+}
+
+/*
+ * Purpose:    Check that numbers overflowing a long are promoted to big
+ *             integers, and that results fitting one are demoted again.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_big(cyenv* env, cygrammar* grammar) {
+        static const char* cases[][2] = {
+                { "(+ 9223372036854775807 1)", "9223372036854775808" },
+                { "(* 4294967296 4294967296)", "18446744073709551616" },
+                { "(- -9223372036854775808 1)", "-9223372036854775809" },
+                { "(- 9223372036854775808 1)", "9223372036854775807" },
+                { "(- -9223372036854775808)", "9223372036854775808" },
+                { "(* -9223372036854775808 -1)", "9223372036854775808" },
+                { "(/ -9223372036854775808 -1)", "9223372036854775808" },
+                { "(% -9223372036854775808 -1)", "0" },
+                { "(% 100000000000000000000 7)", "2" },
+                { "(% -7 3)", "-1" },
+                { "(^ 2 100)", "1267650600228229401496703205376" },
+                { "(^ 3 0)", "1" },
+                { "(^ 2 -1)", "Error: Negative exponent" },
+                { "(/ 100000000000000000000 100000000000000000000)", "1" }
+        };
+        int n = sizeof(cases) / sizeof(cases[0]);
+        int i;
+
+        for (i = 0; i < n; i++)
+                cytest_line(env, grammar, "big", cases[i][0], cases[i][1]);
+}
+
+/*
+ * Purpose:    Check that numeric vectors are packed from Q-expressions of
+ *             numbers that fit in a long, and from nothing else.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_vec(cyenv* env, cygrammar* grammar) {
+        cytest_line(env, grammar, "vec", "(+ (vec {1 2 3}) 10)",
+                    "[11 12 13]");
+        cytest_line(env, grammar, "vec_big",
+                    "(vec {1 123456789012345678901234567890})",
+                    "Error: \"vec\" function passed a big integer, which "
+                    "cannot be packed into a numeric vector");
+        cytest_line(env, grammar, "vec_non_number", "(vec {1 a})",
+                    "Error: \"vec\" function passed non-number");
+}
+
+/*
+ * Purpose:    Check that the folded body cached for a stored Q-expression
+ *             is used again, and is not once a builtin it calls is rebound.
+ * Parameters: A pointer to the cygrammar.
+ * Return:     Void
+ */
+static void cytest_fold(cygrammar* grammar) {
+        cyenv* env = cyenv_new(NULL);
+
+        cyenv_add_builtins(env);
+        cytest_line(env, grammar, "fold", "(def {t} {+ 2 3})", "()");
+        cytest_line(env, grammar, "fold", "(eval t)", "5");
+        cytest_line(env, grammar, "fold_cached", "(eval t)", "5");
+        cytest_line(env, grammar, "fold_rebound", "(def {+} -)", "()");
+        cytest_line(env, grammar, "fold_rebound", "(eval t)", "-1");
+        cyenv_delete(env);
+}
+
+/*
+ * Purpose:    Evaluate the one expression on a line of Choccy.
+ * Parameters: A pointer to the cyenv to evaluate in and a c-string line of
+ *             code.
+ * Return:     A pointer to the cyval result, allocated from the arena if it
+ *             is open.
+ */
+static cyval* cytest_eval(cyenv* env, const char* input) {
+        cyval* line;
+
+        if (!cyread_line(input, &line))
+                return cyval_error("Unreadable test line");
+        return cyval_evaluate(env, cyval_take(line, 0));
+}
+
+/*
+ * Purpose:    Check that memo shares the result it remembered when it is
+ *             asked again, and evaluates afresh once a symbol the
+ *             expression reaches is rebound.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_memo(cyenv* env, cygrammar* grammar) {
+        cyval* first;
+        cyval* again;
+
+        cytest_line(env, grammar, "memo", "(def {x f} 2 {list x 3})", "()");
+        cytest_line(env, grammar, "memo", "(memo f)", "{2 3}");
+
+        /* A hit is a copy of the remembered result, sharing its vector. */
+        cyalloc_arena_begin();
+        first = cytest_eval(env, "(memo f)");
+        again = cytest_eval(env, "(memo f)");
+        cytest_check(first -> vec != NULL && first -> vec == again -> vec,
+                     "memo_hit", NULL, NULL);
+        cyalloc_arena_reset();
+
+        cytest_line(env, grammar, "memo_miss", "(def {x} 5)", "()");
+        cytest_line(env, grammar, "memo_miss", "(memo f)", "{5 3}");
+}
+
+/*
+ * Purpose:    Check that with hash-consing on, equal stored lists share one
+ *             vector, that == and != compare by structure, and that
+ *             changing a shared list leaves the others as they were.
+ * Parameters: A pointer to the cygrammar.
+ * Return:     Void
+ */
+static void cytest_cons(cygrammar* grammar) {
+        cyenv* env = cyenv_new(NULL);
+        cyval* a;
+        cyval* b;
+
+        cyenv_add_builtins(env);
+        cycons_enable(1);
+        cytest_line(env, grammar, "cons", "(def {a b c} {1 {2 3}} "
+                    "(list 1 {2 3}) {1 {2 4}})", "()");
+        a = cyenv_lookup(env, cysym_intern("a"));
+        b = cyenv_lookup(env, cysym_intern("b"));
+        cytest_check(a -> vec == b -> vec, "cons_shared", NULL, NULL);
+        cytest_line(env, grammar, "cons_eq", "(== a b)", "1");
+        cytest_line(env, grammar, "cons_eq", "(!= a b)", "0");
+        cytest_line(env, grammar, "cons_eq", "(== a c)", "0");
+        cytest_line(env, grammar, "cons_eq", "(!= a c)", "1");
+        cytest_line(env, grammar, "cons_eq", "(== (tail a) {{2 3}})", "1");
+        cytest_line(env, grammar, "cons_eq", "(== 1 {1})", "0");
+        cytest_line(env, grammar, "cons_changed",
+                    "(def {b} (join b {5}))", "()");
+        cytest_line(env, grammar, "cons_changed", "a", "{1 {2 3}}");
+        cytest_line(env, grammar, "cons_changed", "b", "{1 {2 3} 5}");
+        cytest_line(env, grammar, "cons_changed", "(== a b)", "0");
+        cycons_enable(0);
+        cyenv_delete(env);
+}
+
+/*
+ * Purpose:    Check that "map", "filter" and "fold" walk Q-expressions and
+ *             numeric vectors alike, keeping the order of the elements.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_apply(cyenv* env, cygrammar* grammar) {
+        static const char* cases[][2] = {
+                { "(map {* 2} {1 2 3})", "{2 4 6}" },
+                { "(map {* 2} (vec {1 2 3}))", "[2 4 6]" },
+                { "(map - (vec {1 -2}))", "[-1 2]" },
+                { "(map {* 2} (vec {}))", "[]" },
+                { "(filter {== 2} (vec {1 2 3 2}))", "[2 2]" },
+                { "(filter {+ 1} (vec {-1 0 1}))", "[0 1]" },
+                { "(fold + 0 (vec {1 2 3}))", "6" },
+                { "(fold join {0} {{1} {2} {3}})", "{0 1 2 3}" },
+                { "(fold + 5 (vec {}))", "5" },
+                { "(fold + 0 (vec {9223372036854775807 1}))",
+                  "9223372036854775808" },
+                { "(map {list} (vec {1 2}))",
+                  "Error: \"map\" function passed function returning a "
+                  "value that cannot be packed into a numeric vector" },
+                { "(map {* 4611686018427387904} (vec {1 2}))",
+                  "Error: \"map\" function passed function returning a "
+                  "value that cannot be packed into a numeric vector" },
+                { "(map {/ 1} (vec {1 0}))", "Error: Division by zero" },
+                { "(filter {list} (vec {1}))",
+                  "Error: \"filter\" function passed predicate "
+                  "returning non-number" },
+                { "(map {* 2} 3)",
+                  "Error: \"map\" function passed incorrect types" }
+        };
+        int n = sizeof(cases) / sizeof(cases[0]);
+        int i;
+
+        for (i = 0; i < n; i++)
+                cytest_line(env, grammar, "apply", cases[i][0], cases[i][1]);
+}
+
+/*
+ * Purpose:    Check that corrupt serialized streams are read as malformed
+ *             values rather than claiming the memory their lengths ask for.
+ * Parameters: None
+ * Return:     Void
+ */
+static void cytest_corrupt_streams(void) {
+        /* Version 1, then a tag and a length of 2^31 - 1. */
+        static const char* streams[] = {
+                "CYSR\x01\x07\xff\xff\xff\xff\x07",
+                "CYSR\x01\x01\x02\xff\xff\xff\xff\x07",
+                "CYSR\x01\x06\xff\xff\xff\xff\x07",
+                "CYSR\x01\x07\x03\x02\x04",
+                "CYSR\x01\x02\xff\xff\xff\xff\x07" "abc"
+        };
+        int n = sizeof(streams) / sizeof(streams[0]);
+        int i;
+        FILE* file;
+        cyser* ser;
+        cyval* value;
+
+        for (i = 0; i < n; i++) {
+                file = fmemopen((void*) streams[i], strlen(streams[i]), "rb");
+                ser = cyser_reader(file);
+                value = ser != NULL ? cyser_read(ser) : NULL;
+                cytest_check(value != NULL &&
+                             CY_TYPE(value) == CYVAL_ERROR,
+                             "corrupt_stream", NULL, NULL);
+                if (value != NULL)
+                        cyval_destructor(value);
+                cyser_close(ser);
+                fclose(file);
+        }
+}
+
+/*
+ * Purpose:    Check that a large Q-expression written as one value can be
+ *             read back child by child.
+ * Parameters: None
+ * Return:     Void
+ */
+static void cytest_read_list(void) {
+        int n = 200000;
+        int i;
+        int type = -1;
+        int len;
+        int same = 1;
+        FILE* file = tmpfile();
+        cyser* ser = cyser_writer(file);
+        cyval* list = cyval_q_exp();
+        cyval* child;
+
+        for (i = 0; i < n; i++)
+                cyval_add(list, i % 3 == 0 ? cyval_sym(i % 2 ? "x" : "y") :
+                                              cyval_num(i));
+        cytest_check(cyser_write(ser, list), "read_list", NULL, NULL);
+        cyser_close(ser);
+
+        rewind(file);
+        ser = cyser_reader(file);
+        len = cyser_read_list(ser, &type);
+        cytest_check(len == n && type == CYVAL_Q_EXP, "read_list", NULL,
+                     NULL);
+        for (i = 0; i < len && same; i++) {
+                child = cyser_read(ser);
+                same = child != NULL && cyval_equal(child, list -> cyvals[i]);
+                if (child != NULL)
+                        cyval_destructor(child);
+        }
+        cytest_check(same && cyser_read(ser) == NULL, "read_list", NULL,
+                     NULL);
+
+        cyser_close(ser);
+        fclose(file);
+        cyval_destructor(list);
+}
+
+/*
+ * Purpose:    Parse a file with a regular expression from the given offset
+ *             and check its output, or that it fails with an error
+ *             containing the given text.
+ * Parameters: A FILE pointer, a c-string regular expression, a long
+ *             offset, an int that is 1 if the parse should succeed, and
+ *             the c-string output or part of the error expected.
+ * Return:     Void
+ */
+static void cytest_parse_file(FILE* file, const char* re, long offset,
+                              int succeeds, const char* expected) {
+        mpc_result_t result;
+        mpc_parser_t* parser = mpc_re(re);
+        char* found;
+        int passed;
+
+        fseek(file, offset, SEEK_SET);
+        if (mpc_parse_file("<test>", file, parser, &result)) {
+                found = result.output;
+                passed = succeeds && strcmp(found, expected) == 0;
+        } else {
+                found = mpc_err_string(result.error);
+                passed = !succeeds && strstr(found, expected) != NULL;
+                mpc_err_delete(result.error);
+        }
+        cytest_check(passed, "parse_file", expected, found);
+        free(found);
+        mpc_delete(parser);
+}
+
+/*
+ * Purpose:    Check that files are parsed from where they are positioned,
+ *             whether a regular expression's DFA matches, overshoots its
+ *             match or fails.
+ * Parameters: None
+ * Return:     Void
+ */
+static void cytest_parse_files(void) {
+        FILE* file = tmpfile();
+
+        fputs("123\nabc\n4567z", file);
+        cytest_parse_file(file, "[0-9]+", 0, 1, "123");
+        cytest_parse_file(file, "[0-9]+", 4, 0, "at 'a'");
+        cytest_parse_file(file, "[0-9]+", 8, 1, "4567");
+        cytest_check(ftell(file) == 12, "parse_file", NULL, NULL);
+        cytest_parse_file(file, "[0-9]+z?", 8, 1, "4567z");
+        cytest_parse_file(file, "[0-9]+(zz)?", 8, 1, "4567");
+        cytest_check(ftell(file) == 12, "parse_file", NULL, NULL);
+        fclose(file);
+}
+
+/*
+ * Purpose:    Check that values round trip through serialize and
+ *             deserialize, and that memo evaluates the builtins that touch
+ *             files every time instead of remembering their results.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_serialize(cyenv* env, cygrammar* grammar) {
+        cytest_line(env, grammar, "serialize_round_trip",
+                    "(serialize {s} {(vec {1 2 3}) "
+                    "123456789012345678901234567890 {a (b)}})", "()");
+        cytest_line(env, grammar, "serialize_round_trip",
+                    "(deserialize {s})",
+                    "{(vec {1 2 3}) 123456789012345678901234567890 {a (b)}}");
+        cytest_line(env, grammar, "serialize_round_trip",
+                    "(serialize {s} (vec {1 2 3}))", "()");
+        cytest_line(env, grammar, "serialize_round_trip",
+                    "(deserialize {s})", "[1 2 3]");
+
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(serialize {d} 1)", "()");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(memo {deserialize {d}})", "1");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(serialize {d} 2)", "()");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(memo {deserialize {d}})", "2");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(memo {serialize {d} 3})", "()");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(serialize {d} 4)", "()");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(memo {serialize {d} 3})", "()");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(deserialize {d})", "3");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(memo {save-image {i}})", "()");
+        remove("i");
+        cytest_line(env, grammar, "memo_file_builtins",
+                    "(memo {save-image {i}})", "()");
+        cytest_check(access("i", F_OK) == 0, "memo_file_builtins",
+                     NULL, NULL);
+
+        remove("s");
+        remove("d");
+        remove("i");
+}
+
+/*
+ * Purpose:    Make a call of eight arguments, each a call of its own large
+ *             enough to be evaluated as a task, such as
+ *             (+ (* 1 (+ 1 2 ...)) (* 2 (+ 38 39 ...)) ...).
+ * Parameters: A c-string head for the outer call, a c-string builtin
+ *             for the inner calls, and a c-string argument put at the end
+ *             of the last inner call.
+ * Return:     A heap c-string.
+ */
+static char* cytest_wide(const char* outer, const char* inner,
+                         const char* last) {
+        int calls = 8;
+        int args = CYPAR_MIN_NODES + 8;
+        char* s = malloc(calls * args * 8 + 256 + strlen(last));
+        char* at = s;
+        int i;
+        int j;
+
+        at += sprintf(at, "(%s", outer);
+        for (i = 0; i < calls; i++) {
+                at += sprintf(at, " (* %d (%s", i + 1, inner);
+                for (j = 0; j < args; j++)
+                        at += sprintf(at, " %d", (i * 37 + j) % 50 + 1);
+                at += sprintf(at, "%s%s))", i == calls - 1 ? " " : "",
+                              i == calls - 1 ? last : "");
+        }
+        strcpy(at, ")");
+        return s;
+}
+
+/*
+ * Purpose:    Make the numbers from 1 to n, separated by spaces, inside a
+ *             line of code.
+ * Parameters: A c-string to put before them, an int n and a c-string to
+ *             put after them.
+ * Return:     A heap c-string.
+ */
+static char* cytest_range(const char* before, int n, const char* after) {
+        char* s = malloc(strlen(before) + n * 12 + strlen(after) + 1);
+        char* at = s + sprintf(s, "%s", before);
+        int i;
+
+        for (i = 1; i <= n; i++)
+                at += sprintf(at, i > 1 ? " %d" : "%d", i);
+        strcpy(at, after);
+        return s;
+}
+
+/*
+ * Purpose:    Check that starting the thread pool does not change what any
+ *             line evaluates to, by evaluating large pure calls serially,
+ *             then again with the pool running. The pool runs until the
+ *             program exits, so this runs last.
+ * Parameters: A pointer to the cygrammar.
+ * Return:     Void
+ */
+static void cytest_parallel(cygrammar* grammar) {
+        char* lines[] = {
+                cytest_wide("+", "+", "x"),
+                cytest_wide("*", "+", "x"),
+                cytest_wide("+", "*", "x"),
+                cytest_wide("-", "/", "0"),
+                cytest_wide("list", "+", "(+ x 1)"),
+                cytest_wide("def {y a b c d e f g}", "+", "x"),
+                cytest_wide("+ y", "+", "g"),
+                cytest_range("(map {* x} {", 2000, "})"),
+                cytest_range("(map {* x} (vec {", 2000, "}))"),
+                cytest_range("(filter {% 7} (vec {", 2000, "}))"),
+                cytest_range("(fold + 0 (map {* x} (vec {", 2000, "})))"),
+                cytest_range("(fold join {} (map {list} {", 2000, "}))"),
+                strdup("y")
+        };
+        int n = sizeof(lines) / sizeof(lines[0]);
+        char* serial[sizeof(lines) / sizeof(lines[0])];
+        char* parallel;
+        cyenv* env;
+        int pass;
+        int i;
+
+        for (pass = 0; pass < 2; pass++) {
+                if (pass == 1)
+                        cypar_start(4);
+                env = cyenv_new(NULL);
+                cyenv_add_builtins(env);
+                cytest_line(env, grammar, "parallel", "(def {x} 3)", "()");
+                for (i = 0; i < n; i++) {
+                        if (pass == 0) {
+                                serial[i] = cytest_output(env, grammar,
+                                                          "parallel",
+                                                          lines[i]);
+                                continue;
+                        }
+                        parallel = cytest_output(env, grammar, "parallel",
+                                                 lines[i]);
+                        cytest_check(strcmp(parallel, serial[i]) == 0,
+                                     "parallel", serial[i], parallel);
+                        free(parallel);
+                        free(serial[i]);
+                }
+                cyenv_delete(env);
+        }
+        for (i = 0; i < n; i++)
+                free(lines[i]);
+}
+
+/*
+ * Purpose:    Print a cyval into a heap c-string.
+ * Parameters: A pointer to a cyval, which is not consumed.
+ * Return:     A heap c-string.
+ */
+static char* cytest_print(cyval* value) {
+        char* found = NULL;
+        size_t len = 0;
+        FILE* out = open_memstream(&found, &len);
+
+        print_cyval(value, out);
+        fclose(out);
+        return found;
+}
+
+/*
+ * Purpose:    Check that an image made by another process, whose symbols
+ *             were interned with other ids, loads at an address other than
+ *             the one it was laid out for with its pointers and symbols
+ *             fixed up.
+ * Parameters: A pointer to the cygrammar.
+ * Return:     Void
+ */
+static void cytest_image(cygrammar* grammar) {
+        int fd;
+        int status;
+        pid_t child;
+        void* block;
+        const char* error;
+        cyenv* env;
+
+        /* Make the image in a child, which interns its own symbols first. */
+        if ((child = fork()) == 0) {
+                env = cyenv_new(NULL);
+                cyenv_add_builtins(env);
+                cysym_intern("cytest_child_only");
+                free(cytest_output(env, grammar, "image",
+                                   "(def {ia ib ic id} 40 {+ ia 2} "
+                                   "{x {y (z)} 123456789012345678901234567890} "
+                                   "(vec {1 2 3}))"));
+                free(cytest_output(env, grammar, "image",
+                                   "(save-image {image})"));
+                _exit(access("image", F_OK) != 0);
+        }
+        waitpid(child, &status, 0);
+        cytest_check(child > 0 && WIFEXITED(status) &&
+                     WEXITSTATUS(status) == 0, "image_saved", NULL, NULL);
+
+        /* Take the ids and the address the image was made for. */
+        cysym_intern("cytest_parent_only");
+        cysym_intern("cytest_parent_too");
+        fd = open("image", O_RDONLY);
+        block = mmap((void*) CYIMAGE_BASE, 4096, PROT_READ, MAP_PRIVATE,
+                     fd, 0);
+        close(fd);
+
+        env = cyenv_new(NULL);
+        cyenv_add_builtins(env);
+        error = cyimage_load(env, "image");
+        cytest_check(error == NULL, "image_load", NULL, error);
+        cytest_line(env, grammar, "image_load", "ia", "40");
+        cytest_line(env, grammar, "image_load", "(eval ib)", "42");
+        cytest_line(env, grammar, "image_load", "ic",
+                    "{x {y (z)} 123456789012345678901234567890}");
+        cytest_line(env, grammar, "image_load", "(== (head ic) {x})", "1");
+        cytest_line(env, grammar, "image_load", "(+ id 1)", "[2 3 4]");
+        cytest_line(env, grammar, "image_load", "(def {ia} 1)", "()");
+        cytest_line(env, grammar, "image_load", "(eval ib)", "3");
+
+        cyenv_delete(env);
+        if (block != MAP_FAILED)
+                munmap(block, 4096);
+        remove("image");
+}
+
+/*
+ * Purpose:    Check that the MPC grammar reads valid lines as the reader
+ *             does, and reports where invalid ones go wrong.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to the
+ *             cygrammar.
+ * Return:     Void
+ */
+static void cytest_grammar(cyenv* env, cygrammar* grammar) {
+        static const char* valid[] = {
+                "(+ 1 -2 {a b {c}} (- 3))",
+                "-5",
+                "- 5",
+                "  ( list  1 {} () ) ",
+                "{x_1 <= != \\ ^ %}",
+                "123456789012345678901234567890"
+        };
+        static const char* invalid[][2] = {
+                { "(+ 1", "grammar:1:5: error: expected one of "
+                  "'0123456789', '-', one or more of one of '0123456789', "
+                  "one or more of one of "
+                  "'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                  "0123456789_+-*/\\=<>!&%^', '(', '{' or ')' at end of "
+                  "input" },
+                { "(a $ b)", "grammar:1:4: error: expected '-', one or "
+                  "more of one of '0123456789', one or more of one of "
+                  "'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                  "0123456789_+-*/\\=<>!&%^', '(', '{' or ')' at '$'" },
+                { "{1 2)", "grammar:1:5: error: expected one of "
+                  "'0123456789', '-', one or more of one of '0123456789', "
+                  "one or more of one of "
+                  "'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                  "0123456789_+-*/\\=<>!&%^', '(', '{' or '}' at ')'" }
+        };
+        int n_valid = sizeof(valid) / sizeof(valid[0]);
+        int n_invalid = sizeof(invalid) / sizeof(invalid[0]);
+        int i;
+        char* expected;
+        char* found;
+        cyval* value;
+        mpc_result_t result;
+
+        for (i = 0; i < n_valid; i++) {
+                cyalloc_arena_begin();
+                if (!cyread_line(valid[i], &value) ||
+                    !mpc_parse("grammar", valid[i], grammar -> line,
+                               &result)) {
+                        cytest_check(0, "grammar_valid", valid[i], NULL);
+                        cyalloc_arena_reset();
+                        continue;
+                }
+                expected = cytest_print(value);
+                value = cyval_read_tree(result.output);
+                mpc_ast_delete(result.output);
+                found = cytest_print(value);
+                cytest_check(strcmp(found, expected) == 0, "grammar_valid",
+                             expected, found);
+                free(found);
+                free(expected);
+                cyalloc_arena_reset();
+        }
+        for (i = 0; i < n_invalid; i++)
+                cytest_line(env, grammar, "grammar", invalid[i][0],
+                            invalid[i][1]);
+}
+
+/*
+ * Purpose:    Check that a batch run on the thread pool prints the output
+ *             of its scripts in order of name, though the later scripts,
+ *             being shorter, tend to finish first.
+ * Parameters: A pointer to the cygrammar and an int number of threads.
+ * Return:     Void
+ */
+static void cytest_batch(cygrammar* grammar, int jobs) {
+        int scripts = 24;
+        int saved;
+        int status;
+        long len;
+        long m;
+        char dir[] = "/tmp/choccy-batch-XXXXXX";
+        char path[64];
+        char* code;
+        char* expected = malloc(scripts * 64 + 1);
+        char* at = expected;
+        char* found;
+        FILE* file;
+        FILE* out;
+        int i;
+
+        if (mkdtemp(dir) == NULL) {
+                cytest_check(0, "batch_dir", NULL, NULL);
+                free(expected);
+                return;
+        }
+        for (i = 0; i < scripts; i++) {
+                /* Script i sums 2, 4, ..., 2m, which is m(m + 1). */
+                m = (scripts - i) * 40;
+                code = cytest_range("(fold + 0 (map {* 2} {", m, "}))");
+                sprintf(path, "%s/s%02d", dir, i);
+                file = fopen(path, "w");
+                fprintf(file, "(def {n} %d)\n%s\nn\n%s", i, code,
+                        i % 5 == 0 ? "(/ n 0)\n" : "");
+                fclose(file);
+                free(code);
+                at += sprintf(at, "()\n%ld\n%d\n%s", m * (m + 1), i,
+                              i % 5 == 0 ? "Error: Division by zero\n" : "");
+        }
+        /* Hidden files are not scripts. */
+        sprintf(path, "%s/.hidden", dir);
+        file = fopen(path, "w");
+        fprintf(file, "(hidden)\n");
+        fclose(file);
+
+        out = tmpfile();
+        fflush(stdout);
+        saved = dup(STDOUT_FILENO);
+        dup2(fileno(out), STDOUT_FILENO);
+        status = cybatch_run(dir, jobs, grammar -> line);
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+
+        len = lseek(fileno(out), 0, SEEK_END);
+        found = malloc(len + 1);
+        rewind(out);
+        len = fread(found, 1, len, out);
+        found[len] = '\0';
+        fclose(out);
+        cytest_check(status == 0 && strcmp(found, expected) == 0, "batch",
+                     expected, found);
+        free(found);
+        free(expected);
+
+        remove(path);
+        for (i = 0; i < scripts; i++) {
+                sprintf(path, "%s/s%02d", dir, i);
+                remove(path);
+        }
+        rmdir(dir);
+}
+
+/*
+ * Purpose:    Run the tests.
+ * Parameters: None
+ * Return:     The int number of checks that failed.
+ */
+int main(void) {
+        char dir[] = "/tmp/choccy-test-XXXXXX";
+        cygrammar* grammar = cygrammar_new();
+        cyenv* env = cyenv_new(NULL);
+
+        cyenv_add_builtins(env);
+        if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+                perror("choccy-test");
+                return 1;
+        }
+
+        cytest_deep(env, grammar);
+        cytest_big(env, grammar);
+        cytest_vec(env, grammar);
+        cytest_fold(grammar);
+        cytest_memo(env, grammar);
+        cytest_cons(grammar);
+        cytest_apply(env, grammar);
+        cytest_grammar(env, grammar);
+        cytest_image(grammar);
+        cytest_corrupt_streams();
+        cytest_read_list();
+        cytest_serialize(env, grammar);
+        cytest_parse_files();
+        cytest_parallel(grammar);
+        cytest_batch(grammar, 4);
+
+        if (chdir("/") == 0)
+                rmdir(dir);
+
+        cymemo_clear();
+        cyenv_delete(env);
+        cygrammar_delete(grammar);
+
+        printf("%d of %d checks passed\n", cytest_runs - cytest_failures,
+               cytest_runs);
+        return cytest_failures;
+}
@@ -0,0 +1,451 @@
+/*
+ * choccyvm.c
+ * A bytecode compiler and stack virtual machine for Choccy. Expressions
+ * read by the parser are compiled once into a flat array of instructions,
+ * which the virtual machine then executes without re-walking the tree.
+ *
+ * Last edited: 10/16/26
+ */
+
+#include "choccyvm.h"
+#include "choccyenv.h"
+#include "choccyfold.h"
+#include "choccypar.h"
+
+/* Initial number of slots allocated for code, constants and the stack. */
+#define CYVM_MIN_SLOTS 16
+
+/* The value stack shared by every program running on this thread. */
+static _Thread_local cyval** cyvm_stack = NULL;
+static _Thread_local int cyvm_len_stack = 0;
+static _Thread_local int cyvm_cap_stack = 0;
+
+/* A program waiting on a call to "eval", and where to resume it. */
+typedef struct cyframe {
+        cyprog* prog;
+        int pc;
+} cyframe;
+
+/*
+ * The frame stack, holding the program and resume point of each program
+ * waiting on a call to "eval". Like the value stack, it is kept between
+ * runs so its memory is reused from line to line.
+ */
+static _Thread_local cyframe* cyvm_frames = NULL;
+static _Thread_local int cyvm_len_frames = 0;
+static _Thread_local int cyvm_cap_frames = 0;
+
+/* An expression waiting to be compiled, on the compiler's work stack. */
+typedef struct cywork {
+        cyval* value;
+        int visited;
+} cywork;
+
+/* The compiler's work stack, also kept between compilations. */
+static _Thread_local cywork* cyprog_work = NULL;
+static _Thread_local int cyprog_len_work = 0;
+static _Thread_local int cyprog_cap_work = 0;
+
+/*
+ * Purpose:    Append a word of bytecode to a program, growing its code
+ *             array geometrically.
+ * Parameters: A pointer to a cyprog and an int word to append.
+ * Return:     Void
+ */
+static void cyprog_emit(cyprog* prog, int word) {
+        if (prog -> len_code == prog -> cap_code) {
+                prog -> cap_code = prog -> cap_code ?
+                                   prog -> cap_code * 2 : CYVM_MIN_SLOTS;
+                prog -> code = realloc(prog -> code,
+                                       sizeof(int) * prog -> cap_code);
+        }
+        prog -> code[prog -> len_code++] = word;
+}
+
+/*
+ * Purpose:    Add a cyval to a program's constant pool, which takes
+ *             ownership of it.
+ * Parameters: A pointer to a cyprog and a pointer to a cyval constant.
+ * Return:     The int index of the constant in the pool.
+ */
+static int cyprog_const(cyprog* prog, cyval* value) {
+        if (prog -> len_consts == prog -> cap_consts) {
+                prog -> cap_consts = prog -> cap_consts ?
+                                     prog -> cap_consts * 2 : CYVM_MIN_SLOTS;
+                prog -> consts = realloc(prog -> consts,
+                                         sizeof(cyval*) * prog -> cap_consts);
+        }
+        prog -> consts[prog -> len_consts] = value;
+        return prog -> len_consts++;
+}
+
+/*
+ * Purpose:    Push an expression onto the compiler's work stack.
+ * Parameters: A pointer to the cyval to compile and an int that is nonzero
+ *             if its children have already been scheduled.
+ * Return:     Void
+ */
+static void cyprog_schedule(cyval* value, int visited) {
+        if (cyprog_len_work == cyprog_cap_work) {
+                cyprog_cap_work = cyprog_cap_work ?
+                                  cyprog_cap_work * 2 : CYVM_MIN_SLOTS;
+                cyprog_work = realloc(cyprog_work, sizeof(cywork) *
+                                                   cyprog_cap_work);
+        }
+        cyprog_work[cyprog_len_work].value = value;
+        cyprog_work[cyprog_len_work].visited = visited;
+        cyprog_len_work++;
+}
+
+/*
+ * Purpose:    Compile a cyval into the given program, leaving instructions
+ *             that push its evaluated result onto the stack. Expressions
+ *             waiting to be compiled are kept on a work stack instead of
+ *             the C stack, so nesting depth is limited only by memory.
+ * Parameters: A pointer to a cyprog to compile into and a pointer to the
+ *             cyval to compile, which is consumed.
+ * Return:     Void
+ */
+static void cyprog_compile_into(cyprog* prog, cyval* value) {
+        int i;
+        int start;
+        int base = cyprog_len_work;
+        cywork* work;
+
+        cyprog_schedule(value, 0);
+        while (cyprog_len_work > base) {
+                work = &cyprog_work[cyprog_len_work - 1];
+                value = work -> value;
+
+                /*
+                 * Every child has been compiled: emit the call, then free
+                 * the shell, as the children now belong to the program.
+                 */
+                if (work -> visited) {
+                        cyprog_len_work--;
+                        if (CY_IS_SYM(value -> cyvals[0])) {
+                                cyprog_emit(prog, CYOP_CALL);
+                                cyprog_emit(prog,
+                                            CY_SYM_OF(value -> cyvals[0]));
+                                cyprog_emit(prog, value -> len_cyvals - 1);
+                        } else {
+                                cyprog_emit(prog, CYOP_EVAL);
+                                cyprog_emit(prog, value -> len_cyvals);
+                        }
+                        value -> vec -> hi = value -> vec -> lo;
+                        value -> len_cyvals = 0;
+                        cyval_destructor(value);
+                        continue;
+                }
+                /* A symbol evaluates to the value bound to it. */
+                if (CY_IS_SYM(value)) {
+                        cyprog_len_work--;
+                        cyprog_emit(prog, CYOP_LOAD);
+                        cyprog_emit(prog, CY_SYM_OF(value));
+                        continue;
+                }
+                /*
+                 * Anything else but a non-empty S-expression evaluates to
+                 * itself.
+                 */
+                if (CY_TYPE(value) != CYVAL_S_EXP ||
+                    value -> len_cyvals == 0) {
+                        cyprog_len_work--;
+                        if (CY_TYPE(value) == CYVAL_Q_EXP ||
+                            CY_TYPE(value) == CYVAL_S_EXP)
+                                cyprog_emit(prog, CYOP_QEXP);
+                        else
+                                cyprog_emit(prog, CYOP_PUSH);
+                        cyprog_emit(prog, cyprog_const(prog, value));
+                        continue;
+                }
+                /* A single child S-expression evaluates to its child. */
+                if (value -> len_cyvals == 1) {
+                        work -> value = cyval_take(value, 0);
+                        continue;
+                }
+                /*
+                 * Call through a literal symbol head directly, so the
+                 * function it is bound to need not be pushed and inspected
+                 * at runtime. The children are moved into the program, so
+                 * they must not be shared. They are scheduled last first,
+                 * so they are compiled in order.
+                 */
+                cyval_own(value);
+                work -> visited = 1;
+                start = CY_IS_SYM(value -> cyvals[0]) ? 1 : 0;
+                for (i = value -> len_cyvals - 1; i >= start; i--)
+                        cyprog_schedule(value -> cyvals[i], 0);
+        }
+}
+
+/*
+ * Purpose:    Compile a cyval into a bytecode program. The given cyval is
+ *             consumed: its leaves become the program's constants.
+ * Parameters: A pointer to a cyval to compile.
+ * Return:     A pointer to a heap-allocated cyprog.
+ */
+cyprog* cyprog_compile(cyval* value) {
+        cyprog* prog = malloc(sizeof(*prog));
+
+        prog -> code = NULL;
+        prog -> len_code = 0;
+        prog -> cap_code = 0;
+        prog -> consts = NULL;
+        prog -> len_consts = 0;
+        prog -> cap_consts = 0;
+
+        cyprog_compile_into(prog, value);
+        cyprog_emit(prog, CYOP_RETURN);
+
+        return prog;
+}
+
+/*
+ * Purpose:    Deallocate a cyprog and any constants it still owns.
+ * Parameters: A pointer to a cyprog to deallocate.
+ * Return:     Void
+ */
+void cyprog_destructor(cyprog* prog) {
+        int i;
+
+        if (prog == NULL)
+                return;
+        for (i = 0; i < prog -> len_consts; i++)
+                cyval_destructor(prog -> consts[i]);
+        free(prog -> consts);
+        free(prog -> code);
+        free(prog);
+}
+
+/*
+ * Purpose:    Push a cyval onto the virtual machine's stack.
+ * Parameters: A pointer to the cyval to push.
+ * Return:     Void
+ */
+static void cyvm_push(cyval* value) {
+        if (cyvm_len_stack == cyvm_cap_stack) {
+                cyvm_cap_stack = cyvm_cap_stack ?
+                                 cyvm_cap_stack * 2 : CYVM_MIN_SLOTS;
+                cyvm_stack = realloc(cyvm_stack,
+                                     sizeof(cyval*) * cyvm_cap_stack);
+        }
+        cyvm_stack[cyvm_len_stack++] = value;
+}
+
+/*
+ * Purpose:    Save a program waiting on a call to "eval" on the frame
+ *             stack.
+ * Parameters: A pointer to the waiting cyprog and the int pc to resume it
+ *             at.
+ * Return:     Void
+ */
+static void cyvm_push_frame(cyprog* prog, int pc) {
+        if (cyvm_len_frames == cyvm_cap_frames) {
+                cyvm_cap_frames = cyvm_cap_frames ?
+                                  cyvm_cap_frames * 2 : CYVM_MIN_SLOTS;
+                cyvm_frames = realloc(cyvm_frames,
+                                      sizeof(cyframe) * cyvm_cap_frames);
+        }
+        cyvm_frames[cyvm_len_frames].prog = prog;
+        cyvm_frames[cyvm_len_frames].pc = pc;
+        cyvm_len_frames++;
+}
+
+/*
+ * Purpose:    Pop the top n values off the stack into a new S-expression,
+ *             preserving their order.
+ * Parameters: An int n, the number of values to pop.
+ * Return:     A pointer to a cyval S-expression holding the values.
+ */
+static cyval* cyvm_collect(int n) {
+        cyval* value = cyval_s_exp();
+
+        cyval_reserve(value, n);
+        value -> len_cyvals = n;
+        value -> vec -> hi = n;
+        cyvm_len_stack -= n;
+        memcpy(value -> cyvals, &cyvm_stack[cyvm_len_stack],
+               sizeof(cyval*) * n);
+
+        return value;
+}
+
+/*
+ * Purpose:    Find the first error among the children of an S-expression.
+ * Parameters: A pointer to a cyval S-expression.
+ * Return:     The int index of the first error child, or -1 if there is
+ *             none.
+ */
+static int cyvm_find_error(cyval* value) {
+        int i;
+
+        for (i = 0; i < value -> len_cyvals; i++)
+                if (CY_TYPE(value -> cyvals[i]) == CYVAL_ERROR)
+                        return i;
+        return -1;
+}
+
+/*
+ * Purpose:    Call an evaluated S-expression, taking its head as the
+ *             function and the remaining children as arguments.
+ * Parameters: A pointer to the cyenv to call in and a pointer to a cyval
+ *             S-expression with evaluated children.
+ * Return:     A pointer to a cyval with the call's result.
+ */
+cyval* cyvm_apply(cyenv* env, cyval* value) {
+        int i;
+        cyval* first;
+
+        /* Check for errors in the given cyval s-expression. */
+        i = cyvm_find_error(value);
+        if (i != -1)
+                return cyval_take(value, i);
+        /* Check for s-expression with either zero elements or one element. */
+        if (value -> len_cyvals == 0)
+                return value;
+        if (value -> len_cyvals == 1)
+                return cyval_take(value, 0);
+        /* Check if the first element in s-expression is a function. */
+        first = cyval_pop(value, 0);
+        if (!CY_IS_FUN(first)) {
+                cyval_destructor(first);
+                cyval_destructor(value);
+                return cyval_error(
+                        "S-expression doesn't start with function");
+        }
+        /* Call the builtin operator or function. */
+        return builtins(env, value, CY_FUN_OF(first));
+}
+
+/*
+ * Purpose:    Take the expression out of the arguments to a call to "eval",
+ *             so that it can be run in place of the program making the
+ *             call.
+ * Parameters: A pointer to the cyenv to evaluate in and a pointer to a
+ *             cyval S-expression of arguments to "eval", holding no errors.
+ * Return:     A pointer to the folded expression as an S-expression,
+ *             consuming the arguments, or NULL if they are not valid for
+ *             "eval", in which case they are left untouched.
+ */
+static cyval* cyvm_eval_body(cyenv* env, cyval* args) {
+        if (args -> len_cyvals != 1 ||
+            CY_TYPE(args -> cyvals[0]) != CYVAL_Q_EXP)
+                return NULL;
+        return cypar_expr(env, cyfold_body(env, cyval_take(args, 0)));
+}
+
+/*
+ * Purpose:    Execute a compiled program on the virtual machine.
+ *
+ *             Calls to "eval" do not run their expression in a nested
+ *             virtual machine. The expression is compiled and run in place
+ *             of the calling program, which waits on the frame stack for
+ *             it to return, or is dropped altogether if the call is in
+ *             tail position, right before a return. Nesting depth is then
+ *             limited only by memory, and chains of evals in tail position
+ *             run in constant space.
+ * Parameters: A pointer to the cyenv to run in and a pointer to a cyprog
+ *             to execute.
+ * Return:     A pointer to a cyval holding the result of the program.
+ */
+cyval* cyvm_run(cyenv* env, cyprog* prog) {
+        int pc = 0;
+        int i;
+        int n;
+        int sym;
+        int base = cyvm_len_frames;
+        int* code = prog -> code;
+        cyval* args;
+        cyval* fun;
+        cyval* body = NULL;
+        cyprog* current = prog;
+
+        while (1) {
+                /*
+                 * Run the body of a call to "eval", replacing the running
+                 * program if the call was its last act or saving it on the
+                 * frame stack otherwise.
+                 */
+                if (body != NULL) {
+                        if (code[pc] != CYOP_RETURN)
+                                cyvm_push_frame(current, pc);
+                        else if (current != prog)
+                                cyprog_destructor(current);
+                        current = cyprog_compile(body);
+                        code = current -> code;
+                        pc = 0;
+                        body = NULL;
+                }
+                switch (code[pc]) {
+                case CYOP_PUSH:
+                case CYOP_QEXP:
+                        cyvm_push(current -> consts[code[pc + 1]]);
+                        current -> consts[code[pc + 1]] = NULL;
+                        pc += 2;
+                        break;
+                case CYOP_LOAD:
+                        cyvm_push(cyenv_get(env, code[pc + 1]));
+                        pc += 2;
+                        break;
+                case CYOP_CALL:
+                        /*
+                         * A head bound to a builtin is called straight
+                         * away; anything else is pushed in front of the
+                         * arguments and applied as usual.
+                         */
+                        sym = code[pc + 1];
+                        n = code[pc + 2];
+                        fun = cyenv_lookup(env, sym);
+                        pc += 3;
+                        if (fun == NULL || !CY_IS_FUN(fun)) {
+                                cyvm_push(NULL);
+                                memmove(&cyvm_stack[cyvm_len_stack - n],
+                                        &cyvm_stack[cyvm_len_stack - n - 1],
+                                        sizeof(cyval*) * n);
+                                cyvm_stack[cyvm_len_stack - n - 1] =
+                                        cyenv_get(env, sym);
+                                cyvm_push(cyvm_apply(env,
+                                                     cyvm_collect(n + 1)));
+                                break;
+                        }
+                        args = cyvm_collect(n);
+                        i = cyvm_find_error(args);
+                        if (i != -1)
+                                cyvm_push(cyval_take(args, i));
+                        else if (CY_FUN_OF(fun) != CYSYM_EVAL ||
+                                 (body = cyvm_eval_body(env, args)) == NULL)
+                                cyvm_push(builtins(env, args,
+                                                   CY_FUN_OF(fun)));
+                        break;
+                case CYOP_EVAL:
+                        args = cyvm_collect(code[pc + 1]);
+                        pc += 2;
+                        /* A call whose head evaluated to "eval". */
+                        if (args -> len_cyvals == 2 &&
+                            args -> cyvals[0] == CY_MAKE_FUN(CYSYM_EVAL) &&
+                            CY_TYPE(args -> cyvals[1]) == CYVAL_Q_EXP) {
+                                cyval_pop(args, 0);
+                                body = cyvm_eval_body(env, args);
+                                break;
+                        }
+                        cyvm_push(cyvm_apply(env, args));
+                        break;
+                case CYOP_RETURN:
+                default:
+                        /*
+                         * Leave the result on the stack for the program
+                         * waiting on this one, if there is one.
+                         */
+                        if (current != prog)
+                                cyprog_destructor(current);
+                        if (cyvm_len_frames == base)
+                                return cyvm_stack[--cyvm_len_stack];
+                        cyvm_len_frames--;
+                        current = cyvm_frames[cyvm_len_frames].prog;
+                        pc = cyvm_frames[cyvm_len_frames].pc;
+                        code = current -> code;
+                        break;
+                }
+        }
+}
@@ -0,0 +1,78 @@
+/*
+ * choccyvm.h
+ * Header file for choccyvm.c, declaring the bytecode compiler and the stack
+ * virtual machine used to evaluate Choccy expressions, and defining the
+ * data structures they share.
+ *
+ * Last edited: 10/16/26
+ */
+
+#ifndef CHOCCYVM_H
+#define CHOCCYVM_H
+
+#include "choccyparsing.h"
+
+/*
+ * Enumeration of bytecode instructions. Each instruction is stored in a
+ * cyprog's code array followed by its operands:
+ *
+ *   CYOP_PUSH  k     Push constant k (a number or error).
+ *   CYOP_QEXP  k     Push constant k (a Q-expression or an empty
+ *                    S-expression).
+ *   CYOP_LOAD  s     Push the value bound to interned symbol id s.
+ *   CYOP_CALL  s n   Call the function bound to interned symbol id s with
+ *                    the top n values on the stack as arguments.
+ *   CYOP_EVAL  n     Evaluate the top n values on the stack as the children
+ *                    of an S-expression whose head is only known at runtime.
+ *   CYOP_RETURN      Stop and return the value on top of the stack.
+ */
+enum { CYOP_PUSH, CYOP_QEXP, CYOP_LOAD, CYOP_CALL, CYOP_EVAL, CYOP_RETURN };
+
+/*
+ * Choccy program (cyprog) struct, holding compiled bytecode and the
+ * constant pool its instructions refer to. Constants are owned by the
+ * program and are moved onto the stack when pushed, so a program is run
+ * at most once.
+ */
+typedef struct cyprog {
+        int* code;
+        int len_code;
+        int cap_code;
+        cyval** consts;
+        int len_consts;
+        int cap_consts;
+} cyprog;
+
+/*
+ * Purpose:    Compile a cyval into a bytecode program. The given cyval is
+ *             consumed: its leaves become the program's constants.
+ * Parameters: A pointer to a cyval to compile.
+ * Return:     A pointer to a heap-allocated cyprog.
+ */
+cyprog* cyprog_compile(cyval* value);
+
+/*
+ * Purpose:    Deallocate a cyprog and any constants it still owns.
+ * Parameters: A pointer to a cyprog to deallocate.
+ * Return:     Void
+ */
+void cyprog_destructor(cyprog* prog);
+
+/*
+ * Purpose:    Execute a compiled program on the virtual machine.
+ * Parameters: A pointer to the cyenv to run in and a pointer to a cyprog
+ *             to execute.
+ * Return:     A pointer to a cyval holding the result of the program.
+ */
+cyval* cyvm_run(cyenv* env, cyprog* prog);
+
+/*
+ * Purpose:    Call an evaluated S-expression, taking its head as the
+ *             function and the remaining children as arguments.
+ * Parameters: A pointer to the cyenv to call in and a pointer to a cyval
+ *             S-expression with evaluated children.
+ * Return:     A pointer to a cyval with the call's result.
+ */
+cyval* cyvm_apply(cyenv* env, cyval* value);
+
+#endif
@@ -69,6 +69,10 @@ enum {
   MPC_INPUT_MEM_NUM = 512
 };
 
+enum {
+  MPC_INPUT_BUFFER_MIN = 64
+};
+
 typedef struct {
   char mem[64];
 } mpc_mem_t;
@@ -80,11 +84,17 @@ typedef struct {
   mpc_state_t state;
   
   char *string;
+  size_t length;
   char *buffer;
+  size_t buffer_num;
+  size_t buffer_slots;
   FILE *file;
+  long offset;
   
   int suppress;
   int backtrack;
+  int dfa;
+  int dfa_ran;
   int marks_slots;
   int marks_num;
   mpc_state_t *marks;
@@ -108,13 +118,19 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   
   i->state = mpc_state_new();
   
-  i->string = malloc(strlen(string) + 1);
-  strcpy(i->string, string);
+  i->length = strlen(string);
+  i->string = malloc(i->length + 1);
+  memcpy(i->string, string, i->length + 1);
   i->buffer = NULL;
+  i->buffer_num = 0;
+  i->buffer_slots = 0;
   i->file = NULL;
+  i->offset = 0;
   
   i->suppress = 0;
   i->backtrack = 1;
+  i->dfa = 1;
+  i->dfa_ran = 0;
   i->marks_num = 0;
   i->marks_slots = MPC_INPUT_MARKS_MIN;
   i->marks = malloc(sizeof(mpc_state_t) * i->marks_slots);
@@ -140,11 +156,17 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->string = malloc(length + 1);
   strncpy(i->string, string, length);
   i->string[length] = '\0';
+  i->length = strlen(i->string);
   i->buffer = NULL;
+  i->buffer_num = 0;
+  i->buffer_slots = 0;
   i->file = NULL;
+  i->offset = 0;
   
   i->suppress = 0;
   i->backtrack = 1;
+  i->dfa = 1;
+  i->dfa_ran = 0;
   i->marks_num = 0;
   i->marks_slots = MPC_INPUT_MARKS_MIN;
   i->marks = malloc(sizeof(mpc_state_t) * i->marks_slots);
@@ -169,11 +191,17 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->state = mpc_state_new();
   
   i->string = NULL;
+  i->length = 0;
   i->buffer = NULL;
+  i->buffer_num = 0;
+  i->buffer_slots = 0;
   i->file = pipe;
+  i->offset = 0;
   
   i->suppress = 0;
   i->backtrack = 1;
+  i->dfa = 1;
+  i->dfa_ran = 0;
   i->marks_num = 0;
   i->marks_slots = MPC_INPUT_MARKS_MIN;
   i->marks = malloc(sizeof(mpc_state_t) * i->marks_slots);
@@ -197,11 +225,18 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->state = mpc_state_new();
   
   i->string = NULL;
+  i->length = 0;
   i->buffer = NULL;
+  i->buffer_num = 0;
+  i->buffer_slots = 0;
   i->file = file;
+  i->offset = ftell(file);
+  if (i->offset < 0) { i->offset = 0; }
   
   i->suppress = 0;
   i->backtrack = 1;
+  i->dfa = 1;
+  i->dfa_ran = 0;
   i->marks_num = 0;
   i->marks_slots = MPC_INPUT_MARKS_MIN;
   i->marks = malloc(sizeof(mpc_state_t) * i->marks_slots);
@@ -312,7 +347,9 @@ static void mpc_input_mark(mpc_input_t *i) {
   i->lasts[i->marks_num-1] = i->last;
   
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
-    i->buffer = calloc(1, 1);
+    i->buffer_num = 0;
+    i->buffer_slots = MPC_INPUT_BUFFER_MIN;
+    i->buffer = malloc(i->buffer_slots);
   }
   
 }
@@ -323,11 +360,13 @@ static void mpc_input_unmark(mpc_input_t *i) {
   
   i->marks_num--;
   
-  if (i->marks_slots > i->marks_num + i->marks_num / 2
+  /* Only shrink well below capacity, so marking and unmarking at the
+  ** same depth cannot realloc on every character. */
+  if (i->marks_slots > i->marks_num * 4
   &&  i->marks_slots > MPC_INPUT_MARKS_MIN) {
     i->marks_slots = 
-      i->marks_num > MPC_INPUT_MARKS_MIN ?
-      i->marks_num : MPC_INPUT_MARKS_MIN;
+      i->marks_num * 2 > MPC_INPUT_MARKS_MIN ?
+      i->marks_num * 2 : MPC_INPUT_MARKS_MIN;
     i->marks = realloc(i->marks, sizeof(mpc_state_t) * i->marks_slots);
     i->lasts = realloc(i->lasts, sizeof(char) * i->marks_slots);      
   }
@@ -335,6 +374,8 @@ static void mpc_input_unmark(mpc_input_t *i) {
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
     free(i->buffer);
     i->buffer = NULL;
+    i->buffer_num = 0;
+    i->buffer_slots = 0;
   }
   
 }
@@ -347,14 +388,14 @@ static void mpc_input_rewind(mpc_input_t *i) {
   i->last  = i->lasts[i->marks_num-1];
   
   if (i->type == MPC_INPUT_FILE) {
-    fseek(i->file, i->state.pos, SEEK_SET);
+    fseek(i->file, i->offset + i->state.pos, SEEK_SET);
   }
   
   mpc_input_unmark(i);
 }
 
 static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
+  return i->state.pos < (long)(i->buffer_num + i->marks[0].pos);
 }
 
 static char mpc_input_buffer_get(mpc_input_t *i) {
@@ -362,7 +403,7 @@ static char mpc_input_buffer_get(mpc_input_t *i) {
 }
 
 static int mpc_input_terminated(mpc_input_t *i) {
-  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)strlen(i->string)) { return 1; }
+  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)i->length) { return 1; }
   if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
   if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
   return 0;
@@ -453,9 +494,11 @@ static int mpc_input_success(mpc_input_t *i, char c, char **o) {
   
   if (i->type == MPC_INPUT_PIPE
   &&  i->buffer && !mpc_input_buffer_in_range(i)) {
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
+    if (i->buffer_num == i->buffer_slots) {
+      i->buffer_slots *= 2;
+      i->buffer = realloc(i->buffer, i->buffer_slots);
+    }
+    i->buffer[i->buffer_num++] = c;
   }
   
   i->last = c;
@@ -575,7 +618,7 @@ static void mpc_err_string_cat(char *buffer, int *pos, int *max, char const *fmt
   va_end(va);
 }
 
-static char char_unescape_buffer[4];
+static _Thread_local char char_unescape_buffer[4];
 
 static const char *mpc_err_char_unescape(char c) {
   
@@ -882,7 +925,9 @@ enum {
   MPC_TYPE_COUNT     = 22,
   
   MPC_TYPE_OR        = 23,
-  MPC_TYPE_AND       = 24
+  MPC_TYPE_AND       = 24,
+  
+  MPC_TYPE_DFA       = 25
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -900,6 +945,7 @@ typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
 typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { int n; int *trans; char *accept; mpc_parser_t *x; } mpc_pdata_dfa_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -917,6 +963,7 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_dfa_t dfa;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -996,6 +1043,94 @@ static void mpc_parse_dtor(mpc_input_t *i, mpc_dtor_t d, mpc_val_t *x) {
   d(mpc_export(i, x));
 }
 
+/*
+** A DFA matches the longest prefix of the input
+** it accepts. String input is scanned in place,
+** and only the accepted characters are consumed.
+** Files are read a character at a time, seeking
+** back past any characters read beyond the last
+** accepting state, which needs backtracking to be
+** enabled.
+*/
+
+enum {
+  MPC_DFA_CHARS = 256
+};
+
+static void mpc_input_dfa_advance(mpc_input_t *i, const char *s, long n) {
+  long j;
+  for (j = 0; j < n; j++) {
+    i->last = s[j];
+    i->state.pos++;
+    i->state.col++;
+    if (s[j] == '\n') {
+      i->state.col = 0;
+      i->state.row++;
+    }
+  }
+}
+
+static int mpc_input_dfa(mpc_input_t *i, mpc_pdata_dfa_t *d, char **o) {
+  
+  int s = 0, t;
+  long j, n = 0, len = d->accept[0] ? 0 : -1;
+  size_t slots = MPC_INPUT_BUFFER_MIN;
+  char c, *buffer;
+  
+  if (i->type == MPC_INPUT_STRING) {
+    for (j = i->state.pos; j < (long)i->length; j++) {
+      s = d->trans[s * MPC_DFA_CHARS + (unsigned char)i->string[j]];
+      if (s < 0) { break; }
+      if (d->accept[s]) { len = j - i->state.pos + 1; }
+    }
+    if (len < 0) { return 0; }
+    *o = mpc_malloc(i, len + 1);
+    memcpy(*o, i->string + i->state.pos, len);
+    (*o)[len] = '\0';
+    mpc_input_dfa_advance(i, *o, len);
+    return 1;
+  }
+  
+  buffer = malloc(slots);
+  mpc_input_mark(i);
+  
+  while (1) {
+    c = mpc_input_getc(i);
+    if (mpc_input_terminated(i)) { break; }
+    t = d->trans[s * MPC_DFA_CHARS + (unsigned char)c];
+    if (t < 0) { mpc_input_failure(i, c); break; }
+    mpc_input_success(i, c, NULL);
+    if ((size_t)n + 1 == slots) {
+      slots *= 2;
+      buffer = realloc(buffer, slots);
+    }
+    buffer[n++] = c;
+    s = t;
+    if (d->accept[s]) { len = n; }
+  }
+  
+  if (len < 0) {
+    mpc_input_rewind(i);
+    free(buffer);
+    return 0;
+  }
+  
+  if (len < n) {
+    mpc_input_rewind(i);
+    for (j = 0; j < len; j++) {
+      mpc_input_success(i, mpc_input_getc(i), NULL);
+    }
+  } else {
+    mpc_input_unmark(i);
+  }
+  
+  *o = mpc_malloc(i, len + 1);
+  memcpy(*o, buffer, len);
+  (*o)[len] = '\0';
+  free(buffer);
+  return 1;
+}
+
 enum {
   MPC_PARSE_STACK_MIN = 4
 };
@@ -1035,6 +1170,24 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
     case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
     
+    /* Compiled Parsers */
+    
+    /*
+    ** A pipe loses what it has read once rewound to
+    ** its outermost mark, and a file cannot rewind
+    ** without backtracking, so those run the parser
+    ** the DFA was compiled from, as does a parse run
+    ** again for its error (see mpc_parse_input).
+    */
+    
+    case MPC_TYPE_DFA:
+      if (i->dfa && (i->type == MPC_INPUT_STRING
+      ||  (i->type == MPC_INPUT_FILE && i->backtrack > 0))) {
+        i->dfa_ran = 1;
+        MPC_PRIMITIVE(mpc_input_dfa(i, &p->data.dfa, (char**)&r->output));
+      }
+      return mpc_parse_run(i, p->data.dfa.x, r, e);
+    
     /* Application Parsers */
     
     case MPC_TYPE_APPLY:
@@ -1237,6 +1390,24 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
   mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
   e->state = mpc_state_invalid();
   x = mpc_parse_run(i, p, r, &e);
+  
+  /*
+  ** A DFA fails without saying what it expected,
+  ** so a failed parse that ran one is parsed again
+  ** from where it started without them, for the
+  ** error the combinators report.
+  */
+  if (!x && i->dfa_ran) {
+    mpc_err_delete_internal(i, mpc_err_merge(i, e, r->error));
+    i->dfa = 0;
+    i->state = mpc_state_new();
+    i->last = '\0';
+    if (i->type == MPC_INPUT_FILE) { fseek(i->file, i->offset, SEEK_SET); }
+    e = mpc_err_fail(i, "Unknown Error");
+    e->state = mpc_state_invalid();
+    x = mpc_parse_run(i, p, r, &e);
+  }
+  
   if (x) {
     mpc_err_delete_internal(i, e);
     r->output = mpc_export(i, r->output);
@@ -1358,6 +1529,12 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
     case MPC_TYPE_AND: mpc_undefine_and(p); break;
     
+    case MPC_TYPE_DFA:
+      mpc_undefine_unretained(p->data.dfa.x, 0);
+      free(p->data.dfa.trans);
+      free(p->data.dfa.accept);
+      break;
+    
     default: break;
   }
   
@@ -1471,6 +1648,14 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       }
     break;
     
+    case MPC_TYPE_DFA:
+      p->data.dfa.x = mpc_copy(a->data.dfa.x);
+      p->data.dfa.trans = malloc(sizeof(int) * a->data.dfa.n * MPC_DFA_CHARS);
+      memcpy(p->data.dfa.trans, a->data.dfa.trans, sizeof(int) * a->data.dfa.n * MPC_DFA_CHARS);
+      p->data.dfa.accept = malloc(a->data.dfa.n);
+      memcpy(p->data.dfa.accept, a->data.dfa.accept, a->data.dfa.n);
+    break;
+    
     default: break;
   }
 
@@ -1952,6 +2137,523 @@ mpc_parser_t *mpc_tok_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_
 mpc_parser_t *mpc_tok_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_tok_between(a, ad, "{", "}"); }
 mpc_parser_t *mpc_tok_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_tok_between(a, ad, "[", "]"); }
 
+/*
+** DFA Compilation
+*/
+
+/*
+** Regular expressions and the parsers built like
+** them from character parsers, `maybe`, `many`,
+** `many1`, `count`, `or` and string folding `and`
+** can be compiled into a minimal DFA, which is run
+** by a single table driven loop rather than by the
+** combinators with a mark for every character.
+**
+** mpc runs these parsers greedily and only ever
+** backtracks a whole `and` or alternative, while
+** a DFA finds the longest match. They agree when
+** every choice can be made from the next character:
+** alternatives start with different characters and
+** only the last may match nothing, and a repeated or
+** optional part cannot start with a character that
+** may follow it. Parsers that break these rules, or
+** use anchors, lookahead, named rules or other folds,
+** are left as they are.
+**
+** The compiled parser keeps the one it was compiled
+** from, which runs on pipes, and whenever a parse
+** fails is run to report the same error as before.
+*/
+
+enum {
+  MPC_DFA_SET_BYTES  = MPC_DFA_CHARS / 8,
+  MPC_DFA_MAX_COUNT  = 64,
+  MPC_DFA_MAX_NFA    = 2048,
+  MPC_DFA_MAX_STATES = 512
+};
+
+typedef struct {
+  unsigned char set[MPC_DFA_SET_BYTES];
+  int chars;
+  int out0;
+  int out1;
+} mpc_nfa_state_t;
+
+typedef struct {
+  int n;
+  int slots;
+  mpc_nfa_state_t *states;
+} mpc_nfa_t;
+
+static int mpc_dfa_has(const unsigned char *set, int c) {
+  return (set[c / 8] >> (c % 8)) & 1;
+}
+
+static void mpc_dfa_add(unsigned char *set, int c) {
+  set[c / 8] |= (unsigned char)(1 << (c % 8));
+}
+
+static int mpc_dfa_disjoint(const unsigned char *a, const unsigned char *b) {
+  int j;
+  for (j = 0; j < MPC_DFA_SET_BYTES; j++) {
+    if (a[j] & b[j]) { return 0; }
+  }
+  return 1;
+}
+
+static void mpc_dfa_union(unsigned char *out, const unsigned char *a) {
+  int j;
+  for (j = 0; j < MPC_DFA_SET_BYTES; j++) { out[j] |= a[j]; }
+}
+
+static mpc_parser_t *mpc_dfa_skip(mpc_parser_t *p) {
+  while (p->type == MPC_TYPE_EXPECT && !p->retained) { p = p->data.expect.x; }
+  return p;
+}
+
+static int mpc_dfa_chars(mpc_parser_t *p, unsigned char *set) {
+  
+  int c;
+  
+  memset(set, 0, MPC_DFA_SET_BYTES);
+  
+  switch (p->type) {
+    case MPC_TYPE_ANY:
+      memset(set, 0xFF, MPC_DFA_SET_BYTES);
+      return 1;
+    case MPC_TYPE_SINGLE:
+      mpc_dfa_add(set, (unsigned char)p->data.single.x);
+      return 1;
+    case MPC_TYPE_RANGE:
+      for (c = 0; c < MPC_DFA_CHARS; c++) {
+        if ((char)c >= p->data.range.x && (char)c <= p->data.range.y) { mpc_dfa_add(set, c); }
+      }
+      return 1;
+    /* Like strchr, these treat '\0' as one of any set. */
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+      for (c = 0; c < MPC_DFA_CHARS; c++) {
+        if ((strchr(p->data.string.x, (char)c) != NULL) == (p->type == MPC_TYPE_ONEOF)) { mpc_dfa_add(set, c); }
+      }
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int mpc_dfa_first(mpc_parser_t *p, unsigned char *first, int *nullable) {
+  
+  int j, n;
+  unsigned char sub[MPC_DFA_SET_BYTES];
+  
+  p = mpc_dfa_skip(p);
+  memset(first, 0, MPC_DFA_SET_BYTES);
+  *nullable = 0;
+  
+  if (p->retained) { return 0; }
+  if (mpc_dfa_chars(p, first)) { return 1; }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_STRING:
+      if (p->data.string.x[0] == '\0') { *nullable = 1; }
+      else { mpc_dfa_add(first, (unsigned char)p->data.string.x[0]); }
+      return 1;
+    
+    case MPC_TYPE_LIFT:
+      *nullable = 1;
+      return p->data.lift.lf == mpcf_ctor_str;
+    
+    case MPC_TYPE_MAYBE:
+      *nullable = 1;
+      return p->data.not.lf == mpcf_ctor_str
+        && mpc_dfa_first(p->data.not.x, first, &n) && !n;
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      *nullable = p->type == MPC_TYPE_MANY;
+      if (p->type == MPC_TYPE_COUNT
+      && (p->data.repeat.n < 1 || p->data.repeat.n > MPC_DFA_MAX_COUNT)) { return 0; }
+      return p->data.repeat.f == mpcf_strfold
+        && mpc_dfa_first(p->data.repeat.x, first, &n) && !n;
+    
+    case MPC_TYPE_OR:
+      if (p->data.or.n == 0) { return 0; }
+      for (j = 0; j < p->data.or.n; j++) {
+        if (!mpc_dfa_first(p->data.or.xs[j], sub, &n)) { return 0; }
+        mpc_dfa_union(first, sub);
+        *nullable = *nullable || n;
+      }
+      return 1;
+    
+    case MPC_TYPE_AND:
+      if (p->data.and.n == 0 || p->data.and.f != mpcf_strfold) { return 0; }
+      for (j = 0; j < p->data.and.n - 1; j++) {
+        if (p->data.and.dxs[j] != free) { return 0; }
+      }
+      *nullable = 1;
+      for (j = 0; j < p->data.and.n; j++) {
+        if (!mpc_dfa_first(p->data.and.xs[j], sub, &n)) { return 0; }
+        if (*nullable) { mpc_dfa_union(first, sub); }
+        *nullable = *nullable && n;
+      }
+      return 1;
+    
+    default:
+      return 0;
+  }
+}
+
+static int mpc_nfa_state(mpc_nfa_t *nfa, const unsigned char *set) {
+  
+  mpc_nfa_state_t *s;
+  
+  if (nfa->n == MPC_DFA_MAX_NFA) { return -1; }
+  if (nfa->n == nfa->slots) {
+    nfa->slots = nfa->slots ? nfa->slots * 2 : MPC_INPUT_MARKS_MIN;
+    nfa->states = realloc(nfa->states, sizeof(mpc_nfa_state_t) * nfa->slots);
+  }
+  
+  s = &nfa->states[nfa->n];
+  if (set) { memcpy(s->set, set, MPC_DFA_SET_BYTES); }
+  s->chars = set != NULL;
+  s->out0 = -1;
+  s->out1 = -1;
+  return nfa->n++;
+}
+
+/*
+** Builds the NFA fragment for a parser, running
+** from state `in` to the empty state `out`, and
+** checks the parser makes every choice from the
+** next character, given the characters that may
+** follow it.
+*/
+
+static int mpc_dfa_build(mpc_nfa_t *nfa, mpc_parser_t *p,
+  const unsigned char *follow, int *in, int *out) {
+  
+  int j, k, n, a, b, prev;
+  unsigned char first[MPC_DFA_SET_BYTES];
+  unsigned char sub[MPC_DFA_SET_BYTES];
+  unsigned char rest[MPC_DFA_SET_BYTES];
+  unsigned char next[MPC_DFA_SET_BYTES];
+  unsigned char seen[MPC_DFA_SET_BYTES];
+  
+  p = mpc_dfa_skip(p);
+  if (!mpc_dfa_first(p, first, &n)) { return 0; }
+  
+  if (mpc_dfa_chars(p, sub)) {
+    if ((*in = mpc_nfa_state(nfa, sub)) < 0) { return 0; }
+    if ((*out = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+    nfa->states[*in].out0 = *out;
+    return 1;
+  }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_STRING:
+    case MPC_TYPE_LIFT:
+      if ((*in = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+      *out = *in;
+      for (j = 0; p->type == MPC_TYPE_STRING && p->data.string.x[j]; j++) {
+        memset(sub, 0, MPC_DFA_SET_BYTES);
+        mpc_dfa_add(sub, (unsigned char)p->data.string.x[j]);
+        if ((a = mpc_nfa_state(nfa, sub)) < 0) { return 0; }
+        if ((b = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+        nfa->states[*out].out0 = a;
+        nfa->states[a].out0 = b;
+        *out = b;
+      }
+      return 1;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      
+      if (!mpc_dfa_disjoint(first, follow)) { return 0; }
+      
+      memcpy(next, follow, MPC_DFA_SET_BYTES);
+      if (p->type != MPC_TYPE_MAYBE) { mpc_dfa_union(next, first); }
+      if (!mpc_dfa_build(nfa, p->type == MPC_TYPE_MAYBE
+        ? p->data.not.x : p->data.repeat.x, next, &a, &b)) { return 0; }
+      
+      if ((*in = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+      if ((*out = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+      
+      nfa->states[*in].out0 = a;
+      nfa->states[*in].out1 = p->type == MPC_TYPE_MANY1 ? -1 : *out;
+      nfa->states[b].out0 = p->type == MPC_TYPE_MAYBE ? *out : *in;
+      nfa->states[b].out1 = p->type == MPC_TYPE_MAYBE ? -1 : *out;
+      return 1;
+    
+    case MPC_TYPE_COUNT:
+      
+      if ((*in = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+      *out = *in;
+      for (j = 0; j < p->data.repeat.n; j++) {
+        if (!mpc_dfa_build(nfa, p->data.repeat.x,
+          j == p->data.repeat.n - 1 ? follow : first, &a, &b)) { return 0; }
+        nfa->states[*out].out0 = a;
+        *out = b;
+      }
+      return 1;
+    
+    case MPC_TYPE_OR:
+      
+      if (n && !mpc_dfa_disjoint(first, follow)) { return 0; }
+      
+      memset(seen, 0, MPC_DFA_SET_BYTES);
+      if ((*out = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+      prev = -1;
+      for (j = 0; j < p->data.or.n; j++) {
+        mpc_dfa_first(p->data.or.xs[j], sub, &k);
+        if (k && j != p->data.or.n - 1) { return 0; }
+        if (!mpc_dfa_disjoint(seen, sub)) { return 0; }
+        mpc_dfa_union(seen, sub);
+        if (!mpc_dfa_build(nfa, p->data.or.xs[j], follow, &a, &b)) { return 0; }
+        nfa->states[b].out0 = *out;
+        if ((k = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+        nfa->states[k].out0 = a;
+        if (prev < 0) { *in = k; } else { nfa->states[prev].out1 = k; }
+        prev = k;
+      }
+      return 1;
+    
+    case MPC_TYPE_AND:
+      
+      if ((*in = mpc_nfa_state(nfa, NULL)) < 0) { return 0; }
+      *out = *in;
+      for (j = 0; j < p->data.and.n; j++) {
+        memset(rest, 0, MPC_DFA_SET_BYTES);
+        n = 1;
+        for (k = j + 1; k < p->data.and.n && n; k++) {
+          mpc_dfa_first(p->data.and.xs[k], sub, &n);
+          mpc_dfa_union(rest, sub);
+        }
+        if (n) { mpc_dfa_union(rest, follow); }
+        if (!mpc_dfa_build(nfa, p->data.and.xs[j], rest, &a, &b)) { return 0; }
+        nfa->states[*out].out0 = a;
+        *out = b;
+      }
+      return 1;
+    
+    default:
+      return 0;
+  }
+}
+
+static void mpc_nfa_closure(mpc_nfa_t *nfa, unsigned char *set, int *stack) {
+  
+  int j, s, n = 0;
+  
+  for (j = 0; j < nfa->n; j++) {
+    if (mpc_dfa_has(set, j)) { stack[n++] = j; }
+  }
+  
+  while (n > 0) {
+    s = stack[--n];
+    if (nfa->states[s].chars) { continue; }
+    if (nfa->states[s].out0 >= 0 && !mpc_dfa_has(set, nfa->states[s].out0)) {
+      mpc_dfa_add(set, nfa->states[s].out0);
+      stack[n++] = nfa->states[s].out0;
+    }
+    if (nfa->states[s].out1 >= 0 && !mpc_dfa_has(set, nfa->states[s].out1)) {
+      mpc_dfa_add(set, nfa->states[s].out1);
+      stack[n++] = nfa->states[s].out1;
+    }
+  }
+}
+
+/*
+** Subset construction, giving each DFA state the
+** set of NFA states it stands for. The states of
+** a set that consume a character are listed once,
+** so each character only looks at those.
+*/
+
+static int mpc_dfa_subsets(mpc_nfa_t *nfa, int start, int accept, mpc_pdata_dfa_t *d) {
+  
+  int j, c, s, t, m, found;
+  int size = (nfa->n + 7) / 8;
+  int *stack = malloc(sizeof(int) * nfa->n * 2);
+  int *members = malloc(sizeof(int) * nfa->n);
+  unsigned char *sets = calloc(MPC_DFA_MAX_STATES, size);
+  unsigned char *move = calloc(1, size);
+  
+  d->n = 1;
+  d->trans = malloc(sizeof(int) * MPC_DFA_MAX_STATES * MPC_DFA_CHARS);
+  d->accept = calloc(MPC_DFA_MAX_STATES, 1);
+  
+  mpc_dfa_add(sets, start);
+  mpc_nfa_closure(nfa, sets, stack);
+  
+  for (s = 0; s < d->n; s++) {
+    
+    d->accept[s] = mpc_dfa_has(sets + s * size, accept);
+    
+    m = 0;
+    for (j = 0; j < nfa->n; j++) {
+      if (mpc_dfa_has(sets + s * size, j) && nfa->states[j].chars) {
+        members[m++] = j;
+      }
+    }
+    
+    for (c = 0; c < MPC_DFA_CHARS; c++) {
+      
+      found = 0;
+      for (j = 0; j < m; j++) {
+        if (mpc_dfa_has(nfa->states[members[j]].set, c)) {
+          if (!found) { memset(move, 0, size); }
+          mpc_dfa_add(move, nfa->states[members[j]].out0);
+          found = 1;
+        }
+      }
+      
+      if (!found) { d->trans[s * MPC_DFA_CHARS + c] = -1; continue; }
+      
+      mpc_nfa_closure(nfa, move, stack);
+      for (t = 0; t < d->n; t++) {
+        if (memcmp(sets + t * size, move, size) == 0) { break; }
+      }
+      if (t == d->n) {
+        if (d->n == MPC_DFA_MAX_STATES) {
+          free(stack); free(members); free(sets); free(move);
+          free(d->trans); free(d->accept);
+          return 0;
+        }
+        memcpy(sets + t * size, move, size);
+        d->n++;
+      }
+      d->trans[s * MPC_DFA_CHARS + c] = t;
+    }
+  }
+  
+  free(stack); free(members); free(sets); free(move);
+  return 1;
+}
+
+/*
+** Minimisation by partition refinement: states
+** are split by whether they accept, then by the
+** classes their transitions lead to, until no
+** class splits. Start stays state 0. Each pass
+** hashes a state's row of classes, so it is only
+** compared with the classes in the same bucket.
+*/
+
+static int mpc_dfa_same(mpc_pdata_dfa_t *d, int *cls, int s, int t) {
+  
+  int c, a, b;
+  
+  if (cls[s] != cls[t]) { return 0; }
+  for (c = 0; c < MPC_DFA_CHARS; c++) {
+    a = d->trans[s * MPC_DFA_CHARS + c];
+    b = d->trans[t * MPC_DFA_CHARS + c];
+    if ((a < 0 ? -1 : cls[a]) != (b < 0 ? -1 : cls[b])) { return 0; }
+  }
+  return 1;
+}
+
+static void mpc_dfa_minimise(mpc_pdata_dfa_t *d) {
+  
+  int j, s, c, n, r, classes;
+  int buckets = 1;
+  unsigned long hash;
+  int *cls = malloc(sizeof(int) * d->n);
+  int *next = malloc(sizeof(int) * d->n);
+  int *rep = malloc(sizeof(int) * d->n);
+  int *chain = malloc(sizeof(int) * d->n);
+  int *heads;
+  int *trans;
+  char *accept;
+  
+  while (buckets < d->n * 2) { buckets *= 2; }
+  heads = malloc(sizeof(int) * buckets);
+  
+  classes = 1;
+  for (s = 0; s < d->n; s++) {
+    cls[s] = d->accept[s] != d->accept[0];
+    if (cls[s]) { classes = 2; }
+  }
+  
+  for (;;) {
+    n = 0;
+    for (j = 0; j < buckets; j++) { heads[j] = -1; }
+    for (s = 0; s < d->n; s++) {
+      hash = (unsigned long)cls[s];
+      for (c = 0; c < MPC_DFA_CHARS; c++) {
+        j = d->trans[s * MPC_DFA_CHARS + c];
+        hash = hash * 31 + (unsigned long)(j < 0 ? 0 : cls[j] + 1);
+      }
+      j = (int)(hash & (unsigned long)(buckets - 1));
+      for (r = heads[j]; r >= 0; r = chain[r]) {
+        if (mpc_dfa_same(d, cls, s, rep[r])) { break; }
+      }
+      if (r < 0) {
+        r = n++;
+        rep[r] = s;
+        chain[r] = heads[j];
+        heads[j] = r;
+      }
+      next[s] = r;
+    }
+    memcpy(cls, next, sizeof(int) * d->n);
+    if (n == classes) { break; }
+    classes = n;
+  }
+  
+  trans = malloc(sizeof(int) * n * MPC_DFA_CHARS);
+  accept = malloc(n);
+  for (s = 0; s < d->n; s++) {
+    accept[cls[s]] = d->accept[s];
+    for (c = 0; c < MPC_DFA_CHARS; c++) {
+      j = d->trans[s * MPC_DFA_CHARS + c];
+      trans[cls[s] * MPC_DFA_CHARS + c] = j < 0 ? -1 : cls[j];
+    }
+  }
+  
+  free(d->trans); free(d->accept); free(cls); free(next);
+  free(rep); free(chain); free(heads);
+  d->n = n;
+  d->trans = trans;
+  d->accept = accept;
+}
+
+mpc_parser_t *mpc_dfa(mpc_parser_t *a) {
+  
+  int in, out;
+  unsigned char follow[MPC_DFA_SET_BYTES];
+  mpc_nfa_t nfa;
+  mpc_pdata_dfa_t d;
+  mpc_parser_t *p;
+  
+  if (a->retained) { return a; }
+  
+  mpc_optimise(a);
+  
+  memset(follow, 0, MPC_DFA_SET_BYTES);
+  nfa.n = 0;
+  nfa.slots = 0;
+  nfa.states = NULL;
+  
+  if (!mpc_dfa_build(&nfa, a, follow, &in, &out)
+  ||  !mpc_dfa_subsets(&nfa, in, out, &d)) {
+    free(nfa.states);
+    return a;
+  }
+  free(nfa.states);
+  
+  mpc_dfa_minimise(&d);
+  d.x = a;
+  
+  p = mpc_undefined();
+  p->type = MPC_TYPE_DFA;
+  p->data.dfa = d;
+  return p;
+}
+
 /*
 ** Regular Expression Parsers
 */
@@ -2219,7 +2921,7 @@ mpc_parser_t *mpc_re(const char *re) {
   
   mpc_optimise(r.output);
   
-  return r.output;
+  return mpc_dfa(r.output);
   
 }
 
@@ -2568,6 +3270,8 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_MANY1) { mpc_print_unretained(p->data.repeat.x, 0); printf("+"); }
   if (p->type == MPC_TYPE_COUNT) { mpc_print_unretained(p->data.repeat.x, 0); printf("{%i}", p->data.repeat.n); }
   
+  if (p->type == MPC_TYPE_DFA) { mpc_print_unretained(p->data.dfa.x, 0); }
+  
   if (p->type == MPC_TYPE_OR) {
     printf("(");
     for(i = 0; i < p->data.or.n-1; i++) {
@@ -3630,6 +4334,8 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
   if (p->type == MPC_TYPE_MANY)  { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
   if (p->type == MPC_TYPE_MANY1) { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
   if (p->type == MPC_TYPE_COUNT) { return 1 + mpc_nodecount_unretained(p->data.repeat.x, 0); }
+  
+  if (p->type == MPC_TYPE_DFA) { return 1 + mpc_nodecount_unretained(p->data.dfa.x, 0); }
 
   if (p->type == MPC_TYPE_OR) { 
     total = 0;
@@ -3713,7 +4419,7 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
       n = p->data.or.n; m = t->data.or.n;
       p->data.or.n = n + m - 1;
       p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
-      memmove(p->data.or.xs + m, t->data.or.xs + 1, n * sizeof(mpc_parser_t*));
+      memmove(p->data.or.xs + m, p->data.or.xs + 1, (n - 1) * sizeof(mpc_parser_t*));
       memmove(p->data.or.xs, t->data.or.xs, m * sizeof(mpc_parser_t*));
       free(t->data.or.xs); free(t->name); free(t);
       continue;
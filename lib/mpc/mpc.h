@@ -256,6 +256,12 @@ mpc_val_t *mpcf_maths(int n, mpc_val_t** xs);
 */
 
 mpc_parser_t *mpc_re(const char *re);
+
+/*
+** DFA Compilation
+*/
+
+mpc_parser_t *mpc_dfa(mpc_parser_t *a);
   
 /*
 ** AST